@@ -41,11 +41,21 @@
 #include "control/conf.h"
 #include "develop/imageop.h"
 
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <libintl.h>
+#include <signal.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#ifdef _WIN32
+#include "win/getdelim.h"
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
 #ifdef __APPLE__
 #include "osx/osx.h"
 #endif
@@ -62,6 +72,7 @@
 static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s [<input file or dir>] [<xmp file>] <output destination> [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "       %s --batch <file or -> [options] [--core <darktable options>]\n", progname);
   fprintf(stderr, "\n");
   fprintf(stderr, "options:\n");
   fprintf(stderr, "   --width <max width> default: 0 = full resolution\n");
@@ -83,6 +94,13 @@ static void usage(const char *progname)
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
   fprintf(stderr, "   --icc-intent <intent> specify icc intent, default to LAST\n");
   fprintf(stderr, "                     use --help icc-intent for list of supported intents\n");
+  fprintf(stderr, "   --batch <file or -> export the jobs listed in file, or read from stdin\n");
+#ifndef _WIN32
+  fprintf(stderr, "   --batch-socket <path> serve export jobs on a local socket\n");
+#endif
+  fprintf(stderr, "                     one job per line: <input> TAB <xmp or empty> TAB <output>\n");
+  fprintf(stderr, "                     [TAB <option>=<value>]..., options as above without dashes\n");
+  fprintf(stderr, "                     a line 'quit' ends the batch\n");
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h [option]\n");
   fprintf(stderr, "   --version\n");
@@ -175,6 +193,441 @@ static dt_iop_color_intent_t get_icc_intent(const char* option)
 }
 #undef ICC_INTENT_FROM_STR
 
+// export settings given on the command line. in batch mode they are the defaults
+// that each job can override.
+typedef struct dt_cli_export_t
+{
+  int width, height;
+  gboolean high_quality, upscale, export_masks, style_overwrite;
+  const char *style;
+  const char *output_ext;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const char *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} dt_cli_export_t;
+
+// state of a --batch run, kept across all job lists and socket connections
+typedef struct dt_cli_batch_t
+{
+  dt_cli_export_t defaults;
+  GHashTable *exported; // ids of the images earlier jobs were run on
+  int num;              // jobs seen so far
+  int failed;           // jobs that failed
+} dt_cli_batch_t;
+
+static int parse_bool(const char *option, gboolean *value)
+{
+  gchar *str = g_ascii_strup(option, -1);
+  int err = 0;
+  if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
+    *value = FALSE;
+  else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
+    *value = TRUE;
+  else
+    err = 1;
+  g_free(str);
+  return err;
+}
+
+// returns the name of the format module to export to and cuts the extension off `output_filename'.
+// `output_ext' takes preference over the extension of the file name. NULL if there is no usable one.
+static gchar *split_output_ext(char *output_filename, const char *output_ext)
+{
+  gchar *ext = NULL;
+  char *dot = strrchr(output_filename, '.');
+  if(!output_ext)
+  {
+    // by this point we're sure output is not dir, there's no output ext specified
+    // so only place to look for it is in filename
+    if(dot && strlen(dot) > DT_MAX_OUTPUT_EXT_LENGTH)
+    {
+      // too long ext, no point in wasting time
+      fprintf(stderr, _("too long output file extension: %s\n"), dot);
+      return NULL;
+    }
+    else if(!dot || strlen(dot) <= 1)
+    {
+      // no ext or empty ext, no point in wasting time
+      fprintf(stderr, _("no output file extension given\n"));
+      return NULL;
+    }
+    *dot = '\0';
+    ext = g_strdup(dot + 1);
+  }
+  else
+  {
+    // check and remove redundant file ext
+    if(dot && !strcmp(output_ext, dot + 1)) *dot = '\0';
+    ext = g_strdup(output_ext);
+  }
+
+  if(!strcmp(ext, "jpg"))
+  {
+    g_free(ext);
+    ext = g_strdup("jpeg");
+  }
+
+  if(!strcmp(ext, "tif"))
+  {
+    g_free(ext);
+    ext = g_strdup("tiff");
+  }
+
+  return ext;
+}
+
+// export the images in `id_list' with the disk storage to `output_filename', a file name
+// pattern without extension. returns 0 on success, 1 if some images failed and -1 if
+// the export could not be set up at all.
+static int export_images(GList **id_list, const char *output_filename, const char *output_ext,
+                         const dt_cli_export_t *opts)
+{
+  // init the export data structures
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata, *fdata;
+
+  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
+  if(storage == NULL)
+  {
+    fprintf(
+        stderr, "%s\n",
+        _("cannot find disk storage module. please check your installation, something seems to be broken."));
+    return -1;
+  }
+
+  sdata = storage->get_params(storage);
+  if(sdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
+    return -1;
+  }
+
+  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
+  // any longer ...
+  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
+  // all is good now, the last line didn't happen.
+
+  format = dt_imageio_get_format_by_name(output_ext);
+  if(format == NULL)
+  {
+    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
+    fprintf(stderr, "\n");
+    storage->free_params(storage, sdata);
+    return -1;
+  }
+
+  fdata = format->get_params(format);
+  if(fdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    storage->free_params(storage, sdata);
+    return -1;
+  }
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = opts->width;
+  fdata->max_height = opts->height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+  fdata->style_append = 1; // make append the default and override with --style-overwrite
+
+  if(opts->style)
+  {
+    g_strlcpy((char *)fdata->style, opts->style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+    if(opts->style_overwrite)
+      fdata->style_append = 0;
+  }
+
+  if(storage->initialize_store)
+  {
+    storage->initialize_store(storage, sdata, &format, &fdata, id_list, opts->high_quality, opts->upscale);
+
+    format->set_params(format, fdata, format->params_size(format));
+    storage->set_params(storage, sdata, storage->params_size(storage));
+  }
+
+  // TODO: add a callback to set the bpp without going through the config
+
+  const int total = g_list_length(*id_list);
+  int num = 1, res = 0;
+  for(GList *iter = *id_list; iter; iter = g_list_next(iter), num++)
+  {
+    const int id = GPOINTER_TO_INT(iter->data);
+    // TODO: have a parameter in command line to get the export presets
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(storage->store(storage, sdata, id, format, fdata, num, total, opts->high_quality, opts->upscale,
+                      opts->export_masks, opts->icc_type, opts->icc_filename, opts->icc_intent, &metadata)
+       != 0)
+      res = 1;
+  }
+
+  // cleanup time
+  if(storage->finalize_store) storage->finalize_store(storage, sdata);
+  storage->free_params(storage, sdata);
+  format->free_params(format, fdata);
+
+  return res;
+}
+
+// apply one `<option>=<value>' field of a batch job. returns an error message or NULL.
+static const char *batch_option(char *field, dt_cli_export_t *opts)
+{
+  if(!strcmp(field, "style-overwrite"))
+  {
+    opts->style_overwrite = TRUE;
+    return NULL;
+  }
+
+  char *value = strchr(field, '=');
+  if(!value) return "expected <option>=<value>";
+  *value++ = '\0';
+
+  if(!strcmp(field, "width"))
+    opts->width = MAX(atoi(value), 0);
+  else if(!strcmp(field, "height"))
+    opts->height = MAX(atoi(value), 0);
+  else if(!strcmp(field, "hq"))
+    return parse_bool(value, &opts->high_quality) ? "unknown value for hq" : NULL;
+  else if(!strcmp(field, "upscale"))
+    return parse_bool(value, &opts->upscale) ? "unknown value for upscale" : NULL;
+  else if(!strcmp(field, "export_masks"))
+    return parse_bool(value, &opts->export_masks) ? "unknown value for export_masks" : NULL;
+  else if(!strcmp(field, "style"))
+    opts->style = *value ? value : NULL;
+  else if(!strcmp(field, "out-ext"))
+  {
+    if(*value == '.') value++;
+    if(strlen(value) > DT_MAX_OUTPUT_EXT_LENGTH) return "too long ext for out-ext";
+    opts->output_ext = *value ? value : NULL;
+  }
+  else if(!strcmp(field, "icc-type"))
+  {
+    gchar *str = g_ascii_strup(value, -1);
+    opts->icc_type = get_icc_type(str);
+    g_free(str);
+    if(opts->icc_type >= DT_COLORSPACE_LAST) return "incorrect ICC type";
+  }
+  else if(!strcmp(field, "icc-file"))
+  {
+    if(!g_file_test(value, G_FILE_TEST_IS_REGULAR)) return "ICC file doesn't exist";
+    opts->icc_filename = value;
+  }
+  else if(!strcmp(field, "icc-intent"))
+  {
+    gchar *str = g_ascii_strup(value, -1);
+    opts->icc_intent = get_icc_intent(str);
+    g_free(str);
+    if(opts->icc_intent >= DT_INTENT_LAST) return "incorrect ICC intent";
+  }
+  else
+    return "unknown option";
+  return NULL;
+}
+
+// run the job described by `fields'. returns an error message or NULL on success.
+static const char *batch_export(gchar **fields, dt_cli_batch_t *batch)
+{
+  if(g_strv_length(fields) < 3 || !*fields[0] || !*fields[2])
+    return "expected <input> TAB <xmp> TAB <output>";
+
+  dt_cli_export_t opts = batch->defaults;
+  for(int k = 3; fields[k]; k++)
+  {
+    const char *error = batch_option(fields[k], &opts);
+    if(error) return error;
+  }
+
+  const char *input = fields[0];
+  const char *xmp = fields[1];
+  if(!g_file_test(input, G_FILE_TEST_IS_REGULAR)) return "input file doesn't exist";
+
+  // the image stays in the library, so its decoded buffers and the pixelpipe disk
+  // cache entries of earlier exports can be reused by later jobs
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(input);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  const int32_t id = filmid ? dt_image_import(filmid, input, TRUE, TRUE) : 0;
+  if(!id) return "can't open input file";
+
+  // an earlier job may have left its history on the image. reset it to what a fresh
+  // import would give, unless the xmp of this job replaces it anyway.
+  gchar *sidecar = NULL;
+  if(!*xmp && g_hash_table_contains(batch->exported, GINT_TO_POINTER(id)))
+  {
+    sidecar = g_strconcat(input, ".xmp", NULL);
+    if(g_file_test(sidecar, G_FILE_TEST_IS_REGULAR))
+      xmp = sidecar;
+    else
+      dt_history_delete_on_image_ext(id, FALSE);
+  }
+  g_hash_table_add(batch->exported, GINT_TO_POINTER(id));
+
+  if(*xmp)
+  {
+    dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+    const int err = dt_exif_xmp_read(image, xmp, 1);
+    // don't write new xmp:
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    if(err)
+    {
+      g_free(sidecar);
+      // don't let the next job on this image start from a half read history
+      dt_history_delete_on_image_ext(id, FALSE);
+      return "can't open xmp file";
+    }
+  }
+  g_free(sidecar);
+
+  gchar *output_filename = NULL;
+  if(g_file_test(fields[2], G_FILE_TEST_IS_DIR))
+  {
+    output_filename = g_build_filename(fields[2], "$(FILE_NAME)", NULL);
+    if(!opts.output_ext) opts.output_ext = "jpg";
+  }
+  else
+    output_filename = g_strdup(fields[2]);
+
+  gchar *output_ext = split_output_ext(output_filename, opts.output_ext);
+  int res = -1;
+  if(output_ext)
+  {
+    GList *id_list = g_list_prepend(NULL, GINT_TO_POINTER(id));
+    res = export_images(&id_list, output_filename, output_ext, &opts);
+    g_list_free(id_list);
+  }
+  g_free(output_ext);
+  g_free(output_filename);
+
+  return !output_ext ? "no usable output file extension" : res ? "export failed" : NULL;
+}
+
+// run all jobs read from `in' and report one status line per job to `out':
+//   ok TAB <job number> TAB <input> TAB <seconds>
+//   error TAB <job number> TAB <input> TAB <reason>
+// returns TRUE if a `quit' line was read.
+static gboolean batch_process(FILE *in, FILE *out, dt_cli_batch_t *batch)
+{
+  char *line = NULL;
+  size_t len = 0;
+  gboolean quit = FALSE;
+  while(!quit && getline(&line, &len, in) != -1)
+  {
+    // strip the line end only, trailing tabs separate empty fields
+    line[strcspn(line, "\r\n")] = '\0';
+    if(!*line || *line == '#') continue;
+    if(!strcmp(line, "quit"))
+    {
+      quit = TRUE;
+      continue;
+    }
+
+    dt_times_t start, end;
+    dt_get_times(&start);
+    gchar **fields = g_strsplit(line, "\t", -1);
+    const int num = ++batch->num;
+    const char *error = batch_export(fields, batch);
+    dt_get_times(&end);
+
+    if(error)
+    {
+      batch->failed++;
+      fprintf(out, "error\t%d\t%s\t%s\n", num, fields[0] ? fields[0] : "", error);
+    }
+    else
+      fprintf(out, "ok\t%d\t%s\t%.3f\n", num, fields[0], end.clock - start.clock);
+    fflush(out);
+    g_strfreev(fields);
+  }
+  free(line);
+  return quit;
+}
+
+static int batch_file(const char *filename, dt_cli_batch_t *batch)
+{
+  FILE *in = strcmp(filename, "-") ? g_fopen(filename, "r") : stdin;
+  if(!in)
+  {
+    fprintf(stderr, _("error: can't open job list %s\n"), filename);
+    return 1;
+  }
+  batch_process(in, stdout, batch);
+  if(in != stdin) fclose(in);
+  return 0;
+}
+
+#ifndef _WIN32
+// serve job lists on a local socket, one client at a time, until a client sends `quit'
+static int batch_socket(const char *path, dt_cli_batch_t *batch)
+{
+  struct sockaddr_un addr = { 0 };
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, _("error: socket path %s is too long\n"), path);
+    return 1;
+  }
+  g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+  // a socket left behind by an earlier run would make bind() fail. don't remove anything else.
+  GStatBuf st;
+  if(!g_lstat(path, &st) && S_ISSOCK(st.st_mode)) g_unlink(path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 8))
+  {
+    fprintf(stderr, _("error: can't listen on %s: %s\n"), path, g_strerror(errno));
+    if(fd >= 0) close(fd);
+    return 1;
+  }
+
+  // a client going away must not take the server down with it
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, _("notice: waiting for jobs on %s\n"), path);
+
+  gboolean quit = FALSE;
+  while(!quit)
+  {
+    const int conn = accept(fd, NULL, NULL);
+    if(conn < 0)
+    {
+      if(errno == EINTR) continue;
+      fprintf(stderr, _("error: can't accept connection on %s: %s\n"), path, g_strerror(errno));
+      break;
+    }
+    const int conn_out = dup(conn);
+    FILE *in = fdopen(conn, "r");
+    FILE *out = conn_out < 0 ? NULL : fdopen(conn_out, "w");
+    if(in && out) quit = batch_process(in, out, batch);
+    if(in) fclose(in); else close(conn);
+    if(out) fclose(out); else if(conn_out >= 0) close(conn_out);
+  }
+
+  close(fd);
+  g_unlink(path);
+  return 0;
+}
+#endif
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -195,6 +648,7 @@ int main(int argc, char *arg[])
   gchar *output_filename = NULL;
   gchar *output_ext = NULL;
   char *style = NULL;
+  char *batch_jobs = NULL, *batch_path = NULL;
   int file_counter = 0;
   int width = 0, height = 0, bpp = 0;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
@@ -381,6 +835,18 @@ int main(int argc, char *arg[])
           exit(1);
         }
       }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch_jobs = arg[k];
+      }
+#ifndef _WIN32
+      else if(!strcmp(arg[k], "--batch-socket") && argc > k + 1)
+      {
+        k++;
+        batch_path = arg[k];
+      }
+#endif
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -420,6 +886,55 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
+  if(batch_jobs || batch_path)
+  {
+    if(file_counter || inputs || (batch_jobs && batch_path))
+    {
+      fprintf(stderr, _("error: batch mode takes its inputs from the job list only\n"));
+      usage(arg[0]);
+      free(m_arg);
+      g_free(output_filename);
+      g_free(output_ext);
+      g_list_free_full(inputs, g_free);
+      exit(1);
+    }
+
+    // init dt once, every job reuses the loaded modules, presets and caches
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      g_free(output_ext);
+      exit(1);
+    }
+
+    dt_cli_batch_t batch = { .defaults = { .width = width,
+                                           .height = height,
+                                           .high_quality = high_quality,
+                                           .upscale = upscale,
+                                           .export_masks = export_masks,
+                                           .style_overwrite = style_overwrite,
+                                           .style = style,
+                                           .output_ext = output_ext,
+                                           .icc_type = icc_type,
+                                           .icc_filename = icc_filename,
+                                           .icc_intent = icc_intent },
+                             .exported = g_hash_table_new(NULL, NULL) };
+#ifndef _WIN32
+    int res = batch_path ? batch_socket(batch_path, &batch) : batch_file(batch_jobs, &batch);
+#else
+    int res = batch_file(batch_jobs, &batch);
+#endif
+    if(batch.failed) res = 1;
+    g_hash_table_destroy(batch.exported);
+
+    dt_cleanup();
+
+    g_free(output_ext);
+    g_free(icc_filename);
+    free(m_arg);
+    exit(res);
+  }
+
   if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
@@ -605,162 +1120,36 @@ int main(int argc, char *arg[])
       printf("[%s]\n", _("empty history stack"));
   }
 
-  if(!output_ext)
-  {
-    // by this point we're sure output is not dir, there's no output ext specified
-    // so only place to look for it is in filename
-    // try to find out the export format from the output_filename
-    char *ext = strrchr(output_filename, '.');
-    if(ext && strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
-    {
-      // too long ext, no point in wasting time
-      fprintf(stderr, _("too long output file extension: %s\n"), ext);
-      usage(arg[0]);
-      g_free(output_filename);
-      exit(1);
-    }
-    else if(!ext || strlen(ext) <= 1)
-    {
-      // no ext or empty ext, no point in wasting time
-      fprintf(stderr, _("no output file extension given\n"));
-      usage(arg[0]);
-      g_free(output_filename);
-      exit(1);
-    }
-    *ext = '\0';
-    ext++;
-    output_ext = g_strdup(ext);
-  } else {
-    // check and remove redundant file ext
-    char *ext = strrchr(output_filename, '.');
-    if(ext && !strcmp(output_ext, ext+1))
-    {
-      *ext = '\0';
-    }
-  }
-
-  if(!strcmp(output_ext, "jpg"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("jpeg");
-  }
-
-  if(!strcmp(output_ext, "tif"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("tiff");
-  }
-
-  // init the export data structures
-  dt_imageio_module_format_t *format;
-  dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
-
-  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
-  if(storage == NULL)
-  {
-    fprintf(
-        stderr, "%s\n",
-        _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    free(m_arg);
-    g_free(output_filename);
-    g_free(output_ext);
-    exit(1);
-  }
-
-  sdata = storage->get_params(storage);
-  if(sdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
-    free(m_arg);
-    g_free(output_filename);
-    g_free(output_ext);
-    exit(1);
-  }
-
-  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
-  // any longer ...
-  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
-  // all is good now, the last line didn't happen.
-
-  format = dt_imageio_get_format_by_name(output_ext);
-  if(format == NULL)
+  gchar *format_name = split_output_ext(output_filename, output_ext);
+  g_free(output_ext);
+  if(!format_name)
   {
-    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
-    fprintf(stderr, "\n");
-    free(m_arg);
+    usage(arg[0]);
     g_free(output_filename);
-    g_free(output_ext);
     exit(1);
   }
+  output_ext = format_name;
 
-  fdata = format->get_params(format);
-  if(fdata == NULL)
+  const dt_cli_export_t opts = { .width = width,
+                                 .height = height,
+                                 .high_quality = high_quality,
+                                 .upscale = upscale,
+                                 .export_masks = export_masks,
+                                 .style_overwrite = style_overwrite,
+                                 .style = style,
+                                 .output_ext = output_ext,
+                                 .icc_type = icc_type,
+                                 .icc_filename = icc_filename,
+                                 .icc_intent = icc_intent };
+  const int res = export_images(&id_list, output_filename, output_ext, &opts);
+  if(res < 0)
   {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
     free(m_arg);
     g_free(output_filename);
     g_free(output_ext);
     exit(1);
   }
 
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-  fdata->style_append = 1; // make append the default and override with --style-overwrite
-
-  if(style)
-  {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
-    if(style_overwrite)
-      fdata->style_append = 0;
-  }
-
-  if(storage->initialize_store)
-  {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
-
-    format->set_params(format, fdata, format->params_size(format));
-    storage->set_params(storage, sdata, storage->params_size(storage));
-  }
-
-  // TODO: add a callback to set the bpp without going through the config
-
-  int num = 1, res = 0;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
-  {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                      icc_type, icc_filename, icc_intent, &metadata) != 0)
-      res = 1;
-  }
-
-  // cleanup time
-  if(storage->finalize_store) storage->finalize_store(storage, sdata);
-  storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
   g_list_free(id_list);
 
   if(icc_filename)
@@ -363,6 +363,7 @@ static void store_scaled_Nwide(const size_t N, float *const restrict out, const
 }
 
 
+__DT_CLONE_TARGETS__
 static void blur_horizontal_4ch(float *const restrict buf, const size_t height, const size_t width, const size_t radius,
                                 float *const restrict scanlines, const size_t padded_size)
 {
@@ -798,11 +799,12 @@ static void blur_vertical_1wide_Kahan(float *const restrict buf, const size_t he
 }
 
 // invoked inside an OpenMP parallel for, so no need to parallelize
+__DT_CLONE_TARGETS__
 static void blur_vertical_4wide(float *const restrict buf, const size_t height, const size_t width, const size_t radius,
                                 float *const restrict scratch)
 {
 #ifdef __SSE2__
-  if (darktable.codepath.SSE2)
+  if (darktable.codepath.SSE2 && !darktable.codepath.AVX2)
   {
     blur_vertical_1ch_sse(buf, height, width, radius, (__m128*)scratch);
     return;
@@ -925,11 +927,12 @@ static void blur_vertical_4wide_Kahan(float *const restrict buf, const size_t he
 }
 
 // invoked inside an OpenMP parallel for, so no need to parallelize
+__DT_CLONE_TARGETS__
 static void blur_vertical_16wide(float *const restrict buf, const size_t height, const size_t width,
                                  const size_t radius, float *const restrict scratch)
 {
 #ifdef __SSE2__
-  if (darktable.codepath.SSE2)
+  if (darktable.codepath.SSE2 && !darktable.codepath.AVX2)
   {
     blur_vertical_4ch_sse(buf, height, width, radius, (__m128*)scratch);
     return;
@@ -1,6 +1,6 @@
 /*
     This file is part of darktable,
-    Copyright (C) 2011-2020 darktable developers.
+    Copyright (C) 2011-2021 darktable developers.
 
     darktable is free software: you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -28,7 +28,8 @@ typedef struct dt_cache_entry_t
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  // intrusive lru list of the shard this entry lives in
+  struct dt_cache_entry_t *lru_prev, *lru_next;
   dt_pthread_rwlock_t lock;
   int _lock_demoting;
   uint32_t key;
@@ -38,16 +39,33 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+// one lock stripe of the cache. keys are distributed over the shards by hash,
+// so threads working on different images mostly don't meet on the same lock.
+typedef struct dt_cache_shard_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock;
+
+  size_t cost;           // cost of the entries in this shard
+
+  GHashTable *hashtable; // stores (key, entry) pairs
+  dt_cache_entry_t *lru_first; // about to be kicked from cache
+  dt_cache_entry_t *lru_last;  // most recently used
 
+  // contention stats for this run, only to be read for printing.
+  long int stats_locks;     // number of times the shard lock has been taken
+  long int stats_contended; // number of times we had to wait for it
+  long int stats_retries;   // number of times an entry was locked and we had to start over
+}
+dt_cache_shard_t;
+
+typedef struct dt_cache_t
+{
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
+  size_t cost;       // user supplied cost per cache line (bytes?), sum over all shards
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  int num_shards;            // power of two
+  dt_cache_shard_t *shards;
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -57,8 +75,20 @@ typedef struct dt_cache_t
 }
 dt_cache_t;
 
+// contention statistics summed over all shards
+typedef struct dt_cache_stats_t
+{
+  long int locks;
+  long int contended;
+  long int retries;
+}
+dt_cache_stats_t;
+
 // entry size is only used if alloc callback is 0
 void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// same, but spread the entries over num_shards (rounded up to a power of two) lock stripes.
+// use this for caches with many small entries which are hammered by many threads.
+void dt_cache_init_sharded(dt_cache_t *cache, size_t entry_size, size_t cost_quota, int num_shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
@@ -89,10 +119,13 @@ int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // removes from the tip of the lru list, until the fill ratio of the hashtable
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
-// is locked)
+// only takes one shard lock at a time and never waits for locked entries, never
+// fails, but sometimes does not free memory (in case all is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
+// sum up the contention counters of all shards
+void dt_cache_get_stats(dt_cache_t *cache, dt_cache_stats_t *stats);
+
 // iterate over all currently contained data blocks.
 // not thread safe! only use this for init/cleanup!
 // returns non zero the first time process() returns non zero.
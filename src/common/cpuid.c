@@ -35,15 +35,25 @@
 #endif
 
 #if defined(HAVE___GET_CPUID)
+// register state the os saves on context switches, as reported by xgetbv
+static guint64 _os_saved_state()
+{
+  guint32 ax, dx;
+  __asm__ __volatile__("xgetbv" : "=a"(ax), "=d"(dx) : "c"(0));
+  return ((guint64)dx << 32) | ax;
+}
+
 dt_cpu_flags_t dt_detect_cpu_features()
 {
   guint32 ax, bx, cx, dx;
+  guint32 max_level = 0;
   static dt_cpu_flags_t cpuflags = 0;
   static GMutex lock;
 
   g_mutex_lock(&lock);
   if(__get_cpuid(0x00000000,&ax,&bx,&cx,&dx))
   {
+    max_level = ax;
     /* Request for standard features */
     if(__get_cpuid(0x00000001,&ax,&bx,&cx,&dx))
     {
@@ -57,7 +67,22 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x00040000) cpuflags |= CPU_FLAG_SSE4_1;
       if(cx & 0x00080000) cpuflags |= CPU_FLAG_SSE4_2;
 
-      if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
+      // the wide registers are only usable if the os saves them (osxsave + xgetbv)
+      const guint64 state = (cx & 0x08000000) ? _os_saved_state() : 0;
+      const gboolean ymm = (state & 0x06) == 0x06;
+      const gboolean zmm = (state & 0xe6) == 0xe6;
+
+      if((cx & 0x10000000) && ymm) cpuflags |= CPU_FLAG_AVX;
+      if((cx & 0x00001000) && ymm) cpuflags |= CPU_FLAG_FMA;
+      if((cx & 0x20000000) && ymm) cpuflags |= CPU_FLAG_F16C;
+
+      /* structured extended features */
+      if(max_level >= 7)
+      {
+        __cpuid_count(0x00000007, 0, ax, bx, cx, dx);
+        if((bx & 0x00000020) && ymm) cpuflags |= CPU_FLAG_AVX2;
+        if((bx & 0x00010000) && zmm) cpuflags |= CPU_FLAG_AVX512F;
+      }
     }
 
     /* Are there extensions? */
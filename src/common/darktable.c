@@ -41,6 +41,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/cpuid.h"
 #include "common/file_location.h"
+#include "common/filemap.h"
 #include "common/film.h"
 #include "common/grealpath.h"
 #include "common/image.h"
@@ -53,6 +54,7 @@
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
+#include "common/trace.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -61,6 +63,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/masks.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
@@ -148,6 +151,7 @@ static int usage(const char *argv0)
   printf("  --noiseprofiles <noiseprofiles json file>\n");
   printf("  -t <num openmp threads>\n");
   printf("  --tmpdir <tmp directory>\n");
+  printf("  --trace <chrome trace json file>\n");
   printf("  --version\n");
 #ifdef _WIN32
   printf("\n");
@@ -358,15 +362,22 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+    darktable.codepath.AVX2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+    darktable.codepath.AVX2 = ((flags & (CPU_FLAG_AVX2)) && (flags & (CPU_FLAG_FMA)));
+#endif
+#if defined(HAVE___GET_CPUID)
+    // not every compiler knows f16c for __builtin_cpu_supports(), so always ask cpuid
+    darktable.codepath.F16C = (dt_detect_cpu_features() & CPU_FLAG_F16C) != 0;
 #endif
   }
 
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -391,6 +402,10 @@ static void dt_codepaths_init()
     fprintf(stderr,
             "[dt_codepaths_init] expect a LOT of functionality to be broken. you have been warned.\n");
   }
+
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] sse2 %d, avx2 %d, f16c %d, openmp simd %d\n",
+           darktable.codepath.SSE2, darktable.codepath.AVX2, darktable.codepath.F16C,
+           darktable.codepath.OPENMP_SIMD);
 }
 
 int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load_data, lua_State *L)
@@ -451,7 +466,6 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_pthread_mutex_init(&(darktable.dev_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.capabilities_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.exiv2_threadsafe), NULL);
-  dt_pthread_mutex_init(&(darktable.readFile_mutex), NULL);
   darktable.control = (dt_control_t *)calloc(1, sizeof(dt_control_t));
 
   // database
@@ -463,6 +477,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   char *tmpdir_from_command = NULL;
   char *configdir_from_command = NULL;
   char *cachedir_from_command = NULL;
+  char *trace_from_command = NULL;
 
 #ifdef HAVE_OPENCL
   gboolean exclude_opencl = FALSE;
@@ -599,6 +614,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
+      else if(!strcmp(argv[k], "--trace") && argc > k + 1)
+      {
+        trace_from_command = argv[++k];
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--configdir") && argc > k + 1)
       {
         configdir_from_command = argv[++k];
@@ -933,6 +954,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_conf_init(darktable.conf, darktablerc, config_override);
   g_slist_free_full(config_override, g_free);
 
+  // start recording pixelpipe timings, if requested
+  dt_trace_init(trace_from_command);
+
+  // bounded parallel reading of image files
+  dt_filemap_init();
+
   // set the interface language and prepare selection for prefs
   darktable.l10n = dt_l10n_init(init_gui);
 
@@ -1102,6 +1129,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
+  dt_masks_raster_cache_init();
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -1321,12 +1349,15 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_masks_raster_cache_cleanup();
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
     free(darktable.control);
     dt_undo_cleanup(darktable.undo);
   }
+  // all pipes have finished, dump the trace
+  dt_trace_cleanup();
   dt_colorspaces_cleanup(darktable.color_profiles);
   dt_conf_cleanup(darktable.conf);
   free(darktable.conf);
@@ -1403,7 +1434,7 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.dev_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
-  dt_pthread_mutex_destroy(&(darktable.readFile_mutex));
+  dt_filemap_cleanup();
 
   dt_exif_cleanup();
 }
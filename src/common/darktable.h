@@ -271,6 +271,10 @@ typedef enum dt_debug_thread_t
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  // AVX2 and FMA: plain code built with __DT_CLONE_TARGETS__ runs wider than the SSE2 intrinsics
+  unsigned int AVX2 : 1;
+  // hardware half float conversion, for fp16 pixelpipe cache lines
+  unsigned int F16C : 1;
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -281,6 +285,7 @@ typedef struct darktable_t
   int32_t num_openmp_threads;
 
   int32_t unmuted;
+  int32_t trace_enabled;
   GList *iop;
   GList *iop_order_list;
   GList *iop_order_rules;
@@ -313,7 +318,6 @@ typedef struct darktable_t
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
   dt_pthread_mutex_t exiv2_threadsafe;
-  dt_pthread_mutex_t readFile_mutex;
   char *progname;
   char *datadir;
   char *sharedir;
@@ -3430,6 +3430,72 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+// transactions of the helpers below. the lock is held from the outermost start to its release or
+// rollback, so the transactions of different threads don't mix on the shared connection.
+static GRecMutex _transaction_lock;
+static int _transaction_depth = 0; // only touched with the lock held
+
+static int _transaction_exec(const dt_database_t *db, const char *sql)
+{
+  dt_print(DT_DEBUG_SQL, "[sql] transaction: exec \"%s\"\n", sql);
+  const int rc = sqlite3_exec(db->handle, sql, NULL, NULL, NULL);
+  if(rc != SQLITE_OK)
+    fprintf(stderr, "[database] transaction: \"%s\" failed: %s\n", sql, sqlite3_errmsg(db->handle));
+  return rc;
+}
+
+gboolean dt_database_start_transaction(const struct dt_database_t *db)
+{
+  g_rec_mutex_lock(&_transaction_lock);
+  char sql[64];
+  if(_transaction_depth == 0)
+    g_strlcpy(sql, "BEGIN TRANSACTION", sizeof(sql));
+  else
+    snprintf(sql, sizeof(sql), "SAVEPOINT dt_transaction_%d", _transaction_depth);
+  if(_transaction_exec(db, sql) != SQLITE_OK)
+  {
+    g_rec_mutex_unlock(&_transaction_lock);
+    return FALSE;
+  }
+  _transaction_depth++;
+  return TRUE;
+}
+
+gboolean dt_database_release_transaction(const struct dt_database_t *db)
+{
+  _transaction_depth--;
+  char sql[64];
+  if(_transaction_depth == 0)
+    g_strlcpy(sql, "COMMIT", sizeof(sql));
+  else
+    snprintf(sql, sizeof(sql), "RELEASE SAVEPOINT dt_transaction_%d", _transaction_depth);
+  const int rc = _transaction_exec(db, sql);
+  // don't leave the connection inside a transaction nobody is going to end
+  if(rc != SQLITE_OK && _transaction_depth == 0 && !sqlite3_get_autocommit(db->handle))
+    _transaction_exec(db, "ROLLBACK TRANSACTION");
+  g_rec_mutex_unlock(&_transaction_lock);
+  return rc == SQLITE_OK;
+}
+
+gboolean dt_database_rollback_transaction(const struct dt_database_t *db)
+{
+  _transaction_depth--;
+  int rc;
+  if(_transaction_depth == 0)
+    rc = _transaction_exec(db, "ROLLBACK TRANSACTION");
+  else
+  {
+    // rolling back to a savepoint keeps it open, it has to be released still
+    char sql[64];
+    snprintf(sql, sizeof(sql), "ROLLBACK TO SAVEPOINT dt_transaction_%d", _transaction_depth);
+    rc = _transaction_exec(db, sql);
+    snprintf(sql, sizeof(sql), "RELEASE SAVEPOINT dt_transaction_%d", _transaction_depth);
+    if(rc == SQLITE_OK) rc = _transaction_exec(db, sql);
+  }
+  g_rec_mutex_unlock(&_transaction_lock);
+  return rc == SQLITE_OK;
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
@@ -47,6 +47,13 @@ gboolean dt_database_snapshot(const struct dt_database_t *db);
 gboolean dt_database_maybe_snapshot(const struct dt_database_t *db);
 /** get list of snapshot files to remove after successful snapshot */
 char **dt_database_snaps_to_remove(const struct dt_database_t *db);
+/** transactions on the shared connection, one thread at a time. they nest: inside a transaction, start opens
+    a savepoint, so an inner rollback only undoes the inner part. each successful start has to be ended by one
+    release (commit) or rollback on the same thread; nothing has to be ended if start returns FALSE. release and
+    rollback return FALSE on error. */
+gboolean dt_database_start_transaction(const struct dt_database_t *db);
+gboolean dt_database_release_transaction(const struct dt_database_t *db);
+gboolean dt_database_rollback_transaction(const struct dt_database_t *db);
 /** get possibly the freshest snapshot to restore */
 gchar *dt_database_get_most_recent_snap(const char* db_filename);
 
@@ -172,6 +172,7 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
   pcoarse += 4;
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                    const int scale, const float sharpen, const int32_t width, const int32_t height)
 {
@@ -417,6 +418,7 @@ void eaw_decompose_sse2(float *const restrict out, const float *const restrict i
 #undef SUM_PIXEL_EPILOGUE_SSE
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_synthesize(float *const out, const float *const in, const float *const restrict detail,
                     const float *const restrict threshold, const float *const restrict boost,
                     const int32_t width, const int32_t height)
@@ -573,6 +575,7 @@ static inline float dn_weight_sse(const __m128 *c1, const __m128 *c2, const floa
   pcoarse += 4;
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_dn_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                       float sum_squared[4], const int scale, const float inv_sigma2,
                       const int32_t width, const int32_t height)
@@ -39,6 +39,7 @@ extern "C" {
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -57,6 +58,7 @@ using namespace std;
 extern "C" {
 #include "common/colorlabels.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
@@ -273,9 +275,16 @@ static const char *_exif_get_exiv2_tag_type(const char *tagname)
   return NULL;
 }
 
+#if EXIV2_VERSION >= EXIV2_MAKE_VERSION(0,27,0)
+// since 0.27 readMetadata can run on different images at the same time, the only shared state is the xmp
+// toolkit which is guarded by _exif_xmp_lock() (see dt_exif_init()).
+#define read_metadata_threadsafe(image)                       \
+{                                                             \
+  image->readMetadata();                                      \
+}
+#else
 // exiv2's readMetadata is not thread safe in 0.26. so we lock it. since readMetadata might throw an exception we
 // wrap it into some c++ magic to make sure we unlock in all cases. well, actually not magic but basic raii.
-// FIXME: check again once we rely on 0.27
 class Lock
 {
 public:
@@ -288,6 +297,80 @@ public:
   Lock lock;                                                  \
   image->readMetadata();                                      \
 }
+#endif
+
+// the xmp toolkit calls this around changes of its global state. recursive as the toolkit may
+// be entered again from inside, and separate from exiv2_threadsafe which is held while it runs.
+static std::recursive_mutex _exif_xmp_mutex;
+
+static void _exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    _exif_xmp_mutex.lock();
+  else
+    _exif_xmp_mutex.unlock();
+}
+
+// metadata of a file read by dt_exif_parse(), waiting to be applied to its image
+struct dt_exif_parsed_t
+{
+  std::string path;
+  std::unique_ptr<Exiv2::Image> image;
+};
+
+// the image of `path' with its metadata read: taken from `parsed' if that has it, opened now otherwise.
+// throws like the exiv2 calls do.
+static std::unique_ptr<Exiv2::Image> _exif_open(const char *path, dt_exif_parsed_t *parsed)
+{
+  if(parsed && parsed->image && parsed->path == path) return std::move(parsed->image);
+
+  std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+  assert(image.get() != 0);
+  read_metadata_threadsafe(image);
+  return image;
+}
+
+dt_exif_parsed_t *dt_exif_parse(const char *path)
+{
+  try
+  {
+    std::unique_ptr<dt_exif_parsed_t> parsed(new dt_exif_parsed_t);
+    parsed->path = path;
+    parsed->image = _exif_open(path, NULL);
+    return parsed.release();
+  }
+  catch(std::exception &)
+  {
+    // dt_exif_read_parsed() tries again and reports the error where it can be dealt with
+    return NULL;
+  }
+}
+
+void dt_exif_parse_batch(const char *const *paths, const int count, dt_exif_parsed_t **parsed)
+{
+#if EXIV2_VERSION >= EXIV2_MAKE_VERSION(0,27,0)
+  // headers are small, this is mostly waiting for the disk. don't have more reads going on
+  // than the raw loaders would.
+  const int threads = CLAMP(dt_conf_get_int("io_parallel_reads"), 1, (int)dt_get_num_threads());
+#else
+  const int threads = 1;
+#endif
+  const double start = dt_get_wtime();
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(paths, count, parsed) \
+  schedule(dynamic) num_threads(threads)
+#endif
+  for(int k = 0; k < count; k++) parsed[k] = paths[k] ? dt_exif_parse(paths[k]) : NULL;
+
+  dt_print(DT_DEBUG_IMAGEIO, "[exif] parsed %d files with %d threads in %.3f s\n", count, threads,
+           dt_get_wtime() - start);
+}
+
+void dt_exif_parsed_free(dt_exif_parsed_t *parsed)
+{
+  delete parsed;
+}
 
 static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos);
 static void read_xmp_timestamps(Exiv2::XmpData &xmpData, dt_image_t *img);
@@ -1424,6 +1507,11 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
  * XMP data trumps IPTC data trumps EXIF data
  */
 int dt_exif_read(dt_image_t *img, const char *path)
+{
+  return dt_exif_read_parsed(img, path, NULL);
+}
+
+int dt_exif_read_parsed(dt_image_t *img, const char *path, dt_exif_parsed_t *parsed)
 {
   // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
   // ...)
@@ -1438,9 +1526,7 @@ int dt_exif_read(dt_image_t *img, const char *path)
 
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
-    assert(image.get() != 0);
-    read_metadata_threadsafe(image);
+    std::unique_ptr<Exiv2::Image> image(_exif_open(path, parsed));
     bool res = true;
 
     // EXIF metadata
@@ -2719,16 +2805,23 @@ static gboolean _image_altered_deprecated(const uint32_t imgid)
 
 // need a write lock on *img (non-const) to write stars (and soon color labels).
 int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only)
+{
+  return dt_exif_xmp_read_parsed(img, filename, history_only, NULL);
+}
+
+int dt_exif_xmp_read_parsed(dt_image_t *img, const char *filename, const int history_only,
+                            dt_exif_parsed_t *parsed)
 {
   // exclude pfm to avoid stupid errors on the console
   const char *c = filename + strlen(filename) - 4;
   if(c >= filename && !strcmp(c, ".pfm")) return 1;
+  // the history is replaced in a transaction of its own, a savepoint if the caller is inside one.
+  // a broken history only rolls back that part.
+  gboolean history_transaction = FALSE;
   try
   {
     // read xmp sidecar
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(filename)));
-    assert(image.get() != 0);
-    read_metadata_threadsafe(image);
+    std::unique_ptr<Exiv2::Image> image(_exif_open(filename, parsed));
     Exiv2::XmpData &xmpData = image->xmpData();
 
     sqlite3_stmt *stmt;
@@ -2841,7 +2934,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     // now add all masks that are not used for cloning. keeping them might be useful.
     // TODO: make this configurable? or remove it altogether?
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    const gboolean masks_transaction = dt_database_start_transaction(darktable.db);
     if(version < 3)
     {
       g_hash_table_foreach(mask_entries, add_non_clone_mask_entries_to_db, &img->id);
@@ -2855,7 +2948,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
         add_mask_entry_to_db(img->id, mask_entry);
       }
     }
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    if(masks_transaction) dt_database_release_transaction(darktable.db);
 
     // history
     int num = 0;
@@ -2878,7 +2971,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    history_transaction = dt_database_start_transaction(darktable.db);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                                 &stmt, NULL);
@@ -2989,6 +3082,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
             g_list_free_full(mask_entries_v3, free_mask_entry);
             if(mask_entries) g_hash_table_destroy(mask_entries);
             g_free(e);
+            if(history_transaction) dt_database_rollback_transaction(darktable.db);
             return 1;
           }
         }
@@ -3131,7 +3225,8 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      if(history_transaction) dt_database_release_transaction(darktable.db);
+      history_transaction = FALSE;
 
       // history_hash
       dt_history_hash_values_t hash = {NULL, 0, NULL, 0, NULL, 0};
@@ -3167,7 +3262,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      if(history_transaction) dt_database_rollback_transaction(darktable.db);
       return 1;
     }
 
@@ -3177,6 +3272,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
     // actually nobody's interested in that if the file doesn't exist:
     // std::string s(e.what());
     // std::cerr << "[exiv2] " << filename << ": " << s << std::endl;
+    if(history_transaction) dt_database_rollback_transaction(darktable.db);
     return 1;
   }
   return 0;
@@ -4226,7 +4322,8 @@ void dt_exif_init()
   Exiv2::enableBMFF();
   #endif
 
-  Exiv2::XmpParser::initialize();
+  // with a lock function the xmp toolkit may be used by several threads at the same time
+  Exiv2::XmpParser::initialize(&_exif_xmp_lock, NULL);
   // this has to stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   // check is Exiv2 version already knows these prefixes
@@ -37,6 +37,24 @@ const GList* dt_exif_get_exiv2_taglist();
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** metadata of a file read ahead, see dt_exif_parse(). */
+typedef struct dt_exif_parsed_t dt_exif_parsed_t;
+
+/** read the metadata of a file without applying it to anything. thread safe, so many files can be
+ * parsed at the same time. returns NULL if the file can't be read. */
+dt_exif_parsed_t *dt_exif_parse(const char *path);
+
+/** parse `count' files in parallel, parsed[k] is NULL where paths[k] is NULL or can't be read. */
+void dt_exif_parse_batch(const char *const *paths, const int count, dt_exif_parsed_t **parsed);
+
+/** free a parse result, NULL is fine. */
+void dt_exif_parsed_free(dt_exif_parsed_t *parsed);
+
+/** like dt_exif_read(), but with the metadata from `parsed' if it was read from `path'. this writes
+ * tags and metadata to the database, so it has to run where that is wanted, e.g. inside the caller's
+ * transaction. `parsed' is used up and still has to be freed. */
+int dt_exif_read_parsed(dt_image_t *img, const char *path, dt_exif_parsed_t *parsed);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -63,6 +81,10 @@ char *dt_exif_xmp_read_string(const int imgid);
 /** read xmp sidecar file. */
 int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only);
 
+/** read xmp sidecar file, parsed by dt_exif_parse() already. */
+int dt_exif_xmp_read_parsed(dt_image_t *img, const char *filename, const int history_only,
+                            dt_exif_parsed_t *parsed);
+
 /** apply default import metadata */
 void dt_exif_apply_default_metadata(dt_image_t *img);
 
@@ -0,0 +1,189 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/filemap.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "control/conf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// rawspeed keeps buffer sizes in 32 bits
+#define DT_FILEMAP_MAX_SIZE ((size_t)UINT32_MAX)
+
+typedef struct dt_filemap_slots_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int active;
+  int max;
+} dt_filemap_slots_t;
+
+static dt_filemap_slots_t _slots = { 0 };
+
+void dt_filemap_init()
+{
+  dt_pthread_mutex_init(&_slots.lock, NULL);
+  pthread_cond_init(&_slots.cond, NULL);
+  _slots.active = 0;
+  _slots.max = CLAMP(dt_conf_get_int("io_parallel_reads"), 1, 64);
+}
+
+void dt_filemap_cleanup()
+{
+  pthread_cond_destroy(&_slots.cond);
+  dt_pthread_mutex_destroy(&_slots.lock);
+}
+
+static void _slot_acquire()
+{
+  dt_pthread_mutex_lock(&_slots.lock);
+  while(_slots.active >= _slots.max) dt_pthread_cond_wait(&_slots.cond, &_slots.lock);
+  _slots.active++;
+  dt_pthread_mutex_unlock(&_slots.lock);
+}
+
+static void _slot_release()
+{
+  dt_pthread_mutex_lock(&_slots.lock);
+  _slots.active--;
+  pthread_cond_signal(&_slots.cond);
+  dt_pthread_mutex_unlock(&_slots.lock);
+}
+
+#if !defined(_WIN32)
+// map the file and make sure all of it is in memory. returns NULL if it can't be mapped.
+static const uint8_t *_filemap_mmap(const int fd, const size_t size)
+{
+#ifdef MAP_POPULATE
+  // reads the whole file right away
+  void *mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  if(mem == MAP_FAILED) return NULL;
+#else
+  void *mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(mem == MAP_FAILED) return NULL;
+  posix_madvise(mem, size, POSIX_MADV_WILLNEED);
+  // fault in every page now, while we hold the slot
+  const size_t page = sysconf(_SC_PAGESIZE);
+  volatile uint8_t sum = 0;
+  for(size_t k = 0; k < size; k += page) sum ^= ((const uint8_t *)mem)[k];
+  (void)sum;
+#endif
+  return (const uint8_t *)mem;
+}
+#endif
+
+static uint8_t *_filemap_read(const int fd, const size_t size)
+{
+#if defined(__linux__)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  uint8_t *buf = (uint8_t *)dt_alloc_align(64, size);
+  if(!buf) return NULL;
+  size_t done = 0;
+  while(done < size)
+  {
+    const ssize_t n = read(fd, buf + done, MIN(size - done, (size_t)1 << 30));
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0)
+    {
+      dt_free_align(buf);
+      return NULL;
+    }
+    done += n;
+  }
+  return buf;
+}
+
+int dt_filemap_open(const char *filename, dt_filemap_t *map)
+{
+  memset(map, 0, sizeof(dt_filemap_t));
+
+  const double start = dt_get_wtime();
+  _slot_acquire();
+  const double io_start = dt_get_wtime();
+
+  const int fd = g_open(filename, O_RDONLY | O_BINARY, 0);
+  if(fd < 0)
+  {
+    _slot_release();
+    return 1;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) || st.st_size <= 0 || (uint64_t)st.st_size > DT_FILEMAP_MAX_SIZE)
+  {
+    close(fd);
+    _slot_release();
+    return 1;
+  }
+  const size_t size = st.st_size;
+
+#if !defined(_WIN32)
+  map->data = _filemap_mmap(fd, size);
+  map->mapped = map->data != NULL;
+#endif
+  // network file systems may refuse to map
+  if(!map->data) map->data = _filemap_read(fd, size);
+  close(fd);
+  _slot_release();
+
+  if(!map->data) return 1;
+  map->size = size;
+
+  const double end = dt_get_wtime();
+  dt_print(DT_DEBUG_IMAGEIO, "[filemap] %s `%s' (%.1f MB) in %.3f s, waited %.3f s for a slot\n",
+           map->mapped ? "mapped" : "read", filename, size / (1024.0 * 1024.0), end - io_start,
+           io_start - start);
+  return 0;
+}
+
+void dt_filemap_close(dt_filemap_t *map)
+{
+  if(!map->data) return;
+#if !defined(_WIN32)
+  if(map->mapped)
+    munmap((void *)map->data, map->size);
+  else
+#endif
+    dt_free_align((void *)map->data);
+  map->data = NULL;
+  map->size = 0;
+  map->mapped = FALSE;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
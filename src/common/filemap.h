@@ -0,0 +1,58 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// whole image files in memory, for the loaders.
+//
+// files are memory mapped where possible, and read into an allocated buffer
+// otherwise. either way all of the file is read before dt_filemap_open()
+// returns, so the decoder never waits for the disk. up to `io_parallel_reads'
+// files are read at the same time, which keeps fast storage busy without making
+// a spinning disk seek back and forth between many files.
+
+typedef struct dt_filemap_t
+{
+  const uint8_t *data;
+  size_t size;
+  gboolean mapped; // data is a mapping of the file, not a copy
+} dt_filemap_t;
+
+void dt_filemap_init();
+void dt_filemap_cleanup();
+
+// returns 0 on success. `map' has to be released with dt_filemap_close() then.
+int dt_filemap_open(const char *filename, dt_filemap_t *map);
+// releases the file. safe to call twice.
+void dt_filemap_close(dt_filemap_t *map);
+
+#ifdef __cplusplus
+}
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
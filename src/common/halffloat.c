@@ -0,0 +1,105 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/halffloat.h"
+#include "common/darktable.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// values converted per thread at a time
+#define DT_HALF_BLOCK 65536
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx,f16c")))
+static void _float_to_half_f16c(uint16_t *const out, const float *const in, const size_t n)
+{
+  size_t k = 0;
+  for(; k + 8 <= n; k += 8)
+    _mm_storeu_si128((__m128i *)(out + k), _mm256_cvtps_ph(_mm256_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT));
+  for(; k < n; k++) out[k] = dt_float_to_half(in[k]);
+}
+
+__attribute__((target("avx,f16c")))
+static void _half_to_float_f16c(float *const out, const uint16_t *const in, const size_t n)
+{
+  size_t k = 0;
+  for(; k + 8 <= n; k += 8)
+    _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(in + k))));
+  for(; k < n; k++) out[k] = dt_half_to_float(in[k]);
+}
+#endif
+
+static void _float_to_half(uint16_t *const out, const float *const in, const size_t n)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(darktable.codepath.F16C)
+  {
+    _float_to_half_f16c(out, in, n);
+    return;
+  }
+#endif
+  for(size_t k = 0; k < n; k++) out[k] = dt_float_to_half(in[k]);
+}
+
+static void _half_to_float(float *const out, const uint16_t *const in, const size_t n)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(darktable.codepath.F16C)
+  {
+    _half_to_float_f16c(out, in, n);
+    return;
+  }
+#endif
+  for(size_t k = 0; k < n; k++) out[k] = dt_half_to_float(in[k]);
+}
+
+void dt_float_to_half_buf(uint16_t *const out, const float *const in, const size_t n)
+{
+  const size_t nblocks = (n + DT_HALF_BLOCK - 1) / DT_HALF_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, in, n, nblocks) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    const size_t k = b * DT_HALF_BLOCK;
+    _float_to_half(out + k, in + k, MIN(n - k, DT_HALF_BLOCK));
+  }
+}
+
+void dt_half_to_float_buf(float *const out, const uint16_t *const in, const size_t n)
+{
+  const size_t nblocks = (n + DT_HALF_BLOCK - 1) / DT_HALF_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, in, n, nblocks) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    const size_t k = b * DT_HALF_BLOCK;
+    _half_to_float(out + k, in + k, MIN(n - k, DT_HALF_BLOCK));
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
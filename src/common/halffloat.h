@@ -0,0 +1,98 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// conversion between 32 bit floats and IEEE 754 half floats (binary16).
+
+typedef union dt_fp32_t
+{
+  uint32_t u;
+  float f;
+} dt_fp32_t;
+
+static inline float dt_half_to_float(const uint16_t h)
+{
+  /* see https://en.wikipedia.org/wiki/Half-precision_floating-point_format#Exponent_encoding
+     and https://en.wikipedia.org/wiki/Single-precision_floating-point_format#Exponent_encoding */
+
+  /* from https://gist.github.com/rygorous/2156668 */
+  static const dt_fp32_t magic = { 113 << 23 };
+  static const uint32_t shifted_exp = 0x7c00 << 13; // exponent mask after shift
+  dt_fp32_t o;
+
+  o.u = (h & 0x7fff) << 13;     // exponent/mantissa bits
+  uint32_t exp = shifted_exp & o.u;   // just the exponent
+  o.u += (127 - 15) << 23;        // exponent adjust
+
+  // handle exponent special cases
+  if (exp == shifted_exp) // Inf/NaN?
+    o.u += (128 - 16) << 23;    // extra exp adjust
+  else if (exp == 0) // Zero/Denormal?
+  {
+    o.u += 1 << 23;             // extra exp adjust
+    o.f -= magic.f;             // renormalize
+  }
+
+  o.u |= (h & 0x8000) << 16;    // sign bit
+  return o.f;
+}
+
+// rounds to nearest even, like the F16C instructions
+static inline uint16_t dt_float_to_half(const float f)
+{
+  /* from https://gist.github.com/rygorous/2156668 as well */
+  static const dt_fp32_t f32infty = { 255 << 23 };
+  static const dt_fp32_t f16max = { (127 + 16) << 23 };
+  static const dt_fp32_t denorm_magic = { ((127 - 15) + (23 - 10) + 1) << 23 };
+  dt_fp32_t v = { .f = f };
+  uint16_t o;
+
+  const uint32_t sign = v.u & 0x80000000u;
+  v.u ^= sign;
+
+  if(v.u >= f16max.u) // result is Inf or NaN
+    o = (v.u > f32infty.u) ? 0x7e00 : 0x7c00; // NaN -> qNaN, Inf -> Inf
+  else if(v.u < (113 << 23)) // result is a denormal or zero
+  {
+    // align the 10 mantissa bits at the bottom of the float, the fp addition rounds for us
+    v.f += denorm_magic.f;
+    o = v.u - denorm_magic.u;
+  }
+  else
+  {
+    const uint32_t mant_odd = (v.u >> 13) & 1;
+    // rebias the exponent and round
+    v.u -= (uint32_t)(127 - 15) << 23;
+    v.u += 0xfff + mant_odd;
+    o = v.u >> 13;
+  }
+
+  return o | (sign >> 16);
+}
+
+// convert `n' values, in parallel and with the F16C instructions where available
+void dt_float_to_half_buf(uint16_t *const out, const float *const in, const size_t n);
+void dt_half_to_float_buf(float *const out, const uint16_t *const in, const size_t n);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -107,6 +107,7 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_mipmap_cache_history_changed(darktable.mipmap_cache, imgid);
 
   _remove_preset_flag(imgid);
 
@@ -722,6 +723,7 @@ static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, dest_imgid);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    dt_mipmap_cache_history_changed(darktable.mipmap_cache, dest_imgid);
   }
   else
   {
@@ -1235,53 +1237,105 @@ gboolean dt_history_check_module_exists(int32_t imgid, const char *operation)
   return result;
 }
 
-GList *dt_history_duplicate(GList *hist)
+dt_dev_history_item_t *dt_history_item_duplicate(const dt_dev_history_item_t *old)
 {
-  GList *result = NULL;
+  dt_dev_history_item_t *new = (dt_dev_history_item_t *)malloc(sizeof(dt_dev_history_item_t));
 
-  for(GList *h = hist; h; h = g_list_next(h))
-  {
-    const dt_dev_history_item_t *old = (dt_dev_history_item_t *)(h->data);
+  memcpy(new, old, sizeof(dt_dev_history_item_t));
 
-    dt_dev_history_item_t *new = (dt_dev_history_item_t *)malloc(sizeof(dt_dev_history_item_t));
-
-    memcpy(new, old, sizeof(dt_dev_history_item_t));
-
-    int32_t params_size = 0;
-    if(old->module)
+  int32_t params_size = 0;
+  if(old->module)
+  {
+    params_size = old->module->params_size;
+  }
+  else
+  {
+    dt_iop_module_t *base = dt_iop_get_module(old->op_name);
+    if(base)
     {
-      params_size = old->module->params_size;
+      params_size = base->params_size;
     }
     else
     {
-      dt_iop_module_t *base = dt_iop_get_module(old->op_name);
-      if(base)
-      {
-        params_size = base->params_size;
-      }
-      else
-      {
-        // nothing else to do
-        fprintf(stderr, "[_duplicate_history] can't find base module for %s\n", old->op_name);
-      }
+      // nothing else to do
+      fprintf(stderr, "[_duplicate_history] can't find base module for %s\n", old->op_name);
     }
+  }
 
-    if(params_size > 0)
-    {
-      new->params = malloc(params_size);
-      memcpy(new->params, old->params, params_size);
-    }
+  if(params_size > 0)
+  {
+    new->params = malloc(params_size);
+    memcpy(new->params, old->params, params_size);
+  }
 
-    new->blend_params = malloc(sizeof(dt_develop_blend_params_t));
-    memcpy(new->blend_params, old->blend_params, sizeof(dt_develop_blend_params_t));
+  new->blend_params = malloc(sizeof(dt_develop_blend_params_t));
+  memcpy(new->blend_params, old->blend_params, sizeof(dt_develop_blend_params_t));
 
-    if(old->forms) new->forms = dt_masks_dup_forms_deep(old->forms, NULL);
+  if(old->forms) new->forms = dt_masks_dup_forms_deep(old->forms, NULL);
+
+  return new;
+}
+
+GList *dt_history_duplicate(GList *hist)
+{
+  GList *result = NULL;
+
+  for(GList *h = hist; h; h = g_list_next(h))
+    result = g_list_prepend(result, dt_history_item_duplicate((dt_dev_history_item_t *)h->data));
 
-    result = g_list_prepend(result, new);
-  }
   return g_list_reverse(result);  // list was built in reverse order, so un-reverse it
 }
 
+// items with masks are never shared, their forms would have to be compared in depth
+static gboolean _history_item_unchanged(const dt_dev_history_item_t *a, const dt_dev_history_item_t *b)
+{
+  return a->module && a->module == b->module && !a->forms && !b->forms
+         && a->enabled == b->enabled
+         && a->iop_order == b->iop_order
+         && a->multi_priority == b->multi_priority
+         && a->num == b->num
+         && a->focus_hash == b->focus_hash
+         && !strcmp(a->op_name, b->op_name)
+         && !strcmp(a->multi_name, b->multi_name)
+         && !memcmp(a->params, b->params, a->module->params_size)
+         && !memcmp(a->blend_params, b->blend_params, sizeof(dt_develop_blend_params_t));
+}
+
+GList *dt_history_duplicate_shared(GList *base, GList *hist)
+{
+  GList *result = NULL;
+
+  for(GList *h = hist; h; h = g_list_next(h))
+  {
+    dt_dev_history_item_t *item = (dt_dev_history_item_t *)h->data;
+    dt_dev_history_item_t *old = base ? (dt_dev_history_item_t *)base->data : NULL;
+    if(old && _history_item_unchanged(old, item))
+      result = g_list_prepend(result, old);
+    else
+      result = g_list_prepend(result, dt_history_item_duplicate(item));
+    base = g_list_next(base);
+  }
+
+  return g_list_reverse(result);
+}
+
+void dt_history_free_shared(GList *base, GList *hist)
+{
+  GHashTable *shared = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(GList *b = base; b; b = g_list_next(b)) g_hash_table_add(shared, b->data);
+  for(GList *h = hist; h; h = g_list_next(h))
+    if(!g_hash_table_contains(shared, h->data)) dt_dev_free_history_item(h->data);
+  g_hash_table_destroy(shared);
+  g_list_free(hist);
+}
+
+dt_dev_history_item_t *dt_history_item_unshare(GList *base, GList *link)
+{
+  if(g_list_find(base, link->data))
+    link->data = dt_history_item_duplicate((dt_dev_history_item_t *)link->data);
+  return (dt_dev_history_item_t *)link->data;
+}
+
 #if 0
 // for debug
 static gchar *_hash_history_to_string(guint8 *hash, const gsize checksum_len)
@@ -1463,6 +1517,7 @@ void dt_history_hash_write_from_history(const int32_t imgid, const dt_history_ha
       g_free(fields);
       g_free(values);
       g_free(conflict);
+      dt_mipmap_cache_history_changed(darktable.mipmap_cache, imgid);
     }
     g_free(hash);
   }
@@ -1487,6 +1542,7 @@ void dt_history_hash_write(const int32_t imgid, dt_history_hash_values_t *hash)
     g_free(hash->basic);
     g_free(hash->auto_apply);
     g_free(hash->current);
+    dt_mipmap_cache_history_changed(darktable.mipmap_cache, imgid);
   }
 }
 
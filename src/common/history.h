@@ -24,6 +24,7 @@
 #include "develop/imageop.h"
 
 struct dt_develop_t;
+struct dt_dev_history_item_t;
 struct dt_iop_module_t;
 
 // history hash is designed to detect any change made on the image
@@ -104,6 +105,16 @@ void dt_history_truncate_on_image(const int32_t imgid, const int32_t history_end
 void dt_history_set_compress_problem(const int32_t imgid, const gboolean set);
 /* duplicate an history list */
 GList *dt_history_duplicate(GList *hist);
+/* duplicate a single history item */
+struct dt_dev_history_item_t *dt_history_item_duplicate(const struct dt_dev_history_item_t *old);
+/* duplicate an history list, sharing the items that are unchanged at the same position of base.
+   free the result with dt_history_free_shared() before freeing base */
+GList *dt_history_duplicate_shared(GList *base, GList *hist);
+/* free a list from dt_history_duplicate_shared(), except the items shared with base */
+void dt_history_free_shared(GList *base, GList *hist);
+/* give link of a list from dt_history_duplicate_shared() its own copy of the item if it is shared
+   with base. to be called before the item is changed in place, returns the item to change */
+struct dt_dev_history_item_t *dt_history_item_unshare(GList *base, GList *link);
 
 
 
@@ -488,6 +488,7 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
   {
     int i = 0;
 
+    dt_image_cache_write_batch_begin(darktable.image_cache);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_geotag_t *undogeotag = (dt_undo_geotag_t *)list->data;
@@ -498,6 +499,7 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undogeotag->imgid));
       i++;
     }
+    dt_image_cache_write_batch_end(darktable.image_cache);
     if(i > 1) dt_control_log((action == DT_ACTION_UNDO)
                               ? _("geo-location undone for %d images")
                               : _("geo-location re-applied to %d images"), i);
@@ -508,6 +510,7 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
   {
     int i = 0;
 
+    dt_image_cache_write_batch_begin(darktable.image_cache);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_datetime_t *undodatetime = (dt_undo_datetime_t *)list->data;
@@ -518,6 +521,7 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undodatetime->imgid));
       i++;
     }
+    dt_image_cache_write_batch_end(darktable.image_cache);
     if(i > 1) dt_control_log((action == DT_ACTION_UNDO)
                               ? _("date/time undone for %d images")
                               : _("date/time re-applied to %d images"), i);
@@ -560,6 +564,7 @@ static void _geotag_undo_data_free(gpointer data)
 
 static void _image_set_location(GList *imgs, const dt_image_geoloc_t *geoloc, GList **undo, const gboolean undo_on)
 {
+  dt_image_cache_write_batch_begin(darktable.image_cache);
   for(GList *images = imgs; images; images = g_list_next(images))
   {
     const int32_t imgid = GPOINTER_TO_INT(images->data);
@@ -577,6 +582,7 @@ static void _image_set_location(GList *imgs, const dt_image_geoloc_t *geoloc, GL
 
     _set_location(imgid, geoloc);
   }
+  dt_image_cache_write_batch_end(darktable.image_cache);
 }
 
 void dt_image_set_locations(const GList *imgs, const dt_image_geoloc_t *geoloc, const gboolean undo_on)
@@ -614,6 +620,7 @@ static void _image_set_images_locations(const GList *img, const GArray *gloc,
                                         GList **undo, const gboolean undo_on)
 {
   int i = 0;
+  dt_image_cache_write_batch_begin(darktable.image_cache);
   for(GList *imgs = (GList *)img; imgs; imgs = g_list_next(imgs))
   {
     const int32_t imgid = GPOINTER_TO_INT(imgs->data);
@@ -632,6 +639,7 @@ static void _image_set_images_locations(const GList *img, const GArray *gloc,
     _set_location(imgid, geoloc);
     i++;
   }
+  dt_image_cache_write_batch_end(darktable.image_cache);
 }
 
 void dt_image_set_images_locations(const GList *imgs, const GArray *gloc, const gboolean undo_on)
@@ -1375,8 +1383,10 @@ static int _image_read_duplicates(const uint32_t id, const char *filename, const
   return count_xmps_processed;
 }
 
+// `exif' and `xmp' are the metadata of the image and its sidecar if they were read ahead, NULL otherwise
 static uint32_t _image_import_internal(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
-                                       gboolean lua_locking, gboolean raise_signals)
+                                       gboolean lua_locking, gboolean raise_signals, dt_exif_parsed_t *exif,
+                                       dt_exif_parsed_t *xmp)
 {
   char *normalized_filename = dt_util_normalize_path(filename);
   if(!normalized_filename || !dt_util_test_image_file(normalized_filename))
@@ -1585,7 +1595,7 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void)dt_exif_read(img, normalized_filename);
+  (void)dt_exif_read_parsed(img, normalized_filename, exif);
   if(dt_conf_get_bool("ui_last/ignore_exif_rating"))
     img->flags = flags;
   char dtfilename[PATH_MAX] = { 0 };
@@ -1593,7 +1603,7 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
   // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
   g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
 
-  const int res = dt_exif_xmp_read(img, dtfilename, 0);
+  const int res = dt_exif_xmp_read_parsed(img, dtfilename, 0, xmp);
 
   // write through to db, but not to xmp.
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
@@ -1677,12 +1687,18 @@ gboolean dt_images_already_imported(const gchar *folder, const gchar *filename)
 uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
                          gboolean raise_signals)
 {
-  return _image_import_internal(film_id, filename, override_ignore_jpegs, TRUE, raise_signals);
+  return _image_import_internal(film_id, filename, override_ignore_jpegs, TRUE, raise_signals, NULL, NULL);
+}
+
+uint32_t dt_image_import_parsed(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                gboolean raise_signals, dt_exif_parsed_t *exif, dt_exif_parsed_t *xmp)
+{
+  return _image_import_internal(film_id, filename, override_ignore_jpegs, TRUE, raise_signals, exif, xmp);
 }
 
 uint32_t dt_image_import_lua(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
 {
-  return _image_import_internal(film_id, filename, override_ignore_jpegs, FALSE, TRUE);
+  return _image_import_internal(film_id, filename, override_ignore_jpegs, FALSE, TRUE, NULL, NULL);
 }
 
 void dt_image_init(dt_image_t *img)
@@ -1771,6 +1787,8 @@ int32_t dt_image_rename(const int32_t imgid, const int32_t filmid, const gchar *
   gchar oldimg[PATH_MAX] = { 0 };
   gchar newimg[PATH_MAX] = { 0 };
   gboolean from_cache = FALSE;
+  // the sidecar moves with the image, a late write must not recreate it at the old place
+  dt_image_cache_flush(darktable.image_cache);
   dt_image_full_path(imgid, oldimg, sizeof(oldimg), &from_cache);
   gchar *newdir = NULL;
 
@@ -2072,8 +2090,6 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
 
       if(newid != -1)
       {
-        // also copy over on-disk thumbnails, if any
-        dt_mipmap_cache_copy_thumbnails(darktable.mipmap_cache, newid, imgid);
         DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                     "INSERT INTO main.color_labels (imgid, color)"
                                     " SELECT ?1, color"
@@ -2198,6 +2214,10 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
 
         dt_history_copy_and_paste_on_image(imgid, newid, FALSE, NULL, TRUE, TRUE);
 
+        // also copy over on-disk thumbnails, if any. the packed store checks them against the
+        // history hash of the copy, which is only there now
+        dt_mipmap_cache_copy_thumbnails(darktable.mipmap_cache, newid, imgid);
+
         // write xmp file
         dt_image_write_sidecar_file(newid);
 
@@ -2422,14 +2442,8 @@ void dt_image_write_sidecar_file(const int32_t imgid)
 
 void dt_image_synch_xmps(const GList *img)
 {
-  if(!img) return;
-  if(dt_conf_get_bool("write_sidecar_files"))
-  {
-    for(const GList *imgs = img; imgs; imgs = g_list_next(imgs))
-    {
-      dt_image_write_sidecar_file(GPOINTER_TO_INT(imgs->data));
-    }
-  }
+  // written in the background, lots of small files would block the caller for long
+  dt_image_cache_write_sidecars(darktable.image_cache, img);
 }
 
 void dt_image_synch_xmp(const int selected)
@@ -2534,6 +2548,7 @@ static void _image_set_datetimes(const GList *img, const GArray *dtime,
                                  GList **undo, const gboolean undo_on)
 {
   int i = 0;
+  dt_image_cache_write_batch_begin(darktable.image_cache);
   for(GList *imgs = (GList *)img; imgs; imgs = g_list_next(imgs))
   {
     const int32_t imgid = GPOINTER_TO_INT(imgs->data);
@@ -2553,6 +2568,7 @@ static void _image_set_datetimes(const GList *img, const GArray *dtime,
     _set_datetime(imgid, datetime->dt);
     i++;
   }
+  dt_image_cache_write_batch_end(darktable.image_cache);
 }
 
 void dt_image_set_datetimes(const GList *imgs, const GArray *dtime, const gboolean undo_on)
@@ -2574,6 +2590,7 @@ void dt_image_set_datetimes(const GList *imgs, const GArray *dtime, const gboole
 static void _image_set_datetime(const GList *img, const char *datetime,
                                 GList **undo, const gboolean undo_on)
 {
+  dt_image_cache_write_batch_begin(darktable.image_cache);
   for(GList *imgs = (GList *)img; imgs;  imgs = g_list_next(imgs))
   {
     const int32_t imgid = GPOINTER_TO_INT(imgs->data);
@@ -2590,6 +2607,7 @@ static void _image_set_datetime(const GList *img, const char *datetime,
 
     _set_datetime(imgid, datetime);
   }
+  dt_image_cache_write_batch_end(darktable.image_cache);
 }
 
 void dt_image_set_datetime(const GList *imgs, const char *datetime, const gboolean undo_on)
@@ -177,6 +177,7 @@ typedef struct dt_image_geoloc_t
 } dt_image_geoloc_t;
 
 struct dt_cache_entry_t;
+struct dt_exif_parsed_t;
 
 #define DT_DATETIME_LENGTH 20
 
@@ -302,6 +303,11 @@ gboolean dt_images_already_imported(const gchar *folder, const gchar *filename);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. Use from threads other than lua.*/
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
                          gboolean raise_signals);
+/** like dt_image_import(), with the metadata of the file and of its .xmp sidecar already read by
+    dt_exif_parse(), see the import job. the parse results still have to be freed. */
+uint32_t dt_image_import_parsed(int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                gboolean raise_signals, struct dt_exif_parsed_t *exif,
+                                struct dt_exif_parsed_t *xmp);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. Use from lua thread.*/
 uint32_t dt_image_import_lua(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
 /** removes the given image from the database. */
@@ -18,17 +18,30 @@
 
 #include "common/image_cache.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/image.h"
 #include "control/conf.h"
 #include "develop/develop.h"
 
+#include <glib/gstdio.h>
 #include <sqlite3.h>
 #include <inttypes.h>
 
+// an image released for writing inside a write batch, waiting for the database
+typedef struct dt_image_cache_dirty_t
+{
+  dt_image_t img;   // copy, the cache entry may be gone by the time the batch ends
+  gboolean sidecar; // released in safe mode, the xmp has to be written, too
+} dt_image_cache_dirty_t;
+
+// nesting depth of the write batches of the calling thread
+static __thread int _write_batch = 0;
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
   entry->cost = sizeof(dt_image_t);
 
   dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
@@ -157,6 +170,14 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
             sqlite3_errmsg(dt_database_get(darktable.db)));
   }
   sqlite3_finalize(stmt);
+
+  // the entry was dropped from the cache while its row was still waiting in a write batch,
+  // the database doesn't know the latest state yet
+  dt_pthread_mutex_lock(&cache->write_lock);
+  const dt_image_cache_dirty_t *dirty = g_hash_table_lookup(cache->dirty, GINT_TO_POINTER(entry->key));
+  if(dirty) *img = dirty->img;
+  dt_pthread_mutex_unlock(&cache->write_lock);
+
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
@@ -169,6 +190,48 @@ void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
   g_free(img);
 }
 
+// write all queued sidecars. returns when the queue is empty or the writer has to quit.
+static void _image_cache_write_sidecars(dt_image_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->write_lock);
+  while(g_hash_table_size(cache->sidecars))
+  {
+    GList *imgs = g_hash_table_get_keys(cache->sidecars);
+    g_hash_table_remove_all(cache->sidecars);
+    cache->sidecar_busy = TRUE;
+    dt_pthread_mutex_unlock(&cache->write_lock);
+
+    for(GList *l = imgs; l; l = g_list_next(l)) dt_image_write_sidecar_file(GPOINTER_TO_INT(l->data));
+    g_list_free(imgs);
+
+    dt_pthread_mutex_lock(&cache->write_lock);
+    cache->sidecar_busy = FALSE;
+  }
+  // everything is on disk, the journal is not needed any more
+  if(cache->journal) g_unlink(cache->journal);
+  pthread_cond_broadcast(&cache->sidecar_cond);
+  dt_pthread_mutex_unlock(&cache->write_lock);
+}
+
+static void *_image_cache_sidecar_thread(void *data)
+{
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
+  dt_pthread_setname("sidecars");
+
+  dt_pthread_mutex_lock(&cache->write_lock);
+  while(TRUE)
+  {
+    while(!cache->sidecar_quit && g_hash_table_size(cache->sidecars) == 0)
+      dt_pthread_cond_wait(&cache->sidecar_cond, &cache->write_lock);
+    if(g_hash_table_size(cache->sidecars) == 0) break; // quit with nothing left to do
+    dt_pthread_mutex_unlock(&cache->write_lock);
+    _image_cache_write_sidecars(cache);
+    dt_pthread_mutex_lock(&cache->write_lock);
+  }
+  dt_pthread_mutex_unlock(&cache->write_lock);
+  return NULL;
+}
+
 void dt_image_cache_init(dt_image_cache_t *cache)
 {
   // the image cache does no serialization.
@@ -179,15 +242,63 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  // lots of small entries requested by all threads, spread them over several locks
+  dt_cache_init_sharded(&cache->cache, sizeof(dt_image_t), max_mem, 2 * dt_get_num_threads());
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
+  dt_pthread_mutex_init(&cache->write_lock, NULL);
+  pthread_cond_init(&cache->sidecar_cond, NULL);
+  cache->update_stmt = NULL;
+  cache->dirty = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  cache->sidecars = g_hash_table_new(NULL, NULL);
+  cache->sidecar_busy = cache->sidecar_quit = FALSE;
+
+  // sidecars that were still pending when darktable went down last time are written now
+  const gchar *library = dt_database_get_path(darktable.db);
+  cache->journal = (library && strcmp(library, ":memory:")) ? g_strconcat(library, ".sidecars", NULL) : NULL;
+  FILE *f = cache->journal ? g_fopen(cache->journal, "r") : NULL;
+  if(f)
+  {
+    int imgid;
+    while(fscanf(f, "%d", &imgid) == 1)
+      if(imgid > 0) g_hash_table_add(cache->sidecars, GINT_TO_POINTER(imgid));
+    fclose(f);
+    dt_print(DT_DEBUG_CACHE, "[image_cache] writing %u sidecars left over from last session\n",
+             g_hash_table_size(cache->sidecars));
+  }
+
+  if(dt_pthread_create(&cache->sidecar_thread, _image_cache_sidecar_thread, cache))
+  {
+    // write them on the calling thread then
+    fprintf(stderr, "[image_cache] can't start the sidecar writer\n");
+    cache->sidecar_quit = TRUE;
+    _image_cache_write_sidecars(cache);
+  }
+
   dt_print(DT_DEBUG_CACHE, "[image_cache] has %d entries\n", num);
 }
 
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
+  dt_image_cache_flush(cache);
+
+  dt_pthread_mutex_lock(&cache->write_lock);
+  const gboolean running = !cache->sidecar_quit;
+  cache->sidecar_quit = TRUE;
+  pthread_cond_broadcast(&cache->sidecar_cond);
+  dt_pthread_mutex_unlock(&cache->write_lock);
+  if(running) pthread_join(cache->sidecar_thread, NULL);
+
+  // a statement left open would keep the database from closing
+  if(cache->update_stmt) sqlite3_finalize(cache->update_stmt);
+  cache->update_stmt = NULL;
+  g_hash_table_destroy(cache->dirty);
+  g_hash_table_destroy(cache->sidecars);
+  g_free(cache->journal);
+  pthread_cond_destroy(&cache->sidecar_cond);
+  dt_pthread_mutex_destroy(&cache->write_lock);
+
   dt_cache_cleanup(&cache->cache);
 }
 
@@ -227,38 +338,30 @@ void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
   dt_cache_release(&cache->cache, img->cache_entry);
 }
 
-// drops the write privileges on an image struct.
-// this triggers a write-through to sql, and if the setting
-// is present, also to xmp sidecar files (safe setting).
-void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_image_cache_write_mode_t mode)
+// write the row of `img' to main.images. called with write_lock held.
+static void _image_cache_write_row(dt_image_cache_t *cache, const dt_image_t *img)
 {
   union {
       struct dt_image_raw_parameters_t s;
       uint32_t u;
   } flip;
-  if(img->aspect_ratio < .0001)
-  {
-    if(img->orientation < ORIENTATION_SWAP_XY)
-      img->aspect_ratio = (float )img->width / (float )img->height;
-    else
-      img->aspect_ratio = (float )img->height / (float )img->width;
-  }
-  if(img->id <= 0) return;
 
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.images"
-                              " SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5,"
-                              "     lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10,"
-                              "     focus_distance = ?11, film_id = ?12, datetime_taken = ?13, flags = ?14,"
-                              "     crop = ?15, orientation = ?16, raw_parameters = ?17, group_id = ?18,"
-                              "     longitude = ?19, latitude = ?20, altitude = ?21, color_matrix = ?22,"
-                              "     colorspace = ?23, raw_black = ?24, raw_maximum = ?25,"
-                              "     aspect_ratio = ROUND(?26,1), exposure_bias = ?27,"
-                              "     import_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30,"
-                              "     print_timestamp = ?31, output_width = ?32, output_height = ?33"
-                              " WHERE id = ?34",
-                              -1, &stmt, NULL);
+  // prepared once, this is run for every single change of every image
+  if(!cache->update_stmt)
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "UPDATE main.images"
+                                " SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5,"
+                                "     lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10,"
+                                "     focus_distance = ?11, film_id = ?12, datetime_taken = ?13, flags = ?14,"
+                                "     crop = ?15, orientation = ?16, raw_parameters = ?17, group_id = ?18,"
+                                "     longitude = ?19, latitude = ?20, altitude = ?21, color_matrix = ?22,"
+                                "     colorspace = ?23, raw_black = ?24, raw_maximum = ?25,"
+                                "     aspect_ratio = ROUND(?26,1), exposure_bias = ?27,"
+                                "     import_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30,"
+                                "     print_timestamp = ?31, output_width = ?32, output_height = ?33"
+                                " WHERE id = ?34",
+                                -1, &cache->update_stmt, NULL);
+  sqlite3_stmt *stmt = cache->update_stmt;
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->filename, -1, SQLITE_STATIC);
@@ -296,7 +399,139 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 34, img->id);
   const int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
+// append the images of `imgs' that aren't queued yet to the journal. called with write_lock held.
+static void _image_cache_journal_sidecars(dt_image_cache_t *cache, const GList *imgs)
+{
+  FILE *journal = (cache->journal && imgs) ? g_fopen(cache->journal, "a") : NULL;
+  if(!journal) return;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+    if(!g_hash_table_contains(cache->sidecars, l->data)) fprintf(journal, "%d\n", GPOINTER_TO_INT(l->data));
+  fclose(journal);
+}
+
+// write the rows of all images released inside write batches in one transaction
+// and hand their sidecars to the writer thread.
+static void _image_cache_write_dirty(dt_image_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->write_lock);
+  const gboolean empty = g_hash_table_size(cache->dirty) == 0;
+  dt_pthread_mutex_unlock(&cache->write_lock);
+  if(empty) return;
+
+  // the transaction goes first: a thread inside a transaction may be waiting for write_lock.
+  // if it can't be started, the rows are written one by one.
+  const gboolean transaction = dt_database_start_transaction(darktable.db);
+  dt_pthread_mutex_lock(&cache->write_lock);
+
+  // journal the sidecars before the rows go in. after a crash they are written on the
+  // next start from whatever made it into the database.
+  GList *sidecars = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cache->dirty);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    if(((dt_image_cache_dirty_t *)value)->sidecar) sidecars = g_list_prepend(sidecars, key);
+  _image_cache_journal_sidecars(cache, sidecars);
+
+  g_hash_table_iter_init(&iter, cache->dirty);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    _image_cache_write_row(cache, &((dt_image_cache_dirty_t *)value)->img);
+  if(transaction && !dt_database_release_transaction(darktable.db))
+  {
+    // the commit failed and was rolled back, write the rows one by one instead
+    g_hash_table_iter_init(&iter, cache->dirty);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+      _image_cache_write_row(cache, &((dt_image_cache_dirty_t *)value)->img);
+  }
+
+  const guint rows = g_hash_table_size(cache->dirty);
+  g_hash_table_remove_all(cache->dirty);
+  for(GList *l = sidecars; l; l = g_list_next(l)) g_hash_table_add(cache->sidecars, l->data);
+  g_list_free(sidecars);
+  pthread_cond_broadcast(&cache->sidecar_cond);
+  const gboolean sync = cache->sidecar_quit;
+  dt_pthread_mutex_unlock(&cache->write_lock);
+
+  dt_print(DT_DEBUG_CACHE, "[image_cache] wrote %u rows%s\n", rows, transaction ? " in one transaction" : "");
+  if(sync) _image_cache_write_sidecars(cache);
+}
+
+void dt_image_cache_write_sidecars(dt_image_cache_t *cache, const GList *imgs)
+{
+  if(!imgs || !dt_conf_get_bool("write_sidecar_files")) return;
+
+  dt_pthread_mutex_lock(&cache->write_lock);
+  // images with rows waiting in a batch get their sidecar once the rows are in the database
+  GList *queue = NULL;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    dt_image_cache_dirty_t *dirty = g_hash_table_lookup(cache->dirty, l->data);
+    if(dirty)
+      dirty->sidecar = TRUE;
+    else
+      queue = g_list_prepend(queue, l->data);
+  }
+  _image_cache_journal_sidecars(cache, queue);
+  for(const GList *l = queue; l; l = g_list_next(l)) g_hash_table_add(cache->sidecars, l->data);
+  g_list_free(queue);
+  pthread_cond_broadcast(&cache->sidecar_cond);
+  const gboolean sync = cache->sidecar_quit;
+  dt_pthread_mutex_unlock(&cache->write_lock);
+
+  if(sync) _image_cache_write_sidecars(cache);
+}
+
+// copy the state of `img' into its dirty row. called with write_lock held.
+static void _image_cache_dirty_set(dt_image_cache_dirty_t *dirty, const dt_image_t *img)
+{
+  dirty->img = *img;
+  // the profile belongs to the cache entry, the copy must not point to it
+  dirty->img.profile = NULL;
+  dirty->img.profile_size = 0;
+  dirty->img.cache_entry = NULL;
+}
+
+// drops the write privileges on an image struct.
+// this triggers a write-through to sql, and if the setting
+// is present, also to xmp sidecar files (safe setting).
+void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_image_cache_write_mode_t mode)
+{
+  if(img->aspect_ratio < .0001)
+  {
+    if(img->orientation < ORIENTATION_SWAP_XY)
+      img->aspect_ratio = (float )img->width / (float )img->height;
+    else
+      img->aspect_ratio = (float )img->height / (float )img->width;
+  }
+  if(img->id <= 0) return;
+
+  const gboolean sidecar = mode == DT_IMAGE_CACHE_SAFE && _write_batch > 0 && dt_conf_get_bool("write_sidecar_files");
+  dt_pthread_mutex_lock(&cache->write_lock);
+  if(_write_batch > 0)
+  {
+    // coalesce with earlier changes of this batch, the last state is what gets written
+    dt_image_cache_dirty_t *dirty = g_hash_table_lookup(cache->dirty, GINT_TO_POINTER(img->id));
+    if(!dirty)
+    {
+      dirty = g_malloc0(sizeof(dt_image_cache_dirty_t));
+      g_hash_table_insert(cache->dirty, GINT_TO_POINTER(img->id), dirty);
+    }
+    _image_cache_dirty_set(dirty, img);
+    dirty->sidecar |= sidecar;
+    dt_pthread_mutex_unlock(&cache->write_lock);
+    dt_cache_release(&cache->cache, img->cache_entry);
+    return;
+  }
+  // the dirty rows are shared by all threads. a batch of another thread still holding an older copy
+  // would write it over this row once it ends, and the cache could reload it, so bring it up to date.
+  dt_image_cache_dirty_t *dirty = g_hash_table_lookup(cache->dirty, GINT_TO_POINTER(img->id));
+  if(dirty) _image_cache_dirty_set(dirty, img);
+  _image_cache_write_row(cache, img);
+  dt_pthread_mutex_unlock(&cache->write_lock);
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
@@ -308,11 +543,37 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   dt_cache_release(&cache->cache, img->cache_entry);
 }
 
+void dt_image_cache_write_batch_begin(dt_image_cache_t *cache)
+{
+  _write_batch++;
+}
+
+void dt_image_cache_write_batch_end(dt_image_cache_t *cache)
+{
+  if(_write_batch <= 0 || --_write_batch > 0) return;
+  _image_cache_write_dirty(cache);
+}
+
+void dt_image_cache_flush(dt_image_cache_t *cache)
+{
+  _image_cache_write_dirty(cache);
+
+  dt_pthread_mutex_lock(&cache->write_lock);
+  while(!cache->sidecar_quit && (g_hash_table_size(cache->sidecars) || cache->sidecar_busy))
+    dt_pthread_cond_wait(&cache->sidecar_cond, &cache->write_lock);
+  dt_pthread_mutex_unlock(&cache->write_lock);
+}
 
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const int32_t imgid)
 {
   dt_cache_remove(&cache->cache, imgid);
+
+  // the image is going away, nothing of it has to be written any more
+  dt_pthread_mutex_lock(&cache->write_lock);
+  g_hash_table_remove(cache->dirty, GINT_TO_POINTER(imgid));
+  g_hash_table_remove(cache->sidecars, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->write_lock);
 }
 
 /* set timestamps */
@@ -19,11 +19,25 @@
 #pragma once
 
 #include "common/cache.h"
+#include "common/dtpthread.h"
 #include "common/image.h"
 
+#include <sqlite3.h>
+
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+
+  // write-behind state, see dt_image_cache_write_batch_begin().
+  dt_pthread_mutex_t write_lock;
+  sqlite3_stmt *update_stmt; // cached UPDATE main.images, only used with write_lock held
+  GHashTable *dirty;         // imgid -> copy of the dt_image_t still to be written to the database
+  GHashTable *sidecars;      // imgids whose xmp sidecar still has to be written
+  gchar *journal;            // lists the pending sidecars in case we crash, NULL for in-memory libraries
+  pthread_t sidecar_thread;
+  pthread_cond_t sidecar_cond; // signals new sidecars to the writer and an empty queue to flushers
+  gboolean sidecar_busy;       // the writer is working on sidecars taken out of the queue
+  gboolean sidecar_quit;
 }
 dt_image_cache_t;
 
@@ -61,8 +75,25 @@ void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
 // drops the write privileges on an image struct.
 // this triggers a write-through to sql, and if the setting
 // is present, also to xmp sidecar files (safe setting).
+// inside a write batch both are deferred, see below.
 void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_image_cache_write_mode_t mode);
 
+// bulk operations on many images (rating, geotagging, pasting history, ...) should be
+// wrapped in a write batch. while the calling thread is inside a batch, write releases
+// only remember the image: the rows of all images are written in one transaction when
+// the outermost batch ends, and their sidecars are written by a background thread
+// afterwards. images written several times are stored once. batches may be nested.
+// until the batch ends, main.images might not show the changes, the image cache does.
+void dt_image_cache_write_batch_begin(dt_image_cache_t *cache);
+void dt_image_cache_write_batch_end(dt_image_cache_t *cache);
+
+// have the sidecars of `imgs' written by the background thread.
+void dt_image_cache_write_sidecars(dt_image_cache_t *cache, const GList *imgs);
+
+// write all pending rows and wait until the pending sidecars are on disk. needed before
+// anything touches sidecar files directly, like moving or copying images.
+void dt_image_cache_flush(dt_image_cache_t *cache);
+
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const int32_t imgid);
 
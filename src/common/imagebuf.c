@@ -18,20 +18,21 @@
 
 #include <stdarg.h>
 #include "common/imagebuf.h"
+#include "develop/pixelpipe_hb.h"
 
 static size_t parallel_imgop_minimum = 500000;
 static size_t parallel_imgop_maxthreads = 4;
 
 // Allocate one or more buffers as detailed in the given parameters.  If any allocation fails, free all of them,
-// set the module's trouble flag, and return FALSE.
-gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
-                                    const struct dt_iop_roi_t *const roi_in,
-                                    const struct dt_iop_roi_t *const roi_out, ...)
+// set the module's trouble flag, and return FALSE.  If `piece' is given, the buffers are scratch of its pipe.
+static gboolean _alloc_image_buffers(struct dt_iop_module_t *const module, struct dt_dev_pixelpipe_iop_t *const piece,
+                                     const struct dt_iop_roi_t *const roi_in,
+                                     const struct dt_iop_roi_t *const roi_out, va_list ap)
 {
   gboolean success = TRUE;
   va_list args;
   // first pass: zero out all of the given buffer pointers
-  va_start(args,roi_out);
+  va_copy(args,ap);
   while (TRUE)
   {
     const int size = va_arg(args,int);
@@ -45,7 +46,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
   va_end(args);
 
   // second pass: attempt to allocate the requested buffers
-  va_start(args,roi_out);
+  va_copy(args,ap);
   while (success)
   {
     const int size = va_arg(args,int);
@@ -87,13 +88,14 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
     }
     if (size & DT_IMGSZ_PERTHREAD)
     {
-      *bufptr = dt_alloc_perthread_float(nfloats,paddedsize);
+      *bufptr = piece ? dt_dev_pixelpipe_scratch_alloc_perthread(piece,nfloats,paddedsize)
+                      : dt_alloc_perthread_float(nfloats,paddedsize);
       if (size & DT_IMGSZ_CLEARBUF)
         memset(*bufptr, 0, *paddedsize * dt_get_num_threads() * sizeof(float));
     }
     else
     {
-      *bufptr = dt_alloc_align_float(nfloats);
+      *bufptr = piece ? dt_dev_pixelpipe_scratch_alloc(piece,nfloats) : dt_alloc_align_float(nfloats);
       if (size & DT_IMGSZ_CLEARBUF)
         memset(*bufptr, 0, nfloats * sizeof(float));
     }
@@ -113,7 +115,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
   }
   else
   {
-    va_start(args,roi_out);
+    va_copy(args,ap);
     while (TRUE)
     {
       const int size = va_arg(args,int);
@@ -122,7 +124,10 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
         (void)va_arg(args,size_t*);  // skip the extra pointer for per-thread allocations
       if (size == 0 || !bufptr || !*bufptr)
         break;  // end of arg list or this attempted allocation failed
-      dt_free_align(*bufptr);
+      if (piece)
+        dt_dev_pixelpipe_scratch_free(piece,*bufptr);
+      else
+        dt_free_align(*bufptr);
       *bufptr = NULL;
     }
     va_end(args);
@@ -138,6 +143,28 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
   return success;
 }
 
+gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
+                                    const struct dt_iop_roi_t *const roi_in,
+                                    const struct dt_iop_roi_t *const roi_out, ...)
+{
+  va_list args;
+  va_start(args,roi_out);
+  const gboolean success = _alloc_image_buffers(module, NULL, roi_in, roi_out, args);
+  va_end(args);
+  return success;
+}
+
+gboolean dt_iop_alloc_scratch_buffers(struct dt_dev_pixelpipe_iop_t *const piece,
+                                      const struct dt_iop_roi_t *const roi_in,
+                                      const struct dt_iop_roi_t *const roi_out, ...)
+{
+  va_list args;
+  va_start(args,roi_out);
+  const gboolean success = _alloc_image_buffers(piece->module, piece, roi_in, roi_out, args);
+  va_end(args);
+  return success;
+}
+
 
 // Copy an image buffer, specifying the number of floats it contains.  Use of this function is to be preferred
 // over a bare memcpy both because it helps document the purpose of the code and because it gives us a single
@@ -38,6 +38,11 @@ static inline float *__restrict__ dt_iop_image_alloc(const size_t width, const s
 gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
                                     const struct dt_iop_roi_t *const roi_in,
                                     const struct dt_iop_roi_t *const roi_out, ...);
+// The same, but the buffers are scratch memory of the pipe `piece' belongs to, recycled across modules and runs.
+// They have to be freed with dt_dev_pixelpipe_scratch_free() before process() returns.
+gboolean dt_iop_alloc_scratch_buffers(struct dt_dev_pixelpipe_iop_t *const piece,
+                                      const struct dt_iop_roi_t *const roi_in,
+                                      const struct dt_iop_roi_t *const roi_out, ...);
 // Optional flags to add to size request.  Default is to allocate N channels per pixel according to
 // the dimensions of roi_out
 #define DT_IMGSZ_CH_MASK    0x000FFFF  // isolate just the number of floats per pixel
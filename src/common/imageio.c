@@ -47,6 +47,7 @@
 #endif
 #include "common/mipmap_cache.h"
 #include "common/styles.h"
+#include "common/trace.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -629,6 +630,243 @@ void dt_imageio_to_fractional(float in, uint32_t *num, uint32_t *den)
   }
 }
 
+// steps done once the exported file has been written
+static void _export_written(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                            dt_imageio_module_data_t *format_params, dt_imageio_module_storage_t *storage,
+                            dt_imageio_module_data_t *storage_params, const gboolean copy_metadata,
+                            const gboolean thumbnail_export, dt_export_metadata_t *metadata)
+{
+  /* now write xmp into that container, if possible */
+  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach_export(imgid, filename, metadata);
+    // no need to cancel the export if this fail
+  }
+
+  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
+    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+#ifdef USE_LUA
+    //Synchronous calling of lua intermediate-export-image events
+    dt_lua_lock();
+
+    lua_State *L = darktable.lua_state.state;
+
+    luaA_push(L, dt_lua_image_t, &imgid);
+
+    lua_pushstring(L, filename);
+
+    luaA_push_type(L, format->parameter_lua_type, format_params);
+
+    if (storage)
+      luaA_push_type(L, storage->parameter_lua_type, storage_params);
+    else
+      lua_pushnil(L);
+
+    dt_lua_event_trigger(L, "intermediate-export-image", 4);
+
+    dt_lua_unlock();
+#endif
+
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                            format_params, storage, storage_params);
+  }
+}
+
+typedef struct dt_imageio_export_task_t
+{
+  int32_t imgid;
+  char *filename;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *storage_params;
+  uint8_t *buf;
+  gboolean ignore_exif;
+  gboolean copy_metadata;
+  int sRGB;
+  dt_colorspaces_color_profile_type_t icc_type;
+  gchar *icc_filename;
+  int num, total;
+  dt_export_metadata_t *metadata;
+  gboolean created; // the file didn't exist or was reserved empty, remove it if writing fails
+} dt_imageio_export_task_t;
+
+struct dt_imageio_export_writer_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GQueue *queue;
+  int depth;
+  int pending; // images copied for the writer, queued or being written. at most depth.
+  int failed;
+  gboolean quit;
+  int num_threads;
+  pthread_t *threads;
+};
+
+static __thread dt_imageio_export_writer_t *_bound_writer = NULL;
+// the last export of this thread was handed to the writer
+static __thread gboolean _deferred = FALSE;
+
+static void _export_task_free(dt_imageio_export_task_t *task)
+{
+  task->format->free_params(task->format, task->format_params);
+  dt_free_align(task->buf);
+  g_free(task->filename);
+  g_free(task->icc_filename);
+  free(task);
+}
+
+static int _export_task_write(dt_imageio_export_task_t *task)
+{
+  dt_imageio_module_data_t *fdata = task->format_params;
+  dt_times_t start;
+  dt_get_times(&start);
+
+  int length = 0;
+  uint8_t *exif_profile = NULL;
+  if(!task->ignore_exif)
+  {
+    char pathname[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(task->imgid, pathname, sizeof(pathname), &from_cache);
+    length = dt_exif_read_blob(&exif_profile, pathname, task->imgid, task->sRGB, fdata->width, fdata->height, 0);
+  }
+
+  const int res = task->format->write_image(fdata, task->filename, task->buf, task->icc_type, task->icc_filename,
+                                            exif_profile, length, task->imgid, task->num, task->total, NULL, FALSE);
+  free(exif_profile);
+  dt_trace_event("export", "write", task->imgid, &start, 0, DT_TRACE_NONE);
+  if(res)
+  {
+    fprintf(stderr, "[dt_imageio_export_writer] could not export to file: `%s'!\n", task->filename);
+    dt_control_log(_("could not export to file `%s'!"), task->filename);
+    if(task->created) g_unlink(task->filename);
+    return 1;
+  }
+
+  _export_written(task->imgid, task->filename, task->format, fdata, task->storage, task->storage_params,
+                  task->copy_metadata, FALSE, task->metadata);
+
+  // the storage returned long ago, tell the user now that the file is there
+  fprintf(stderr, "[export_job] exported to `%s'\n", task->filename);
+  dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", task->num), task->num, task->total,
+                 task->filename);
+  return 0;
+}
+
+static void *_export_writer_thread(void *arg)
+{
+  dt_imageio_export_writer_t *writer = (dt_imageio_export_writer_t *)arg;
+  dt_pthread_mutex_lock(&writer->lock);
+  while(TRUE)
+  {
+    dt_imageio_export_task_t *task = g_queue_pop_head(writer->queue);
+    if(!task)
+    {
+      if(writer->quit) break;
+      dt_pthread_cond_wait(&writer->cond, &writer->lock);
+      continue;
+    }
+    dt_pthread_mutex_unlock(&writer->lock);
+
+    const int res = _export_task_write(task);
+    _export_task_free(task);
+
+    dt_pthread_mutex_lock(&writer->lock);
+    if(res) writer->failed++;
+    // its copy is gone, a pipe waiting in _export_writer_reserve() may make the next one
+    writer->pending--;
+    pthread_cond_broadcast(&writer->cond);
+  }
+  dt_pthread_mutex_unlock(&writer->lock);
+  return NULL;
+}
+
+// wait for a free slot before the output gets copied, so that no more than depth copies exist
+// at any time. the export job counts them in its memory budget.
+static void _export_writer_reserve(dt_imageio_export_writer_t *writer)
+{
+  dt_pthread_mutex_lock(&writer->lock);
+  while(writer->pending >= writer->depth) dt_pthread_cond_wait(&writer->cond, &writer->lock);
+  writer->pending++;
+  dt_pthread_mutex_unlock(&writer->lock);
+}
+
+static void _export_writer_unreserve(dt_imageio_export_writer_t *writer)
+{
+  dt_pthread_mutex_lock(&writer->lock);
+  writer->pending--;
+  pthread_cond_broadcast(&writer->cond);
+  dt_pthread_mutex_unlock(&writer->lock);
+}
+
+static void _export_writer_push(dt_imageio_export_writer_t *writer, dt_imageio_export_task_t *task)
+{
+  dt_pthread_mutex_lock(&writer->lock);
+  g_queue_push_tail(writer->queue, task);
+  pthread_cond_broadcast(&writer->cond);
+  dt_pthread_mutex_unlock(&writer->lock);
+}
+
+dt_imageio_export_writer_t *dt_imageio_export_writer_new(const int threads, const int depth)
+{
+  dt_imageio_export_writer_t *writer = calloc(1, sizeof(dt_imageio_export_writer_t));
+  dt_pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+  writer->queue = g_queue_new();
+  writer->depth = MAX(depth, 1);
+  writer->threads = calloc(MAX(threads, 1), sizeof(pthread_t));
+  for(int k = 0; k < MAX(threads, 1); k++)
+  {
+    if(dt_pthread_create(&writer->threads[writer->num_threads], _export_writer_thread, writer)) break;
+    writer->num_threads++;
+  }
+  if(!writer->num_threads)
+  {
+    // no thread to drain the queue, export synchronously
+    dt_imageio_export_writer_destroy(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+void dt_imageio_export_writer_destroy(dt_imageio_export_writer_t *writer)
+{
+  if(!writer) return;
+  dt_pthread_mutex_lock(&writer->lock);
+  writer->quit = TRUE;
+  pthread_cond_broadcast(&writer->cond);
+  dt_pthread_mutex_unlock(&writer->lock);
+  // the threads only leave once the queue is empty
+  for(int k = 0; k < writer->num_threads; k++) pthread_join(writer->threads[k], NULL);
+  free(writer->threads);
+  g_queue_free(writer->queue);
+  pthread_cond_destroy(&writer->cond);
+  dt_pthread_mutex_destroy(&writer->lock);
+  free(writer);
+}
+
+void dt_imageio_export_writer_bind(dt_imageio_export_writer_t *writer)
+{
+  _bound_writer = writer;
+}
+
+gboolean dt_imageio_export_deferred()
+{
+  return _deferred;
+}
+
+int dt_imageio_export_writer_failed(dt_imageio_export_writer_t *writer)
+{
+  if(!writer) return 0;
+  dt_pthread_mutex_lock(&writer->lock);
+  const int failed = writer->failed;
+  dt_pthread_mutex_unlock(&writer->lock);
+  return failed;
+}
+
 int dt_imageio_export(const int32_t imgid, const char *filename, dt_imageio_module_format_t *format,
                       dt_imageio_module_data_t *format_params, const gboolean high_quality, const gboolean upscale,
                       const gboolean copy_metadata, const gboolean export_masks,
@@ -636,6 +874,7 @@ int dt_imageio_export(const int32_t imgid, const char *filename, dt_imageio_modu
                       dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
                       dt_imageio_module_data_t *storage_params, int num, int total, dt_export_metadata_t *metadata)
 {
+  _deferred = FALSE;
   if(strcmp(format->mime(format_params), "x-copy") == 0)
     /* This is a just a copy, skip process and just export */
     return format->write_image(format_params, filename, NULL, icc_type, icc_filename, NULL, 0, imgid, num, total, NULL,
@@ -657,16 +896,22 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_data_t *storage_params, int num, int total,
                                  dt_export_metadata_t *metadata)
 {
+  _deferred = FALSE;
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
   dt_dev_load_image(&dev, imgid);
 
+  const char *trace_category = thumbnail_export ? "thumbnail" : "export";
+  dt_times_t load_start;
+  dt_get_times(&load_start);
+
   const gboolean buf_is_downscaled = (thumbnail_export && dt_conf_get_bool("ui/performance"));
   dt_mipmap_buffer_t buf;
   if(buf_is_downscaled)
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
   else
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  dt_trace_event(trace_category, "load", imgid, &load_start, 0, DT_TRACE_NONE);
 
   const dt_image_t *img = &dev.image_storage;
 
@@ -1032,6 +1277,55 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   format_params->width = processed_width;
   format_params->height = processed_height;
 
+  // hand encoding and writing over to the writer stage if the export job set one up.
+  // tiff needs the pipe for the masks and some formats keep state across images, these
+  // are written right here.
+  dt_imageio_export_writer_t *writer = _bound_writer;
+  if(writer && !thumbnail_export && !export_masks && strcmp(format->mime(format_params), "memory")
+     && !(format->flags(format_params) & FORMAT_FLAGS_SEQUENTIAL))
+  {
+    const size_t size = (size_t)processed_width * processed_height * 4 * (bpp / 8);
+    _export_writer_reserve(writer);
+    dt_imageio_export_task_t *task = calloc(1, sizeof(dt_imageio_export_task_t));
+    task->buf = dt_alloc_align(64, size);
+    task->format_params = format->get_params(format);
+    if(task->buf && task->format_params)
+    {
+      memcpy(task->buf, outbuf, size);
+      memcpy(task->format_params, format_params, format->params_size(format));
+      task->imgid = imgid;
+      task->filename = g_strdup(filename);
+      task->format = format;
+      task->storage = storage;
+      task->storage_params = storage_params;
+      task->ignore_exif = ignore_exif;
+      task->copy_metadata = copy_metadata;
+      task->sRGB = sRGB;
+      task->icc_type = icc_type;
+      task->icc_filename = g_strdup(icc_filename);
+      task->num = num;
+      task->total = total;
+      task->metadata = metadata;
+      GStatBuf st;
+      task->created = g_stat(filename, &st) != 0 || st.st_size == 0;
+
+      dt_dev_pixelpipe_cleanup(&pipe);
+      dt_dev_cleanup(&dev);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      _export_writer_push(writer, task);
+      _deferred = TRUE;
+      return 0;
+    }
+    // out of memory for the copy, write synchronously
+    if(task->format_params) format->free_params(format, task->format_params);
+    dt_free_align(task->buf);
+    free(task);
+    _export_writer_unreserve(writer);
+  }
+
+  dt_times_t write_start;
+  dt_get_times(&write_start);
+
   if(!ignore_exif)
   {
     int length;
@@ -1054,6 +1348,7 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
     res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
                               &pipe, export_masks);
   }
+  dt_trace_event(trace_category, "write", imgid, &write_start, 0, DT_TRACE_NONE);
 
   if(res)
     goto error;
@@ -1062,41 +1357,8 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach_export(imgid, filename, metadata);
-    // no need to cancel the export if this fail
-  }
-
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-#ifdef USE_LUA
-    //Synchronous calling of lua intermediate-export-image events
-    dt_lua_lock();
-
-    lua_State *L = darktable.lua_state.state;
-
-    luaA_push(L, dt_lua_image_t, &imgid);
-
-    lua_pushstring(L, filename);
-
-    luaA_push_type(L, format->parameter_lua_type, format_params);
-
-    if (storage)
-      luaA_push_type(L, storage->parameter_lua_type, storage_params);
-    else
-      lua_pushnil(L);
-
-    dt_lua_event_trigger(L, "intermediate-export-image", 4);
-
-    dt_lua_unlock();
-#endif
-
-    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  _export_written(imgid, filename, format, format_params, storage, storage_params, copy_metadata,
+                  thumbnail_export, metadata);
 
   return 0; // success
 
@@ -88,6 +88,24 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
                                  int num, int total, dt_export_metadata_t *metadata);
 
+// asynchronous encode and write stage for batch exports. while a writer is
+// bound to the calling thread, dt_imageio_export_with_flags() copies the
+// processed image into the writer's bounded queue and returns, so the next
+// image can go through the pixelpipe while this one is encoded and written.
+typedef struct dt_imageio_export_writer_t dt_imageio_export_writer_t;
+// start `threads' writer threads. at most `depth' copies of images are queued or being written,
+// a pipe with the next one waits for a free slot before copying its output.
+dt_imageio_export_writer_t *dt_imageio_export_writer_new(const int threads, const int depth);
+// wait until all queued images are written, stop the threads and free the writer.
+void dt_imageio_export_writer_destroy(dt_imageio_export_writer_t *writer);
+// bind the writer to the calling thread, NULL unbinds it.
+void dt_imageio_export_writer_bind(dt_imageio_export_writer_t *writer);
+// TRUE if the last export of the calling thread went to the bound writer. the file isn't written
+// yet then, the writer reports success or failure itself once it is.
+gboolean dt_imageio_export_deferred();
+// number of images the writer failed to write so far.
+int dt_imageio_export_writer_failed(dt_imageio_export_writer_t *writer);
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -39,9 +39,17 @@ typedef enum dt_imageio_format_flags_t
 {
   FORMAT_FLAGS_SUPPORT_XMP = 1,
   FORMAT_FLAGS_NO_TMPFILE = 2,
-  FORMAT_FLAGS_SUPPORT_LAYERS = 4
+  FORMAT_FLAGS_SUPPORT_LAYERS = 4,
+  FORMAT_FLAGS_SEQUENTIAL = 8 // write_image() keeps state in fdata across the images of one export
 } dt_imageio_format_flags_t;
 
+/** Flag for the storage modules */
+typedef enum dt_imageio_storage_flags_t
+{
+  /** store() may be called for several images at the same time, each with its own fdata */
+  STORAGE_FLAGS_PARALLEL_STORE = 1
+} dt_imageio_storage_flags_t;
+
 /**
  * defines the plugin structure for image import and export.
  *
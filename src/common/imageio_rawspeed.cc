@@ -31,6 +31,7 @@ extern "C" {
 #include "common/darktable.h"
 #include "common/exif.h"
 #include "common/file_location.h"
+#include "common/filemap.h"
 #include "common/imageio_rawspeed.h"
 #include "imageio.h"
 #include "common/tags.h"
@@ -49,6 +50,13 @@ int rawspeed_get_number_of_processor_cores()
 
 using namespace rawspeed;
 
+// releases the mapped file however loading ends
+struct dt_rawspeed_file_t
+{
+  dt_filemap_t map = {};
+  ~dt_rawspeed_file_t() { dt_filemap_close(&map); }
+};
+
 static dt_imageio_retval_t dt_imageio_open_rawspeed_sraw (dt_image_t *img, RawImage r, dt_mipmap_buffer_t *buf);
 static CameraMetaData *meta = NULL;
 
@@ -119,6 +127,8 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
 
+  // declared before the buffer, which refers to its memory
+  dt_rawspeed_file_t file;
   std::unique_ptr<RawDecoder> d;
   std::unique_ptr<const Buffer> m;
 
@@ -126,9 +136,10 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
-    dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    m = f.readFile();
-    dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    if(!dt_filemap_open(filen, &file.map))
+      m.reset(new Buffer(file.map.data, (Buffer::size_type)file.map.size));
+    else
+      m = f.readFile(); // let rawspeed tell what's wrong with the file
 
     RawParser t(m.get());
     d = t.getDecoder(meta);
@@ -223,6 +234,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+    dt_filemap_close(&file.map);
 
     // Grab the WB
     for(int i = 0; i < 4; i++) img->wb_coeffs[i] = r->metadata.wbCoeffs[i];
@@ -19,6 +19,7 @@
 #include "common/colorspaces.h"
 #include "common/darktable.h"
 #include "common/exif.h"
+#include "common/halffloat.h"
 #include "control/conf.h"
 #include "develop/develop.h"
 #include "imageio.h"
@@ -45,41 +46,6 @@ typedef struct tiff_t
   tdata_t buf;
 } tiff_t;
 
-typedef union fp32_t
-{
-  uint32_t u;
-  float f;
-} fp32_t;
-
-static inline float _half_to_float(uint16_t h)
-{
-  /* see https://en.wikipedia.org/wiki/Half-precision_floating-point_format#Exponent_encoding
-     and https://en.wikipedia.org/wiki/Single-precision_floating-point_format#Exponent_encoding */
-
-  /* TODO: use intrinsics when possible */
-
-  /* from https://gist.github.com/rygorous/2156668 */
-  static const fp32_t magic = { 113 << 23 };
-  static const uint32_t shifted_exp = 0x7c00 << 13; // exponent mask after shift
-  fp32_t o;
-
-  o.u = (h & 0x7fff) << 13;     // exponent/mantissa bits
-  uint32_t exp = shifted_exp & o.u;   // just the exponent
-  o.u += (127 - 15) << 23;        // exponent adjust
-
-  // handle exponent special cases
-  if (exp == shifted_exp) // Inf/NaN?
-    o.u += (128 - 16) << 23;    // extra exp adjust
-  else if (exp == 0) // Zero/Denormal?
-  {
-    o.u += 1 << 23;             // extra exp adjust
-    o.f -= magic.f;             // renormalize
-  }
-
-  o.u |= (h & 0x8000) << 16;    // sign bit
-  return o.f;
-}
-
 static inline int _read_chunky_8(tiff_t *t)
 {
   for(uint32_t row = 0; row < t->height; row++)
@@ -155,7 +121,7 @@ static inline int _read_chunky_h(tiff_t *t)
 
     for(uint32_t i = 0; i < t->width; i++, in += t->spp, out += 4)
     {
-      out[0] = _half_to_float(in[0]);
+      out[0] = dt_half_to_float(in[0]);
 
       if(t->spp == 1)
       {
@@ -163,8 +129,8 @@ static inline int _read_chunky_h(tiff_t *t)
       }
       else
       {
-        out[1] = _half_to_float(in[1]);
-        out[2] = _half_to_float(in[2]);
+        out[1] = dt_half_to_float(in[1]);
+        out[2] = dt_half_to_float(in[2]);
       }
 
       out[3] = 0;
@@ -1380,6 +1380,7 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
+__DT_CLONE_TARGETS__
 static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
                                             const dt_iop_roi_t *const roi_out, const int32_t out_stride,
                                             const float *const in, const dt_iop_roi_t *const roi_in,
@@ -1717,7 +1718,7 @@ void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
                                const float *const in, const dt_iop_roi_t *const roi_in,
                                const int32_t in_stride)
 {
-  if(darktable.codepath.OPENMP_SIMD)
+  if(darktable.codepath.OPENMP_SIMD || darktable.codepath.AVX2)
     return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
 #if defined(__SSE2__)
   else if(darktable.codepath.SSE2)
@@ -1998,6 +1999,7 @@ int dt_interpolation_resample_roi_cl(const struct dt_interpolation *itor, int de
 }
 #endif
 
+__DT_CLONE_TARGETS__
 static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *itor, float *out,
                                                const dt_iop_roi_t *const roi_out, const int32_t out_stride,
                                                const float *const in, const dt_iop_roi_t *const roi_in,
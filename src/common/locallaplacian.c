@@ -530,6 +530,7 @@ void apply_curve_sse2(
 #endif
 
 // scalar version
+__DT_CLONE_TARGETS__
 void apply_curve(
     float *const out,
     const float *const in,
@@ -560,6 +561,7 @@ void apply_curve(
   pad_by_replication(out, w, h, padding);
 }
 
+__DT_CLONE_TARGETS__
 void local_laplacian_internal(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
@@ -22,6 +22,7 @@
 #include "common/exif.h"
 #include "common/file_location.h"
 #include "common/grealpath.h"
+#include "common/history.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
@@ -307,6 +308,121 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+static inline gboolean _use_disk_backend(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
+
+// hash of the current history, used by the packed store to detect stale thumbnails. the database
+// is only asked once per image until dt_mipmap_cache_history_changed().
+static uint64_t _history_hash(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&cache->history_hash_lock);
+  const uint64_t *cached = g_hash_table_lookup(cache->history_hash, GUINT_TO_POINTER(imgid));
+  const uint64_t known = cached ? *cached : 0;
+  const uint32_t generation = cache->history_hash_generation;
+  dt_pthread_mutex_unlock(&cache->history_hash_lock);
+  if(cached) return known;
+
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(imgid, &hash);
+  uint64_t h = 5381;
+  for(int k = 0; k < hash.current_len; k++) h = ((h << 5) + h) ^ hash.current[k];
+  free(hash.basic);
+  free(hash.auto_apply);
+  free(hash.current);
+
+  // a history written while we were reading may have been missed, don't remember the result then
+  dt_pthread_mutex_lock(&cache->history_hash_lock);
+  if(generation == cache->history_hash_generation)
+  {
+    uint64_t *value = g_new(uint64_t, 1);
+    *value = h;
+    g_hash_table_insert(cache->history_hash, GUINT_TO_POINTER(imgid), value);
+  }
+  dt_pthread_mutex_unlock(&cache->history_hash_lock);
+  return h;
+}
+
+void dt_mipmap_cache_history_changed(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  if(!cache || !cache->history_hash) return;
+  dt_pthread_mutex_lock(&cache->history_hash_lock);
+  g_hash_table_remove(cache->history_hash, GUINT_TO_POINTER(imgid));
+  cache->history_hash_generation++;
+  dt_pthread_mutex_unlock(&cache->history_hash_lock);
+}
+
+static int _load_from_store(dt_mipmap_cache_t *cache, dt_cache_entry_t *entry, const dt_mipmap_size_t mip)
+{
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  const uint32_t imgid = get_imgid(entry->key);
+  uint8_t *blob = NULL;
+  size_t len = 0;
+  dt_mipmap_store_info_t info;
+  const dt_mipmap_store_result_t err
+      = dt_mipmap_store_read(cache->store, imgid, mip, _history_hash(cache, imgid), &blob, &len, &info);
+  if(err != DT_MIPMAP_STORE_OK)
+  {
+    // outdated thumbnail, drop it so that the regenerated one gets written on eviction
+    if(err == DT_MIPMAP_STORE_STALE) dt_mipmap_store_remove(cache->store, imgid, mip);
+    return 0;
+  }
+
+  int loaded = 0;
+  dt_imageio_jpeg_t jpg;
+  if(dt_imageio_jpeg_decompress_header(blob, len, &jpg)
+     || (jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip])
+     || sizeof(*dsc) + (size_t)jpg.width * jpg.height * 4 > entry->data_size
+     || dt_imageio_jpeg_decompress(&jpg, entry->data + sizeof(*dsc)))
+  {
+    fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from packed store!\n",
+            imgid);
+    dt_mipmap_store_remove(cache->store, imgid, mip);
+  }
+  else
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from packed disk cache\n", mip,
+             imgid);
+    dsc->width = jpg.width;
+    dsc->height = jpg.height;
+    dsc->iscale = 1.0f;
+    dsc->color_space = info.color_space;
+    loaded = 1;
+  }
+  g_free(blob);
+  return loaded;
+}
+
+static void _write_to_store(dt_mipmap_cache_t *cache, dt_cache_entry_t *entry, const dt_mipmap_size_t mip)
+{
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  const uint32_t imgid = get_imgid(entry->key);
+  // as for the jpg files, don't rewrite what is already there (quality suffers)
+  if(dt_mipmap_store_contains(cache->store, imgid, mip)) return;
+
+  // the compressor can't grow its output buffer, which is as large as the input.
+  // don't bother with the really tiny ones.
+  const size_t out_size = (size_t)dsc->width * dsc->height * 4;
+  if(out_size < 4096) return;
+  uint8_t *blob = (uint8_t *)dt_alloc_align(64, out_size);
+  if(!blob) return;
+
+  const int cache_quality = dt_conf_get_int("database_cache_quality");
+  const int len = dt_imageio_jpeg_compress(entry->data + sizeof(*dsc), blob, dsc->width, dsc->height,
+                                           MIN(100, MAX(10, cache_quality)));
+  if(len > 1)
+  {
+    const dt_mipmap_store_info_t info = { .width = dsc->width,
+                                          .height = dsc->height,
+                                          .color_space = dsc->color_space,
+                                          .hash = _history_hash(cache, imgid) };
+    dt_mipmap_store_write(cache->store, imgid, mip, blob, len, &info);
+  }
+  dt_free_align(blob);
+}
+
 // callback for the cache backend to initialize payload pointers
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -367,10 +483,14 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   assert(dsc->size >= sizeof(*dsc));
 
   int loaded_from_disk = 0;
-  if(mip < DT_MIPMAP_F)
+  if(mip < DT_MIPMAP_F && _use_disk_backend(cache, mip))
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    if(cache->store)
+    {
+      // one index probe plus one read
+      loaded_from_disk = _load_from_store(cache, entry, mip);
+    }
+    else
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -444,6 +564,7 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
   }
+  dt_mipmap_store_remove(cache->store, imgid, mip);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -460,8 +581,11 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else if(cache->store && _use_disk_backend(cache, mip))
+      {
+        _write_to_store(cache, entry, mip);
+      }
+      else if(_use_disk_backend(cache, mip))
       {
         // serialize to disk
         char filename[PATH_MAX] = {0};
@@ -529,6 +653,16 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  cache->store = NULL;
+  dt_pthread_mutex_init(&cache->history_hash_lock, NULL);
+  cache->history_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  cache->history_hash_generation = 0;
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend_packed"))
+  {
+    char storedir[PATH_MAX] = { 0 };
+    snprintf(storedir, sizeof(storedir), "%s.d/packed", cache->cachedir);
+    cache->store = dt_mipmap_store_open(storedir);
+  }
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -583,7 +717,9 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // thumbnails are requested by all worker threads and the gui at once, use lock stripes.
+  // the float and full buffers only hold a handful of entries, one lock is fine there.
+  dt_cache_init_sharded(&cache->mip_thumbs.cache, 0, max_mem, 2 * dt_get_num_threads());
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -611,6 +747,12 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, their cleanup still writes thumbnails
+  dt_mipmap_store_close(cache->store);
+  cache->store = NULL;
+  g_hash_table_destroy(cache->history_hash);
+  cache->history_hash = NULL;
+  dt_pthread_mutex_destroy(&cache->history_hash_lock);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -657,6 +799,20 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
          100.0 * cache->mip_full.stats_standin / (float)sum_standins,
          100.0 * cache->mip_full.stats_fetches / (float)sum_fetches,
          100.0 * cache->mip_full.stats_requests / (float)sum);
+
+  dt_cache_stats_t stats[3];
+  dt_cache_get_stats(&cache->mip_thumbs.cache, &stats[0]);
+  dt_cache_get_stats(&cache->mip_f.cache, &stats[1]);
+  dt_cache_get_stats(&cache->mip_full.cache, &stats[2]);
+  const char *names[3] = { "thumb", "float", "full " };
+  const int shards[3]
+      = { cache->mip_thumbs.cache.num_shards, cache->mip_f.cache.num_shards, cache->mip_full.cache.num_shards };
+  printf("[mipmap_cache] level | shards | locks | contended | retries\n");
+  for(int k = 0; k < 3; k++)
+    printf("[mipmap_cache] %s | %6d | %ld | %6.2f%% | %ld\n", names[k], shards[k], stats[k].locks,
+           stats[k].locks ? 100.0 * stats[k].contended / (float)stats[k].locks : 0.0, stats[k].retries);
+
+  dt_mipmap_store_print(cache->store);
   printf("\n\n");
 }
 
@@ -679,6 +835,39 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+gboolean dt_mipmap_cache_is_on_disk(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0]) return FALSE;
+  if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
+    return FALSE; // remove the (int) once we no longer have to support gcc < 4.8 :/
+  if(cache->store)
+  {
+    // a single index probe, no stat() on the file system
+    return dt_mipmap_store_contains(cache->store, imgid, mip);
+  }
+  char filename[PATH_MAX] = {0};
+  // named like the files dt_mipmap_cache_deallocate_dynamic() writes
+  snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
+gboolean dt_mipmap_cache_prefetch_disk(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(dt_mipmap_cache_is_loaded(cache, imgid, mip) || !dt_mipmap_cache_is_on_disk(cache, imgid, mip)) return FALSE;
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_prefetch_job_create(imgid, mip));
+  return TRUE;
+}
+
+gboolean dt_mipmap_cache_is_loaded(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_NONE || (int)mip < DT_MIPMAP_0) return FALSE;
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(cache, &buf, imgid, mip, DT_MIPMAP_TESTLOCK, 'r');
+  const gboolean loaded = buf.buf != NULL;
+  dt_mipmap_cache_release(cache, &buf);
+  return loaded;
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -732,13 +921,7 @@ void dt_mipmap_cache_get_with_caller(
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
   {
     // only prefetch if the disk cache exists:
-    if(!cache->cachedir[0]) return;
-    if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
-      return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-    // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_is_on_disk(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -918,7 +1101,12 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
+    if(cache->store)
+    {
+      if(dt_mipmap_store_contains(cache->store, imgid, mip))
+        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
+    }
+    else if(cache->cachedir[0])
     {
       char filename[PATH_MAX] = {0};
       snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
@@ -1317,9 +1505,27 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
   return DT_COLORSPACE_DISPLAY;
 }
 
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
-  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+  if(cache->store && dt_conf_get_bool("cache_disk_backend"))
+  {
+    // called once the history is copied, so this is the hash the copies are made from
+    const uint64_t src_hash = _history_hash(cache, src_imgid);
+    const uint64_t dst_hash = _history_hash(cache, dst_imgid);
+    for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+    {
+      uint8_t *blob = NULL;
+      size_t len = 0;
+      dt_mipmap_store_info_t info;
+      if(dt_mipmap_store_read(cache->store, src_imgid, mip, src_hash, &blob, &len, &info) == DT_MIPMAP_STORE_OK)
+      {
+        info.hash = dst_hash;
+        dt_mipmap_store_write(cache->store, dst_imgid, mip, blob, len, &info);
+      }
+      g_free(blob);
+    }
+  }
+  else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
@@ -21,6 +21,7 @@
 #include "common/cache.h"
 #include "common/colorspaces.h"
 #include "common/image.h"
+#include "common/mipmap_store.h"
 
 // sizes stored in the mipmap cache, set to fixed values in mipmap_cache.c
 typedef enum dt_mipmap_size_t {
@@ -99,6 +100,13 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // packed disk backend, NULL if thumbnails are stored as one jpg file each
+  dt_mipmap_store_t *store;
+  // current history hash per image for the packed store, thumbnails are loaded and evicted with
+  // a shard lock held and shouldn't query the database each time
+  dt_pthread_mutex_t history_hash_lock;
+  GHashTable *history_hash; // imgid -> uint64_t
+  uint32_t history_hash_generation;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -134,6 +142,17 @@ void dt_mipmap_cache_write_get_with_caller(
     const char *file,
     int line);
 
+// is `mip' of `imgid' in the disk cache, whichever backend holds it?
+gboolean dt_mipmap_cache_is_on_disk(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
+// like DT_MIPMAP_PREFETCH_DISK, for speculative loads: nothing is queued if the buffer is in memory
+// already, and the load is called off by dt_image_prefetch_cancel() if it hasn't started by then.
+// returns TRUE if a load was queued.
+gboolean dt_mipmap_cache_prefetch_disk(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
+// is the buffer in memory? doesn't wait for or load anything.
+gboolean dt_mipmap_cache_is_loaded(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
 // drop a lock
 #define dt_mipmap_cache_release(A, B) dt_mipmap_cache_release_with_caller(A, B, __FILE__, __LINE__)
 void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const char *file,
@@ -141,6 +160,8 @@ void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buf
 
 // remove thumbnails, so they will be regenerated:
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid);
+// the history hash of the image was written, stored thumbnails made from another one are stale
+void dt_mipmap_cache_history_changed(dt_mipmap_cache_t *cache, const uint32_t imgid);
 void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
 
 // evict thumbnails from cache. They will be written to disc if not existing
@@ -163,7 +184,7 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
-void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
+void dt_mipmap_cache_copy_thumbnails(dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(char *value);
@@ -0,0 +1,822 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_store.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DT_MIPMAP_STORE_INDEX_MAGIC 0xD7570BE5u
+#define DT_MIPMAP_STORE_RECORD_MAGIC 0xD75EC0DEu
+#define DT_MIPMAP_STORE_TOMBSTONE_MAGIC 0xD75DEAD0u
+#define DT_MIPMAP_STORE_VERSION 1
+#define DT_MIPMAP_STORE_INITIAL_SLOTS (1u << 16)
+// start a new segment once the current one grows beyond this
+#define DT_MIPMAP_STORE_SEGMENT_SIZE (((uint64_t)256) << 20)
+// don't bother compacting before that much space could be reclaimed
+#define DT_MIPMAP_STORE_COMPACT_MIN (((uint64_t)64) << 20)
+
+typedef enum dt_mipmap_store_slot_state_t
+{
+  DT_MIPMAP_STORE_SLOT_EMPTY = 0,
+  DT_MIPMAP_STORE_SLOT_LIVE = 1,
+  DT_MIPMAP_STORE_SLOT_DELETED = 2
+} dt_mipmap_store_slot_state_t;
+
+// first bytes of the index file
+typedef struct dt_mipmap_store_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;    // number of slots, power of two
+  uint32_t used;        // live + deleted slots
+  uint32_t live;        // live slots
+  uint32_t segment;     // segment we currently append to
+  uint64_t segment_end; // append position in that segment
+  uint64_t live_bytes;  // bytes in segments referenced by the index
+  uint64_t dead_bytes;  // bytes in segments which could be reclaimed by compaction
+  uint32_t clean;       // set on orderly shutdown only
+  uint32_t padding[5];
+} dt_mipmap_store_header_t;
+
+typedef struct dt_mipmap_store_slot_t
+{
+  uint32_t key;
+  uint32_t state;
+  uint64_t hash;
+  uint64_t offset; // of the record header inside the segment
+  uint32_t segment;
+  uint32_t length; // payload length
+} dt_mipmap_store_slot_t;
+
+// header in front of every payload inside a segment
+typedef struct dt_mipmap_store_record_t
+{
+  uint32_t magic;
+  uint32_t key;
+  uint64_t hash;
+  uint32_t length;
+  uint32_t width;
+  uint32_t height;
+  int32_t color_space;
+  uint64_t checksum;        // of the payload
+  uint64_t header_checksum; // of all the fields above
+} dt_mipmap_store_record_t;
+
+struct dt_mipmap_store_t
+{
+  char path[PATH_MAX];
+
+  // the mmap'ed index
+  int index_fd;
+  size_t index_size;
+  dt_mipmap_store_header_t *header;
+  dt_mipmap_store_slot_t *slots;
+
+  // segment number -> file descriptor + 1
+  GHashTable *segments;
+  dt_pthread_mutex_t segments_lock;
+
+  // readers share the index, writers, compaction and index growth are exclusive
+  dt_pthread_rwlock_t lock;
+
+  // stats for this run
+  long int stats_hits;
+  long int stats_misses;
+  long int stats_stale;
+  long int stats_writes;
+};
+
+static inline uint32_t _store_key(const uint32_t imgid, const int mip)
+{
+  // same layout as the in-memory mipmap cache keys
+  return (((uint32_t)mip) << 28) | (imgid - 1);
+}
+
+static inline uint32_t _slot_hash(const uint32_t key)
+{
+  // fibonacci hashing, keys are mostly sequential image ids
+  return key * 2654435761u;
+}
+
+static uint64_t _checksum(const void *data, const size_t length)
+{
+  // 64-bit FNV-1a
+  const uint8_t *p = (const uint8_t *)data;
+  uint64_t hash = 14695981039346656037ull;
+  for(size_t k = 0; k < length; k++)
+  {
+    hash ^= p[k];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static inline uint64_t _record_checksum(const dt_mipmap_store_record_t *rec)
+{
+  return _checksum(rec, offsetof(dt_mipmap_store_record_t, header_checksum));
+}
+
+static inline uint64_t _record_size(const uint32_t length)
+{
+  return sizeof(dt_mipmap_store_record_t) + length;
+}
+
+static int _pwrite_all(const int fd, const void *buf, size_t count, off_t offset)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+  while(count > 0)
+  {
+    const ssize_t written = pwrite(fd, p, count, offset);
+    if(written < 0 && errno == EINTR) continue;
+    if(written <= 0) return 1;
+    p += written;
+    count -= written;
+    offset += written;
+  }
+  return 0;
+}
+
+static int _pread_all(const int fd, void *buf, size_t count, off_t offset)
+{
+  uint8_t *p = (uint8_t *)buf;
+  while(count > 0)
+  {
+    const ssize_t rd = pread(fd, p, count, offset);
+    if(rd < 0 && errno == EINTR) continue;
+    if(rd <= 0) return 1;
+    p += rd;
+    count -= rd;
+    offset += rd;
+  }
+  return 0;
+}
+
+static void _segment_filename(const dt_mipmap_store_t *store, const uint32_t segment, char *filename,
+                              const size_t size)
+{
+  snprintf(filename, size, "%s/%08" PRIu32 ".seg", store->path, segment);
+}
+
+static int _segment_fd(dt_mipmap_store_t *store, const uint32_t segment, const gboolean create)
+{
+  dt_pthread_mutex_lock(&store->segments_lock);
+  int fd = GPOINTER_TO_INT(g_hash_table_lookup(store->segments, GUINT_TO_POINTER(segment))) - 1;
+  if(fd < 0)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _segment_filename(store, segment, filename, sizeof(filename));
+    fd = open(filename, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0640);
+    if(fd >= 0) g_hash_table_insert(store->segments, GUINT_TO_POINTER(segment), GINT_TO_POINTER(fd + 1));
+  }
+  dt_pthread_mutex_unlock(&store->segments_lock);
+  return fd;
+}
+
+static void _segment_close(dt_mipmap_store_t *store, const uint32_t segment)
+{
+  dt_pthread_mutex_lock(&store->segments_lock);
+  const int fd = GPOINTER_TO_INT(g_hash_table_lookup(store->segments, GUINT_TO_POINTER(segment))) - 1;
+  if(fd >= 0)
+  {
+    close(fd);
+    g_hash_table_remove(store->segments, GUINT_TO_POINTER(segment));
+  }
+  dt_pthread_mutex_unlock(&store->segments_lock);
+}
+
+static gint _sort_segments(gconstpointer a, gconstpointer b)
+{
+  const uint32_t sa = GPOINTER_TO_UINT(a), sb = GPOINTER_TO_UINT(b);
+  return (sa > sb) - (sa < sb);
+}
+
+// sorted list of all segment numbers found on disk
+static GList *_list_segments(const dt_mipmap_store_t *store)
+{
+  GList *segments = NULL;
+  GDir *dir = g_dir_open(store->path, 0, NULL);
+  if(!dir) return NULL;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".seg")) continue;
+    char *end = NULL;
+    const unsigned long segment = strtoul(name, &end, 10);
+    if(end && !strcmp(end, ".seg")) segments = g_list_prepend(segments, GUINT_TO_POINTER((uint32_t)segment));
+  }
+  g_dir_close(dir);
+  return g_list_sort(segments, _sort_segments);
+}
+
+static dt_mipmap_store_slot_t *_find_slot(dt_mipmap_store_slot_t *slots, const uint32_t capacity,
+                                          const uint32_t key, const gboolean for_insert)
+{
+  const uint32_t mask = capacity - 1;
+  dt_mipmap_store_slot_t *deleted = NULL;
+  uint32_t i = _slot_hash(key) & mask;
+  for(uint32_t n = 0; n < capacity; n++, i = (i + 1) & mask)
+  {
+    dt_mipmap_store_slot_t *slot = slots + i;
+    if(slot->state == DT_MIPMAP_STORE_SLOT_EMPTY) return for_insert ? (deleted ? deleted : slot) : NULL;
+    if(slot->state == DT_MIPMAP_STORE_SLOT_DELETED)
+    {
+      if(!deleted) deleted = slot;
+      continue;
+    }
+    if(slot->key == key) return slot;
+  }
+  return for_insert ? deleted : NULL;
+}
+
+static int _index_map(dt_mipmap_store_t *store, const char *filename, const uint32_t capacity, int *fd,
+                      size_t *size, dt_mipmap_store_header_t **header)
+{
+  *size = sizeof(dt_mipmap_store_header_t) + (size_t)capacity * sizeof(dt_mipmap_store_slot_t);
+  *fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+  if(*fd < 0) return 1;
+  if(ftruncate(*fd, *size))
+  {
+    close(*fd);
+    return 1;
+  }
+  void *mem = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  if(mem == MAP_FAILED)
+  {
+    close(*fd);
+    return 1;
+  }
+  *header = (dt_mipmap_store_header_t *)mem;
+  return 0;
+}
+
+static void _index_reset(dt_mipmap_store_t *store, const uint32_t capacity)
+{
+  dt_mipmap_store_header_t *h = store->header;
+  memset(store->header, 0, store->index_size);
+  h->magic = DT_MIPMAP_STORE_INDEX_MAGIC;
+  h->version = DT_MIPMAP_STORE_VERSION;
+  h->capacity = capacity;
+}
+
+// rehash into a fresh index file, twice the size if needed. requires the write lock.
+static int _index_grow(dt_mipmap_store_t *store)
+{
+  const dt_mipmap_store_header_t *old = store->header;
+  const uint32_t capacity = (old->live > old->capacity / 4) ? old->capacity * 2 : old->capacity;
+
+  char filename[PATH_MAX] = { 0 }, tmpname[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s/index", store->path);
+  snprintf(tmpname, sizeof(tmpname), "%s/index.new", store->path);
+
+  int fd;
+  size_t size;
+  dt_mipmap_store_header_t *header;
+  if(_index_map(store, tmpname, capacity, &fd, &size, &header)) return 1;
+
+  memset(header, 0, size);
+  *header = *old;
+  header->capacity = capacity;
+  header->used = header->live = 0;
+  dt_mipmap_store_slot_t *slots = (dt_mipmap_store_slot_t *)(header + 1);
+  for(uint32_t k = 0; k < old->capacity; k++)
+  {
+    const dt_mipmap_store_slot_t *slot = store->slots + k;
+    if(slot->state != DT_MIPMAP_STORE_SLOT_LIVE) continue;
+    *_find_slot(slots, capacity, slot->key, TRUE) = *slot;
+    header->used++;
+    header->live++;
+  }
+
+  msync(header, size, MS_SYNC);
+  if(g_rename(tmpname, filename))
+  {
+    munmap(header, size);
+    close(fd);
+    g_unlink(tmpname);
+    return 1;
+  }
+
+  munmap(store->header, store->index_size);
+  close(store->index_fd);
+  store->index_fd = fd;
+  store->index_size = size;
+  store->header = header;
+  store->slots = slots;
+  return 0;
+}
+
+// make the index point to a new record, or drop the key if rec is a tombstone.
+static void _index_apply(dt_mipmap_store_t *store, const dt_mipmap_store_record_t *rec, const uint32_t segment,
+                         const uint64_t offset)
+{
+  dt_mipmap_store_header_t *h = store->header;
+  dt_mipmap_store_slot_t *slot = _find_slot(store->slots, h->capacity, rec->key, FALSE);
+
+  if(slot)
+  {
+    // whatever we had before is garbage now
+    h->live_bytes -= _record_size(slot->length);
+    h->dead_bytes += _record_size(slot->length);
+    h->live--;
+    slot->state = DT_MIPMAP_STORE_SLOT_DELETED;
+  }
+
+  if(rec->magic == DT_MIPMAP_STORE_TOMBSTONE_MAGIC)
+  {
+    h->dead_bytes += _record_size(0);
+    return;
+  }
+
+  if(!slot && (uint64_t)(h->used + 1) * 10 > (uint64_t)h->capacity * 7)
+  {
+    if(_index_grow(store))
+    {
+      fprintf(stderr, "[mipmap_store] failed to grow index in `%s'\n", store->path);
+      h = store->header;
+      h->dead_bytes += _record_size(rec->length);
+      return;
+    }
+    h = store->header;
+  }
+
+  if(!slot)
+  {
+    slot = _find_slot(store->slots, h->capacity, rec->key, TRUE);
+    if(slot->state == DT_MIPMAP_STORE_SLOT_EMPTY) h->used++;
+  }
+  slot->key = rec->key;
+  slot->state = DT_MIPMAP_STORE_SLOT_LIVE;
+  slot->hash = rec->hash;
+  slot->segment = segment;
+  slot->offset = offset;
+  slot->length = rec->length;
+  h->live++;
+  h->live_bytes += _record_size(rec->length);
+}
+
+// append a record to the current segment. requires the write lock.
+static int _append(dt_mipmap_store_t *store, dt_mipmap_store_record_t *rec, const uint8_t *payload,
+                   uint32_t *segment, uint64_t *offset)
+{
+  dt_mipmap_store_header_t *h = store->header;
+  const uint64_t size = _record_size(rec->length);
+  if(h->segment_end > 0 && h->segment_end + size > DT_MIPMAP_STORE_SEGMENT_SIZE)
+  {
+    _segment_close(store, h->segment);
+    h->segment++;
+    h->segment_end = 0;
+  }
+
+  const int fd = _segment_fd(store, h->segment, TRUE);
+  if(fd < 0) return 1;
+
+  rec->header_checksum = _record_checksum(rec);
+  // header and payload go out in one write, a torn record is detected by its length on rebuild
+  uint8_t *buf = g_try_malloc(size);
+  if(!buf) return 1;
+  memcpy(buf, rec, sizeof(*rec));
+  if(rec->length) memcpy(buf + sizeof(*rec), payload, rec->length);
+  const int err = _pwrite_all(fd, buf, size, h->segment_end);
+  g_free(buf);
+  if(err)
+  {
+    // don't leave a partial record behind
+    if(ftruncate(fd, h->segment_end)) {}
+    return 1;
+  }
+
+  *segment = h->segment;
+  *offset = h->segment_end;
+  h->segment_end += size;
+  return 0;
+}
+
+// rebuild the index from the segment files, truncating torn records.
+static void _index_rebuild(dt_mipmap_store_t *store)
+{
+  dt_print(DT_DEBUG_CACHE, "[mipmap_store] rebuilding index of `%s'\n", store->path);
+  const double start = dt_get_wtime();
+
+  _index_reset(store, store->header->capacity);
+  dt_mipmap_store_header_t *h = store->header;
+
+  GList *segments = _list_segments(store);
+  for(GList *l = segments; l; l = g_list_next(l))
+  {
+    const uint32_t segment = GPOINTER_TO_UINT(l->data);
+    const int fd = _segment_fd(store, segment, FALSE);
+    if(fd < 0) continue;
+    struct stat st;
+    if(fstat(fd, &st)) continue;
+
+    uint64_t offset = 0;
+    while(offset + sizeof(dt_mipmap_store_record_t) <= (uint64_t)st.st_size)
+    {
+      dt_mipmap_store_record_t rec;
+      if(_pread_all(fd, &rec, sizeof(rec), offset)) break;
+      if((rec.magic != DT_MIPMAP_STORE_RECORD_MAGIC && rec.magic != DT_MIPMAP_STORE_TOMBSTONE_MAGIC)
+         || rec.header_checksum != _record_checksum(&rec)
+         || offset + _record_size(rec.length) > (uint64_t)st.st_size)
+        break;
+      _index_apply(store, &rec, segment, offset);
+      h = store->header;
+      offset += _record_size(rec.length);
+    }
+    if(offset < (uint64_t)st.st_size)
+    {
+      fprintf(stderr, "[mipmap_store] truncating damaged segment %" PRIu32 " at %" PRIu64 "\n", segment, offset);
+      if(ftruncate(fd, offset)) {}
+    }
+    h->segment = segment;
+    h->segment_end = offset;
+  }
+  g_list_free(segments);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_store] index rebuilt with %" PRIu32 " thumbnails in %.3f secs\n", h->live,
+           dt_get_wtime() - start);
+}
+
+dt_mipmap_store_t *dt_mipmap_store_open(const char *path)
+{
+  if(g_mkdir_with_parents(path, 0750)) return NULL;
+
+  dt_mipmap_store_t *store = (dt_mipmap_store_t *)calloc(1, sizeof(dt_mipmap_store_t));
+  g_strlcpy(store->path, path, sizeof(store->path));
+  store->segments = g_hash_table_new(NULL, NULL);
+  dt_pthread_mutex_init(&store->segments_lock, NULL);
+  dt_pthread_rwlock_init(&store->lock, NULL);
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s/index", path);
+
+  // find out the capacity of an existing index, if any
+  uint32_t capacity = DT_MIPMAP_STORE_INITIAL_SLOTS;
+  gboolean rebuild = TRUE;
+  dt_mipmap_store_header_t existing = { 0 };
+  const int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if(fd >= 0)
+  {
+    struct stat st;
+    if(!_pread_all(fd, &existing, sizeof(existing), 0) && !fstat(fd, &st)
+       && existing.magic == DT_MIPMAP_STORE_INDEX_MAGIC && existing.version == DT_MIPMAP_STORE_VERSION
+       && existing.capacity >= DT_MIPMAP_STORE_INITIAL_SLOTS && !(existing.capacity & (existing.capacity - 1))
+       && (uint64_t)st.st_size
+              == sizeof(dt_mipmap_store_header_t) + (uint64_t)existing.capacity * sizeof(dt_mipmap_store_slot_t))
+    {
+      capacity = existing.capacity;
+      rebuild = !existing.clean;
+    }
+    close(fd);
+  }
+
+  if(_index_map(store, filename, capacity, &store->index_fd, &store->index_size, &store->header))
+  {
+    fprintf(stderr, "[mipmap_store] failed to map index `%s'\n", filename);
+    g_hash_table_destroy(store->segments);
+    dt_pthread_mutex_destroy(&store->segments_lock);
+    dt_pthread_rwlock_destroy(&store->lock);
+    free(store);
+    return NULL;
+  }
+  store->slots = (dt_mipmap_store_slot_t *)(store->header + 1);
+
+  if(rebuild)
+  {
+    _index_reset(store, capacity);
+    _index_rebuild(store);
+  }
+
+  // until we close it orderly, the index must be considered stale
+  store->header->clean = 0;
+  msync(store->header, sizeof(dt_mipmap_store_header_t), MS_SYNC);
+
+  if(store->header->dead_bytes > DT_MIPMAP_STORE_COMPACT_MIN
+     && store->header->dead_bytes > store->header->live_bytes)
+    dt_mipmap_store_compact(store);
+
+  return store;
+}
+
+static void _close_fd(gpointer key, gpointer value, gpointer user_data)
+{
+  const int fd = GPOINTER_TO_INT(value) - 1;
+  if(fd >= 0)
+  {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+void dt_mipmap_store_close(dt_mipmap_store_t *store)
+{
+  if(!store) return;
+  dt_pthread_rwlock_wrlock(&store->lock);
+  // flush the segments before declaring the index trustworthy
+  g_hash_table_foreach(store->segments, _close_fd, NULL);
+  g_hash_table_destroy(store->segments);
+  store->header->clean = 1;
+  msync(store->header, store->index_size, MS_SYNC);
+  munmap(store->header, store->index_size);
+  close(store->index_fd);
+  dt_pthread_rwlock_unlock(&store->lock);
+
+  dt_pthread_mutex_destroy(&store->segments_lock);
+  dt_pthread_rwlock_destroy(&store->lock);
+  free(store);
+}
+
+gboolean dt_mipmap_store_contains(dt_mipmap_store_t *store, const uint32_t imgid, const int mip)
+{
+  if(!store) return FALSE;
+  dt_pthread_rwlock_rdlock(&store->lock);
+  const gboolean found
+      = _find_slot(store->slots, store->header->capacity, _store_key(imgid, mip), FALSE) != NULL;
+  dt_pthread_rwlock_unlock(&store->lock);
+  return found;
+}
+
+dt_mipmap_store_result_t dt_mipmap_store_read(dt_mipmap_store_t *store, const uint32_t imgid, const int mip,
+                                              const uint64_t hash, uint8_t **blob, size_t *length,
+                                              dt_mipmap_store_info_t *info)
+{
+  *blob = NULL;
+  *length = 0;
+  if(!store) return DT_MIPMAP_STORE_MISSING;
+
+  const uint32_t key = _store_key(imgid, mip);
+  dt_mipmap_store_result_t err = DT_MIPMAP_STORE_MISSING;
+  uint8_t *buf = NULL;
+
+  // segments can't go away while we hold the read lock
+  dt_pthread_rwlock_rdlock(&store->lock);
+  const dt_mipmap_store_slot_t *slot = _find_slot(store->slots, store->header->capacity, key, FALSE);
+  if(!slot)
+  {
+    __sync_fetch_and_add(&store->stats_misses, 1);
+    goto end;
+  }
+  if(slot->hash != hash)
+  {
+    __sync_fetch_and_add(&store->stats_stale, 1);
+    err = DT_MIPMAP_STORE_STALE;
+    goto end;
+  }
+
+  const int fd = _segment_fd(store, slot->segment, FALSE);
+  dt_mipmap_store_record_t rec;
+  if(fd < 0 || _pread_all(fd, &rec, sizeof(rec), slot->offset) || rec.magic != DT_MIPMAP_STORE_RECORD_MAGIC
+     || rec.key != key || rec.length != slot->length || rec.header_checksum != _record_checksum(&rec))
+    goto corrupt;
+
+  buf = g_try_malloc(rec.length);
+  if(!buf || _pread_all(fd, buf, rec.length, slot->offset + sizeof(rec)) || _checksum(buf, rec.length) != rec.checksum)
+    goto corrupt;
+
+  info->width = rec.width;
+  info->height = rec.height;
+  info->color_space = rec.color_space;
+  info->hash = rec.hash;
+  *blob = buf;
+  *length = rec.length;
+  buf = NULL;
+  err = DT_MIPMAP_STORE_OK;
+  __sync_fetch_and_add(&store->stats_hits, 1);
+  goto end;
+
+corrupt:
+  fprintf(stderr, "[mipmap_store] corrupt record for mip %d of image %" PRIu32 " in `%s'\n", mip, imgid,
+          store->path);
+  err = DT_MIPMAP_STORE_CORRUPT;
+
+end:
+  dt_pthread_rwlock_unlock(&store->lock);
+  g_free(buf);
+  // drop corrupt records so we regenerate the thumbnail
+  if(err == DT_MIPMAP_STORE_CORRUPT) dt_mipmap_store_remove(store, imgid, mip);
+  return err;
+}
+
+int dt_mipmap_store_write(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint8_t *blob,
+                          const size_t length, const dt_mipmap_store_info_t *info)
+{
+  if(!store || !blob || !length || length > UINT32_MAX) return 1;
+
+  dt_mipmap_store_record_t rec = { 0 };
+  rec.magic = DT_MIPMAP_STORE_RECORD_MAGIC;
+  rec.key = _store_key(imgid, mip);
+  rec.hash = info->hash;
+  rec.length = (uint32_t)length;
+  rec.width = info->width;
+  rec.height = info->height;
+  rec.color_space = info->color_space;
+  rec.checksum = _checksum(blob, length);
+
+  dt_pthread_rwlock_wrlock(&store->lock);
+  uint32_t segment = 0;
+  uint64_t offset = 0;
+  const int err = _append(store, &rec, blob, &segment, &offset);
+  if(!err) _index_apply(store, &rec, segment, offset);
+  dt_pthread_rwlock_unlock(&store->lock);
+
+  if(err)
+    fprintf(stderr, "[mipmap_store] failed to write mip %d of image %" PRIu32 " to `%s'\n", mip, imgid,
+            store->path);
+  else
+    __sync_fetch_and_add(&store->stats_writes, 1);
+  return err;
+}
+
+void dt_mipmap_store_remove(dt_mipmap_store_t *store, const uint32_t imgid, const int mip)
+{
+  if(!store) return;
+  const uint32_t key = _store_key(imgid, mip);
+
+  dt_pthread_rwlock_wrlock(&store->lock);
+  if(_find_slot(store->slots, store->header->capacity, key, FALSE))
+  {
+    dt_mipmap_store_record_t rec = { 0 };
+    rec.magic = DT_MIPMAP_STORE_TOMBSTONE_MAGIC;
+    rec.key = key;
+    rec.checksum = _checksum(NULL, 0);
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+    // even if the tombstone can't be written, forget about the record for this run
+    _append(store, &rec, NULL, &segment, &offset);
+    _index_apply(store, &rec, segment, offset);
+  }
+  dt_pthread_rwlock_unlock(&store->lock);
+}
+
+int dt_mipmap_store_compact(dt_mipmap_store_t *store)
+{
+  if(!store) return 1;
+
+  const double start = dt_get_wtime();
+  dt_pthread_rwlock_wrlock(&store->lock);
+  dt_mipmap_store_header_t *h = store->header;
+  const uint64_t reclaimed = h->dead_bytes;
+
+  // everything from now on goes to fresh segments, so a crash in between leaves
+  // both copies around and the rebuild picks the newer one.
+  _segment_close(store, h->segment);
+  const uint32_t first_new = h->segment + 1;
+  h->segment = first_new;
+  h->segment_end = 0;
+
+  uint8_t *buf = NULL;
+  size_t buf_size = 0;
+  for(uint32_t k = 0; k < h->capacity; k++)
+  {
+    dt_mipmap_store_slot_t *slot = store->slots + k;
+    if(slot->state != DT_MIPMAP_STORE_SLOT_LIVE || slot->segment >= first_new) continue;
+
+    const int fd = _segment_fd(store, slot->segment, FALSE);
+    dt_mipmap_store_record_t rec;
+    gboolean ok = fd >= 0 && !_pread_all(fd, &rec, sizeof(rec), slot->offset)
+                  && rec.magic == DT_MIPMAP_STORE_RECORD_MAGIC && rec.key == slot->key
+                  && rec.length == slot->length && rec.header_checksum == _record_checksum(&rec);
+    if(ok && rec.length > buf_size)
+    {
+      g_free(buf);
+      buf_size = rec.length;
+      buf = g_try_malloc(buf_size);
+      if(!buf) buf_size = 0;
+    }
+    ok = ok && buf && !_pread_all(fd, buf, rec.length, slot->offset + sizeof(rec))
+         && _checksum(buf, rec.length) == rec.checksum;
+
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+    if(ok && !_append(store, &rec, buf, &segment, &offset))
+    {
+      slot->segment = segment;
+      slot->offset = offset;
+    }
+    else
+    {
+      h->live--;
+      h->live_bytes -= _record_size(slot->length);
+      slot->state = DT_MIPMAP_STORE_SLOT_DELETED;
+    }
+  }
+  g_free(buf);
+
+  // make sure the copies hit the disk before the originals go away
+  const int fd = _segment_fd(store, h->segment, TRUE);
+  if(fd >= 0) fsync(fd);
+  msync(h, store->index_size, MS_SYNC);
+
+  // remove old segments in ascending order, so records are always gone before their tombstones
+  GList *segments = _list_segments(store);
+  for(GList *l = segments; l; l = g_list_next(l))
+  {
+    const uint32_t segment = GPOINTER_TO_UINT(l->data);
+    if(segment >= first_new) continue;
+    char filename[PATH_MAX] = { 0 };
+    _segment_filename(store, segment, filename, sizeof(filename));
+    _segment_close(store, segment);
+    g_unlink(filename);
+  }
+  g_list_free(segments);
+  h->dead_bytes = 0;
+
+  dt_pthread_rwlock_unlock(&store->lock);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_store] compacted `%s', reclaimed %.2f MB in %.3f secs\n", store->path,
+           reclaimed / (1024.0 * 1024.0), dt_get_wtime() - start);
+  return 0;
+}
+
+void dt_mipmap_store_print(dt_mipmap_store_t *store)
+{
+  if(!store) return;
+  dt_pthread_rwlock_rdlock(&store->lock);
+  const dt_mipmap_store_header_t *h = store->header;
+  printf("[mipmap_store] %" PRIu32 " thumbnails, index fill %.2f%%, %.2f MB live, %.2f MB garbage, %" PRIu32
+         " segments\n",
+         h->live, 100.0f * (float)h->used / (float)h->capacity, h->live_bytes / (1024.0 * 1024.0),
+         h->dead_bytes / (1024.0 * 1024.0), g_hash_table_size(store->segments));
+  dt_pthread_rwlock_unlock(&store->lock);
+  printf("[mipmap_store] hits %ld | misses %ld | stale %ld | writes %ld\n", store->stats_hits,
+         store->stats_misses, store->stats_stale, store->stats_writes);
+}
+
+#else // _WIN32
+
+// no mmap on windows, the one-file-per-thumbnail backend is used there.
+
+dt_mipmap_store_t *dt_mipmap_store_open(const char *path)
+{
+  return NULL;
+}
+
+void dt_mipmap_store_close(dt_mipmap_store_t *store)
+{
+}
+
+gboolean dt_mipmap_store_contains(dt_mipmap_store_t *store, const uint32_t imgid, const int mip)
+{
+  return FALSE;
+}
+
+int dt_mipmap_store_read(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint64_t hash,
+                         uint8_t **blob, size_t *length, dt_mipmap_store_info_t *info)
+{
+  *blob = NULL;
+  *length = 0;
+  return 1;
+}
+
+int dt_mipmap_store_write(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint8_t *blob,
+                          const size_t length, const dt_mipmap_store_info_t *info)
+{
+  return 1;
+}
+
+void dt_mipmap_store_remove(dt_mipmap_store_t *store, const uint32_t imgid, const int mip)
+{
+}
+
+int dt_mipmap_store_compact(dt_mipmap_store_t *store)
+{
+  return 1;
+}
+
+void dt_mipmap_store_print(dt_mipmap_store_t *store)
+{
+}
+
+#endif // _WIN32
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
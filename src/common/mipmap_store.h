@@ -0,0 +1,88 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+// packed on-disk storage for compressed thumbnails.
+//
+// instead of one jpg file per (image, mip) pair, thumbnails are appended to a
+// small number of large segment files. an mmap'ed open addressing hash table
+// maps (imgid, mip) to the location of the latest record, together with the
+// history hash the thumbnail was created from.
+//
+// segments are the only source of truth: every record carries its own key and
+// a checksum, removals are appended as tombstones. if darktable was not shut
+// down cleanly the index is rebuilt from the segments on the next start, and a
+// torn record at the tail of a segment is truncated away.
+
+typedef struct dt_mipmap_store_t dt_mipmap_store_t;
+
+// per thumbnail metadata stored next to the compressed payload
+typedef struct dt_mipmap_store_info_t
+{
+  uint32_t width;
+  uint32_t height;
+  int32_t color_space;
+  uint64_t hash;
+} dt_mipmap_store_info_t;
+
+// results of dt_mipmap_store_read()
+typedef enum dt_mipmap_store_result_t
+{
+  DT_MIPMAP_STORE_OK = 0,
+  DT_MIPMAP_STORE_MISSING = 1,
+  DT_MIPMAP_STORE_STALE = 2,   // made from another history than `hash'
+  DT_MIPMAP_STORE_CORRUPT = 3, // the record is dropped already
+} dt_mipmap_store_result_t;
+
+// open (and create if needed) the store living in directory `path'.
+// returns NULL if the store can't be used (e.g. on platforms without mmap).
+dt_mipmap_store_t *dt_mipmap_store_open(const char *path);
+// sync the index and close all files.
+void dt_mipmap_store_close(dt_mipmap_store_t *store);
+
+// single index probe, no disk access. returns TRUE if a thumbnail is stored.
+gboolean dt_mipmap_store_contains(dt_mipmap_store_t *store, const uint32_t imgid, const int mip);
+
+// read a stored thumbnail. on success *blob is allocated with g_malloc and has
+// to be freed by the caller.
+dt_mipmap_store_result_t dt_mipmap_store_read(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint64_t hash,
+                         uint8_t **blob, size_t *length, dt_mipmap_store_info_t *info);
+
+// append a thumbnail, replacing any older version for this (imgid, mip).
+// returns 0 on success.
+int dt_mipmap_store_write(dt_mipmap_store_t *store, const uint32_t imgid, const int mip, const uint8_t *blob,
+                          const size_t length, const dt_mipmap_store_info_t *info);
+
+// forget about a thumbnail. a tombstone is appended so that the removal survives index rebuilds.
+void dt_mipmap_store_remove(dt_mipmap_store_t *store, const uint32_t imgid, const int mip);
+
+// rewrite all live records into fresh segments and drop the old ones.
+// returns 0 on success.
+int dt_mipmap_store_compact(dt_mipmap_store_t *store);
+
+// print fill and fragmentation statistics
+void dt_mipmap_store_print(dt_mipmap_store_t *store);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
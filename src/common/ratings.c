@@ -89,12 +89,14 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 {
   if(type == DT_UNDO_RATINGS)
   {
+    dt_image_cache_write_batch_begin(darktable.image_cache);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_ratings_t *ratings = (dt_undo_ratings_t *)list->data;
       _ratings_apply_to_image(ratings->imgid, (action == DT_ACTION_UNDO) ? ratings->before : ratings->after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(ratings->imgid));
     }
+    dt_image_cache_write_batch_end(darktable.image_cache);
     dt_collection_hint_message(darktable.collection);
   }
 }
@@ -107,6 +109,7 @@ static void _ratings_undo_data_free(gpointer data)
 
 static void _ratings_apply(const GList *imgs, const int rating, GList **undo, const gboolean undo_on)
 {
+  dt_image_cache_write_batch_begin(darktable.image_cache);
   for(const GList *images = imgs; images; images = g_list_next(images))
   {
     const int image_id = GPOINTER_TO_INT(images->data);
@@ -121,6 +124,7 @@ static void _ratings_apply(const GList *imgs, const int rating, GList **undo, co
 
     _ratings_apply_to_image(image_id, rating);
   }
+  dt_image_cache_write_batch_end(darktable.image_cache);
 }
 
 void dt_ratings_apply_on_list(const GList *img, const int rating, const gboolean undo_on)
@@ -0,0 +1,183 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/trace.h"
+#include "common/dtpthread.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ring size if tracing was requested on the command line but `trace_events' is not set
+#define DT_TRACE_DEFAULT_EVENTS 65536
+
+typedef struct dt_trace_event_t
+{
+  char name[32];
+  const char *category;
+  double start; // seconds since darktable started
+  double wall;  // seconds
+  double cpu;   // seconds of process cpu time, as for `-d perf'
+  size_t bytes;
+  int32_t imgid;
+  int32_t tid;
+  uint32_t flags;
+} dt_trace_event_t;
+
+typedef struct dt_trace_t
+{
+  dt_pthread_mutex_t lock;
+  dt_trace_event_t *events;
+  size_t size;    // capacity of the ring
+  uint64_t count; // events recorded so far, the ring keeps the last `size' of them
+  gchar *filename;
+} dt_trace_t;
+
+static dt_trace_t _trace = { 0 };
+
+// small per thread number, so the trace viewer shows one row per thread
+static gint _trace_threads = 0;
+static __thread int32_t _trace_tid = -1;
+
+void dt_trace_init(const char *filename)
+{
+  size_t size = MAX(dt_conf_get_int("trace_events"), 0);
+  if(filename && size == 0) size = DT_TRACE_DEFAULT_EVENTS;
+  if(size == 0) return;
+
+  _trace.events = (dt_trace_event_t *)calloc(size, sizeof(dt_trace_event_t));
+  if(!_trace.events)
+  {
+    fprintf(stderr, "[trace] can't allocate %zu events\n", size);
+    return;
+  }
+  dt_pthread_mutex_init(&_trace.lock, NULL);
+  _trace.size = size;
+  _trace.count = 0;
+  if(filename)
+    _trace.filename = g_strdup(filename);
+  else
+  {
+    char cachedir[PATH_MAX] = { 0 };
+    dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+    _trace.filename = g_build_filename(cachedir, "darktable-trace.json", NULL);
+  }
+  darktable.trace_enabled = TRUE;
+}
+
+void dt_trace_cleanup()
+{
+  if(!_trace.events) return;
+
+  if(!dt_trace_write(_trace.filename))
+    fprintf(stderr, "[trace] wrote %" PRIu64 " events to `%s'\n", MIN(_trace.count, (uint64_t)_trace.size),
+            _trace.filename);
+  g_free(_trace.filename);
+  _trace.filename = NULL;
+
+  darktable.trace_enabled = FALSE;
+  dt_pthread_mutex_destroy(&_trace.lock);
+  free(_trace.events);
+  _trace.events = NULL;
+}
+
+void dt_trace_event(const char *category, const char *name, const int32_t imgid, const dt_times_t *start,
+                    const size_t bytes, const uint32_t flags)
+{
+  if(!darktable.trace_enabled) return;
+
+  dt_times_t end;
+  dt_get_times(&end);
+
+  if(_trace_tid < 0) _trace_tid = g_atomic_int_add(&_trace_threads, 1);
+
+  dt_pthread_mutex_lock(&_trace.lock);
+  dt_trace_event_t *ev = _trace.events + (_trace.count++ % _trace.size);
+  g_strlcpy(ev->name, name, sizeof(ev->name));
+  ev->category = category;
+  ev->start = start->clock - darktable.start_wtime;
+  ev->wall = end.clock - start->clock;
+  ev->cpu = end.user - start->user;
+  ev->bytes = bytes;
+  ev->imgid = imgid;
+  ev->tid = _trace_tid;
+  ev->flags = flags;
+  dt_pthread_mutex_unlock(&_trace.lock);
+}
+
+int dt_trace_write(const char *filename)
+{
+  if(!_trace.events) return 1;
+
+  // copy the ring so recording can go on while we write
+  dt_pthread_mutex_lock(&_trace.lock);
+  const size_t num = MIN(_trace.count, (uint64_t)_trace.size);
+  const size_t first = _trace.count - num;
+  dt_trace_event_t *events = (dt_trace_event_t *)malloc(sizeof(dt_trace_event_t) * MAX(num, 1));
+  for(size_t k = 0; k < num; k++) events[k] = _trace.events[(first + k) % _trace.size];
+  dt_pthread_mutex_unlock(&_trace.lock);
+
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    fprintf(stderr, "[trace] can't write `%s'\n", filename);
+    free(events);
+    return 1;
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"version\":\"%s\"},\"traceEvents\":[\n",
+          darktable_package_version);
+  for(size_t k = 0; k < num; k++)
+  {
+    const dt_trace_event_t *ev = events + k;
+    // names are module operations or fixed strings, but don't rely on that for valid json
+    char name[2 * sizeof(ev->name)];
+    size_t n = 0;
+    for(const char *c = ev->name; *c; c++)
+    {
+      if(*c == '"' || *c == '\\') name[n++] = '\\';
+      name[n++] = (*c >= ' ') ? *c : '?';
+    }
+    name[n] = '\0';
+
+    fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,"
+               "\"args\":{\"imgid\":%d,\"cpu_ms\":%.3f,\"bytes\":%zu",
+            k ? ",\n" : "", name, ev->category, ev->tid, 1e6 * ev->start, 1e6 * ev->wall, ev->imgid,
+            1e3 * ev->cpu, ev->bytes);
+    if(ev->flags & (DT_TRACE_CACHE_HIT | DT_TRACE_CACHE_MISS | DT_TRACE_DISK_CACHE_HIT))
+      fprintf(f, ",\"cache\":\"%s\"",
+              ev->flags & DT_TRACE_CACHE_HIT ? "hit" : ev->flags & DT_TRACE_DISK_CACHE_HIT ? "disk" : "miss");
+    if(ev->flags & (DT_TRACE_CACHE_MISS | DT_TRACE_OPENCL))
+      fprintf(f, ",\"device\":\"%s\"", ev->flags & DT_TRACE_OPENCL ? "gpu" : "cpu");
+    if(ev->flags & DT_TRACE_TILING) fprintf(f, ",\"tiling\":true");
+    if(ev->flags & DT_TRACE_OPENCL_FALLBACK) fprintf(f, ",\"opencl_fallback\":true");
+    if(ev->flags & DT_TRACE_FUSED) fprintf(f, ",\"fused\":true");
+    fprintf(f, "}}");
+  }
+  fprintf(f, "\n]}\n");
+  free(events);
+
+  return fclose(f) != 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
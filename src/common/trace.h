@@ -0,0 +1,67 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+#include <glib.h>
+#include <inttypes.h>
+
+// runtime profiling of pixelpipe runs and exports.
+//
+// unlike `-d perf', which prints as it goes, timed events are kept in a fixed
+// size ring buffer and can be dumped as chrome trace json (chrome://tracing,
+// perfetto) at any time. recording is off unless darktable was started with
+// `--trace <file>' or `trace_events' is set, so release builds can be profiled
+// without rebuilding.
+
+typedef enum dt_trace_flags_t
+{
+  DT_TRACE_NONE            = 0,
+  DT_TRACE_CACHE_HIT       = 1 << 0, // output found in the pixelpipe cache
+  DT_TRACE_CACHE_MISS      = 1 << 1, // output had to be computed
+  DT_TRACE_DISK_CACHE_HIT  = 1 << 2, // output read from the disk cache
+  DT_TRACE_TILING          = 1 << 3, // processed in tiles
+  DT_TRACE_OPENCL          = 1 << 4, // processed on the gpu
+  DT_TRACE_OPENCL_FALLBACK = 1 << 5, // gpu processing failed, redone on the cpu
+  DT_TRACE_FUSED           = 1 << 6  // run of pointwise modules processed in one pass
+} dt_trace_flags_t;
+
+// set up the ring buffer from `trace_events'. if `filename' is not NULL,
+// recording is switched on and the trace is written there by dt_trace_cleanup().
+void dt_trace_init(const char *filename);
+void dt_trace_cleanup();
+
+// TRUE if events are recorded. check this before gathering data for dt_trace_event().
+static inline gboolean dt_trace_enabled()
+{
+  return darktable.trace_enabled;
+}
+
+// record an event that started at `start' and ends now. `category' has to be a
+// static string, `name' is copied. `bytes' is the memory the event allocated.
+void dt_trace_event(const char *category, const char *name, const int32_t imgid, const dt_times_t *start,
+                    const size_t bytes, const uint32_t flags);
+
+// write all recorded events as chrome trace json. returns 0 on success.
+int dt_trace_write(const char *filename);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
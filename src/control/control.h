@@ -203,14 +203,16 @@ typedef struct dt_control_t
   // job management
   int32_t running;
   gboolean export_scheduled;
-  dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
+  dt_pthread_mutex_t dedup_mutex, cond_mutex, run_mutex;
   pthread_cond_t cond;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
-  dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  // one set of queues per worker, idle workers steal from the others
+  struct dt_control_worker_queue_t *worker_queues;
+  uint32_t next_queue;
+  // queued and running DT_JOB_QUEUE_SYSTEM_FG jobs, for deduping
+  GHashTable *dedup;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
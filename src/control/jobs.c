@@ -51,9 +51,26 @@ typedef struct _dt_job_t
 
   dt_progress_t *progress;
 
+  // position in the worker queue holding the job. owner is -1 once it got picked.
+  GList *link;
+  int32_t owner;
+  // dedup hash, taken when the job is added. params may change while it runs.
+  guint hash;
+
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
+/* every worker has its own set of queues. jobs added by a worker go to its own
+   queues, the others are spread round robin. a worker without anything to do
+   steals from the others, so the lock of a queue set is only ever contended by
+   its owner, one thief and whoever adds a job to it.
+*/
+typedef struct dt_control_worker_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  GQueue queues[DT_JOB_QUEUE_MAX];
+} dt_control_worker_queue_t;
+
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
@@ -63,11 +80,35 @@ typedef struct _dt_job_t
 static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
 {
   if(!j1 || !j2) return 0;
-  if(j1->params_size != 0 && j1->params_size == j2->params_size)
-    return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb
-            && j1->queue == j2->queue && (memcmp(j1->params, j2->params, j1->params_size) == 0));
-  return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb && j1->queue == j2->queue
-          && (g_strcmp0(j1->description, j2->description) == 0));
+  // same rules as dt_control_job_compute_hash(): params if there are any, the description otherwise
+  if(j1->execute != j2->execute || j1->state_changed_cb != j2->state_changed_cb || j1->queue != j2->queue
+     || j1->params_size != j2->params_size)
+    return 0;
+  if(j1->params_size != 0) return memcmp(j1->params, j2->params, j1->params_size) == 0;
+  return g_strcmp0(j1->description, j2->description) == 0;
+}
+
+static guint dt_control_job_compute_hash(const _dt_job_t *job)
+{
+  guint hash = g_direct_hash((gconstpointer)(uintptr_t)job->execute) ^ (guint)job->queue;
+  if(job->params_size != 0)
+  {
+    const uint8_t *p = (const uint8_t *)job->params;
+    for(size_t k = 0; k < job->params_size; k++) hash = hash * 33 + p[k];
+  }
+  else
+    hash = hash * 33 + g_str_hash(job->description);
+  return hash;
+}
+
+static guint dt_control_job_hash(gconstpointer key)
+{
+  return ((const _dt_job_t *)key)->hash;
+}
+
+static gboolean dt_control_job_hash_equal(gconstpointer a, gconstpointer b)
+{
+  return a == b || dt_control_job_equal((_dt_job_t *)a, (_dt_job_t *)b);
 }
 
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
@@ -129,6 +170,7 @@ dt_job_t *dt_control_job_create(dt_job_execute_callback execute, const char *msg
 
   job->execute = execute;
   job->state = DT_JOB_STATE_INITIALIZED;
+  job->owner = -1;
 
   dt_pthread_mutex_init(&job->state_mutex, NULL);
   dt_pthread_mutex_init(&job->wait_mutex, NULL);
@@ -224,7 +266,7 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
-static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+static _dt_job_t *dt_control_schedule_job_from(dt_control_t *control, dt_control_worker_queue_t *wq)
 {
   /*
    * job scheduling works like this:
@@ -237,17 +279,21 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
    * - the jobs that didn't get picked this round get their priority incremented
    */
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
+  dt_pthread_mutex_lock(&wq->mutex);
 
-  // find the job
+  gboolean skip_export = control->export_scheduled;
   _dt_job_t *job = NULL;
   int winner_queue = DT_JOB_QUEUE_MAX;
+find_job:
+  // find the job
+  job = NULL;
+  winner_queue = DT_JOB_QUEUE_MAX;
   int max_priority = -1;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
+    if(g_queue_is_empty(&wq->queues[i])) continue;
+    if(skip_export && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    _dt_job_t *_job = (_dt_job_t *)g_queue_peek_head(&wq->queues[i]);
     if(_job->priority > max_priority)
     {
       max_priority = _job->priority;
@@ -256,37 +302,104 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
     }
   }
 
+  // only one export job may run at a time, claim that slot. if another worker was faster we look again.
+  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT
+     && !__sync_bool_compare_and_swap(&control->export_scheduled, FALSE, TRUE))
+  {
+    skip_export = TRUE;
+    goto find_job;
+  }
+
   if(!job)
   {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
+    dt_pthread_mutex_unlock(&wq->mutex);
     return NULL;
   }
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
+  // the order of the queues matches our priority, and we only update job when the priority
   // is strictly bigger
   // invariant -> job is the one we are looking for
 
   // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
-
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
+  g_queue_unlink(&wq->queues[winner_queue], job->link);
+  g_list_free_1(job->link);
+  job->link = NULL;
+  job->owner = -1;
 
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    if(i == winner_queue || g_queue_is_empty(&wq->queues[i])) continue;
+    ((_dt_job_t *)g_queue_peek_head(&wq->queues[i]))->priority++;
   }
 
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  dt_pthread_mutex_unlock(&wq->mutex);
 
   return job;
 }
 
+// rank the best queue head of a worker the way dt_control_schedule_job_from() picks it.
+// returns -1 if there is nothing to take.
+static int dt_control_worker_queue_rank(dt_control_t *control, dt_control_worker_queue_t *wq)
+{
+  const gboolean skip_export = control->export_scheduled;
+  int rank = -1;
+  dt_pthread_mutex_lock(&wq->mutex);
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(g_queue_is_empty(&wq->queues[i])) continue;
+    if(skip_export && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    const _dt_job_t *_job = (const _dt_job_t *)g_queue_peek_head(&wq->queues[i]);
+    // higher priority wins, on a tie the earlier queue
+    const int r = _job->priority * DT_JOB_QUEUE_MAX + (DT_JOB_QUEUE_MAX - 1 - i);
+    if(r > rank) rank = r;
+  }
+  dt_pthread_mutex_unlock(&wq->mutex);
+  return rank;
+}
+
+static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+{
+  // take the best queue head of all workers, so an idle worker doesn't run its own background job
+  // while a user job waits with somebody else. on a tie our own queues win.
+  const int32_t self = dt_control_get_threadid();
+  int best = -1, best_rank = -1;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    const int32_t victim = (self + k) % control->num_threads;
+    const int rank = dt_control_worker_queue_rank(control, &control->worker_queues[victim]);
+    if(rank > best_rank)
+    {
+      best_rank = rank;
+      best = victim;
+    }
+  }
+  if(best < 0) return NULL;
+
+  _dt_job_t *job = dt_control_schedule_job_from(control, &control->worker_queues[best]);
+  if(job)
+  {
+    if(best != self)
+      dt_print(DT_DEBUG_CONTROL, "[schedule_job] worker %d stole from worker %d\n", self, best);
+    return job;
+  }
+
+  // somebody else was faster, take whatever is left, own queues first
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    const int32_t victim = (self + k) % control->num_threads;
+    if(victim == best) continue;
+    job = dt_control_schedule_job_from(control, &control->worker_queues[victim]);
+    if(job)
+    {
+      if(victim != self)
+        dt_print(DT_DEBUG_CONTROL, "[schedule_job] worker %d stole from worker %d\n", self, victim);
+      return job;
+    }
+  }
+  return NULL;
+}
+
 static void dt_control_job_execute(_dt_job_t *job)
 {
   dt_print(DT_DEBUG_CONTROL, "[run_job+] %02d %f ", DT_CTL_WORKER_RESERVED + dt_control_get_threadid(),
@@ -320,11 +433,15 @@ static int32_t dt_control_run_job(dt_control_t *control)
 
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
-  // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // remove the job from the scheduled jobs (for job deduping)
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    dt_pthread_mutex_lock(&control->dedup_mutex);
+    g_hash_table_remove(control->dedup, job);
+    dt_pthread_mutex_unlock(&control->dedup_mutex);
+  }
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT)
+    __sync_bool_compare_and_swap(&control->export_scheduled, TRUE, FALSE);
 
   // and free it
   dt_control_job_dispose(job);
@@ -388,14 +505,14 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
   job->queue = queue_id;
 
-  _dt_job_t *job_for_disposal = NULL;
+  _dt_job_t *job_dropped = NULL;
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
+  // jobs added by a worker stay with it, the others are spread over all workers
+  int32_t w = dt_control_get_threadid();
+  if(w >= control->num_threads) w = __sync_fetch_and_add(&control->next_queue, 1) % control->num_threads;
+  dt_control_worker_queue_t *wq = &control->worker_queues[w];
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
-
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %d | ", w);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -403,61 +520,63 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   {
     // this is a stack with limited size and bubble up and all that stuff
     job->priority = DT_CONTROL_FG_PRIORITY;
+    job->hash = dt_control_job_compute_hash(job);
 
-    // check if we have already scheduled the job
-    for(int k = 0; k < control->num_threads; k++)
+    dt_pthread_mutex_lock(&control->dedup_mutex);
+    _dt_job_t *other_job = (_dt_job_t *)g_hash_table_lookup(control->dedup, job);
+    if(other_job)
     {
-      _dt_job_t *other_job = (_dt_job_t *)control->job[k];
-      if(dt_control_job_equal(job, other_job))
+      // if the job is still queued -> move it to the top of its stack, else it's already scheduled
+      const int32_t owner = other_job->owner;
+      if(owner >= 0)
       {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        dt_pthread_mutex_unlock(&control->queue_mutex);
-
-        dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
-        dt_control_job_dispose(job);
-
-        return 0; // there can't be any further copy
+        dt_control_worker_queue_t *owq = &control->worker_queues[owner];
+        dt_pthread_mutex_lock(&owq->mutex);
+        if(other_job->owner == owner)
+        {
+          dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+          dt_control_job_print(other_job);
+          dt_print(DT_DEBUG_CONTROL, "\n");
+          g_queue_unlink(&owq->queues[queue_id], other_job->link);
+          g_queue_push_head_link(&owq->queues[queue_id], other_job->link);
+        }
+        dt_pthread_mutex_unlock(&owq->mutex);
       }
-    }
-
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
-    {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
+      else
       {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
         dt_control_job_print(other_job);
         dt_print(DT_DEBUG_CONTROL, "\n");
+      }
+      dt_pthread_mutex_unlock(&control->dedup_mutex);
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
-
-        job_for_disposal = job;
+      dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(job);
 
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      return 0; // there can't be any further copy
     }
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    // now we can add the new job to the stack
+    g_hash_table_add(control->dedup, job);
+    dt_pthread_mutex_lock(&wq->mutex);
+    job->link = g_list_alloc();
+    job->link->data = job;
+    job->owner = w;
+    g_queue_push_head_link(&wq->queues[queue_id], job->link);
 
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    // and take care of the maximal queue size, shared by all workers
+    if(wq->queues[queue_id].length > (DT_CONTROL_MAX_JOBS + control->num_threads - 1) / control->num_threads)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      GList *last = g_queue_pop_tail_link(&wq->queues[queue_id]);
+      job_dropped = (_dt_job_t *)last->data;
+      g_list_free_1(last);
+      job_dropped->link = NULL;
+      job_dropped->owner = -1;
+      g_hash_table_remove(control->dedup, job_dropped);
     }
-
-    control->queue_length[queue_id] = length;
+    dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    dt_pthread_mutex_unlock(&wq->mutex);
+    dt_pthread_mutex_unlock(&control->dedup_mutex);
   }
   else
   {
@@ -468,11 +587,14 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    dt_pthread_mutex_lock(&wq->mutex);
+    job->link = g_list_alloc();
+    job->link->data = job;
+    job->owner = w;
+    g_queue_push_tail_link(&wq->queues[queue_id], job->link);
+    dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    dt_pthread_mutex_unlock(&wq->mutex);
   }
-  dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // notify workers
   dt_pthread_mutex_lock(&control->cond_mutex);
@@ -480,8 +602,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
   // dispose of dropped job, if any
-  dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
-  dt_control_job_dispose(job_for_disposal);
+  dt_control_job_set_state(job_dropped, DT_JOB_STATE_DISCARDED);
+  dt_control_job_dispose(job_dropped);
 
   return 0;
 }
@@ -607,7 +729,15 @@ void dt_control_jobs_init(dt_control_t *control)
   // start threads
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
-  control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->worker_queues
+      = (dt_control_worker_queue_t *)calloc(control->num_threads, sizeof(dt_control_worker_queue_t));
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&control->worker_queues[k].mutex, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_init(&control->worker_queues[k].queues[i]);
+  }
+  control->next_queue = 0;
+  control->dedup = g_hash_table_new(dt_control_job_hash, dt_control_job_hash_equal);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -641,7 +771,13 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
-  free(control->job);
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_clear(&control->worker_queues[k].queues[i]);
+    dt_pthread_mutex_destroy(&control->worker_queues[k].mutex);
+  }
+  free(control->worker_queues);
+  g_hash_table_destroy(control->dedup);
   free(control->thread);
 }
 
@@ -35,6 +35,7 @@
 #include "common/import_session.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 
 #include "gui/gtk.h"
 
@@ -60,6 +61,15 @@
 // overall time for a large import.
 #define PROGRESS_UPDATE_INTERVAL 0.5
 
+// images whose metadata is parsed at the same time when refreshing exif
+#define DT_CONTROL_EXIF_BATCH 64
+// files imported in place per database transaction, their headers are read in parallel
+#define DT_CONTROL_IMPORT_BATCH 256
+// the files of an import batch are committed in chunks of at most this many images or seconds, the
+// transaction lock keeps the gui waiting to write a rating meanwhile
+#define DT_CONTROL_IMPORT_CHUNK 32
+#define DT_CONTROL_IMPORT_CHUNK_SECONDS 0.2
+
 typedef struct dt_control_datetime_t
 {
   long int offset;
@@ -997,6 +1007,9 @@ static int32_t dt_control_delete_images_job_run(dt_job_t *job)
 
   sqlite3_stmt *stmt;
 
+  // sidecars still being written in the background would come back after we deleted them
+  dt_image_cache_flush(darktable.image_cache);
+
   dt_collection_update(darktable.collection);
 
   // We need a list of files to regenerate .xmp files if there are duplicates
@@ -1277,34 +1290,59 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
   char message[512] = { 0 };
   snprintf(message, sizeof(message), ngettext("refreshing info for %d image", "refreshing info for %d images", total), total);
   dt_control_job_set_progress_message(job, message);
+
+  // the files are parsed in parallel, a chunk at a time. applying the metadata writes to the
+  // database, which is done here in one transaction per chunk.
+  int imgids[DT_CONTROL_EXIF_BATCH];
+  char *paths[DT_CONTROL_EXIF_BATCH];
+  dt_exif_parsed_t *parsed[DT_CONTROL_EXIF_BATCH];
   while(t)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    if(imgid >= 0)
+    int count = 0;
+    for(; t && count < DT_CONTROL_EXIF_BATCH; t = g_list_next(t))
     {
+      const int imgid = GPOINTER_TO_INT(t->data);
+      if(imgid < 0)
+      {
+        fprintf(stderr,"[dt_control_refresh_exif_run] illegal imgid %i\n", imgid);
+        continue;
+      }
       gboolean from_cache = TRUE;
       char sourcefile[PATH_MAX];
       dt_image_full_path(imgid, sourcefile, sizeof(sourcefile), &from_cache);
+      imgids[count] = imgid;
+      paths[count] = g_strdup(sourcefile);
+      count++;
+    }
 
-      dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
+    dt_exif_parse_batch((const char *const *)paths, count, parsed);
+
+    const gboolean transaction = dt_database_start_transaction(darktable.db);
+    dt_image_cache_write_batch_begin(darktable.image_cache);
+    for(int k = 0; k < count; k++)
+    {
+      dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgids[k], 'w');
       if(img)
       {
         const uint32_t flags = img->flags;
-        dt_exif_read(img, sourcefile);
+        dt_exif_read_parsed(img, paths[k], parsed[k]);
         if(dt_conf_get_bool("ui_last/ignore_exif_rating"))
           img->flags = flags;
         dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
       }
       else
-        fprintf(stderr,"[dt_control_refresh_exif_run] couldn't dt_image_cache_get for imgid %i\n", imgid);
+        fprintf(stderr,"[dt_control_refresh_exif_run] couldn't dt_image_cache_get for imgid %i\n", imgids[k]);
 
-      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
+      dt_exif_parsed_free(parsed[k]);
+      g_free(paths[k]);
     }
-    else
-      fprintf(stderr,"[dt_control_refresh_exif_run] illegal imgid %i\n", imgid);
+    // the rows of the batch go into the same transaction
+    dt_image_cache_write_batch_end(darktable.image_cache);
+    if(transaction) dt_database_release_transaction(darktable.db);
 
-    t = g_list_next(t);
-    fraction += 1.0 / total;
+    if(count) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
+
+    fraction += (double)count / total;
     dt_control_job_set_progress(job, fraction);
   }
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
@@ -1315,6 +1353,166 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+// state shared by all threads of one export job
+typedef struct dt_control_export_worker_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_data_t *fdata; // template, the job thread exports with this one
+  dt_export_metadata_t *metadata;
+  dt_imageio_export_writer_t *writer; // encode and write stage, NULL if store() has to write itself
+  int *images;
+  gboolean *done;
+  guint total;
+  guint next;     // next image to hand out
+  guint reported; // images finished in list order, drives the progress bar
+  guint tagid, etagid;
+  gboolean tag_change;
+  int openmp_threads;
+  dt_pthread_mutex_t lock;
+} dt_control_export_worker_t;
+
+typedef struct dt_control_export_thread_t
+{
+  dt_control_export_worker_t *w;
+  dt_imageio_module_data_t *fdata;
+  pthread_t thread;
+} dt_control_export_thread_t;
+
+static void _export_images(dt_control_export_worker_t *w, dt_imageio_module_data_t *fdata)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(w->openmp_threads);
+#endif
+  dt_imageio_export_writer_bind(w->writer);
+  dt_control_export_t *settings = w->settings;
+
+  while(dt_control_job_get_state(w->job) != DT_JOB_STATE_CANCELLED)
+  {
+    dt_pthread_mutex_lock(&w->lock);
+    if(w->next >= w->total)
+    {
+      dt_pthread_mutex_unlock(&w->lock);
+      break;
+    }
+    const guint idx = w->next++;
+    const int imgid = w->images[idx];
+
+    // remove 'changed' tag from image
+    if(dt_tag_detach(w->tagid, imgid, FALSE, FALSE)) w->tag_change = TRUE;
+    // make sure the 'exported' tag is set on the image
+    if(dt_tag_attach(w->etagid, imgid, FALSE, FALSE)) w->tag_change = TRUE;
+
+    /* register export timestamp in cache */
+    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+
+    // decode the next image in the background while this one is processed
+    if(w->next < w->total)
+      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, w->images[w->next], DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    dt_pthread_mutex_unlock(&w->lock);
+
+    const guint num = idx + 1;
+
+    // check if image still exists:
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+    if(image)
+    {
+      char imgfilename[PATH_MAX] = { 0 };
+      gboolean from_cache = TRUE;
+      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+      {
+        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+        // dt_image_remove(imgid);
+        dt_image_cache_read_release(darktable.image_cache, image);
+      }
+      else
+      {
+        dt_image_cache_read_release(darktable.image_cache, image);
+        if(w->mstorage->store(w->mstorage, w->sdata, imgid, w->mformat, fdata, num, w->total,
+                              settings->high_quality, settings->upscale, settings->export_masks,
+                              settings->icc_type, settings->icc_filename, settings->icc_intent, w->metadata)
+           != 0)
+          dt_control_job_cancel(w->job);
+      }
+    }
+    // the writer stage reports failures late, stop as soon as we know about one
+    if(dt_imageio_export_writer_failed(w->writer)) dt_control_job_cancel(w->job);
+
+    // images may finish out of order when exporting in parallel. only report
+    // the leading run of finished images so that progress is monotonic and
+    // the same as for a sequential export.
+    dt_pthread_mutex_lock(&w->lock);
+    w->done[idx] = TRUE;
+    const guint before = w->reported;
+    while(w->reported < w->total && w->done[w->reported]) w->reported++;
+    if(w->reported != before)
+    {
+      char message[512] = { 0 };
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s"), MIN(w->reported + 1, w->total), w->total,
+               w->mstorage->name(w->mstorage));
+      dt_control_job_set_progress_message(w->job, message);
+      dt_control_job_set_progress(w->job, MIN(1.0, (double)w->reported / w->total));
+    }
+    dt_pthread_mutex_unlock(&w->lock);
+  }
+  dt_imageio_export_writer_bind(NULL);
+}
+
+static void *_export_thread(void *arg)
+{
+  dt_control_export_thread_t *t = (dt_control_export_thread_t *)arg;
+  _export_images(t->w, t->fdata);
+  return NULL;
+}
+
+// number of images to export at the same time. bounded by the user's setting
+// and by the memory needed for the largest image in the list, using the same
+// estimate tiling does to decide whether a buffer fits into host memory.
+// with a writer stage every pipe also has one copy of its output in the writer.
+static int _export_parallel_pipes(dt_imageio_module_storage_t *mstorage, dt_imageio_module_format_t *mformat,
+                                  dt_imageio_module_data_t *fdata, GList *images, const guint total,
+                                  const gboolean writer)
+{
+  if(total < 2) return 1;
+  if(!mstorage->flags || !(mstorage->flags(mstorage) & STORAGE_FLAGS_PARALLEL_STORE)) return 1;
+  if(mformat->flags(fdata) & FORMAT_FLAGS_SEQUENTIAL) return 1;
+
+  int pipes = MIN(dt_conf_get_int("max_parallel_exports"), total);
+  if(pipes < 2) return 1;
+
+  size_t width = 0, height = 0;
+  for(const GList *l = images; l; l = g_list_next(l))
+  {
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, GPOINTER_TO_INT(l->data), 'r');
+    if(!image) continue;
+    if((size_t)image->width * image->height > width * height)
+    {
+      width = image->width;
+      height = image->height;
+    }
+    dt_image_cache_read_release(darktable.image_cache, image);
+  }
+  // dimensions not known yet, assume a large sensor
+  if(width * height == 0)
+  {
+    width = 8192;
+    height = 6144;
+  }
+
+  // each pipe holds about an input, an output and a scratch buffer of 4 floats per pixel,
+  // the writer one slot per pipe
+  const float buffers = writer ? 4.0f : 3.0f;
+  while(pipes > 1 && !dt_tiling_piece_fits_host_memory(width, height, 4 * sizeof(float), buffers * pipes, 0))
+    pipes--;
+
+  return pipes;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1361,18 +1559,11 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
 
-  double fraction = 0;
-
   // set up the fdata struct
   fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
   fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
   g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
   fdata->style_append = settings->style_append;
-  // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
-  // sensible assumption?
-  guint tagid = 0, etagid = 0;
-  dt_tag_new("darktable|changed", &tagid);
-  dt_tag_new("darktable|exported", &etagid);
 
   dt_export_metadata_t metadata;
   metadata.flags = 0;
@@ -1383,54 +1574,77 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
-  {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // remove 'changed' tag from image
-    if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-    // make sure the 'exported' tag is set on the image
-    if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+  dt_control_export_worker_t worker = { 0 };
+  worker.job = job;
+  worker.settings = settings;
+  worker.mformat = mformat;
+  worker.mstorage = mstorage;
+  worker.sdata = sdata;
+  worker.fdata = fdata;
+  worker.metadata = &metadata;
+  worker.total = total;
+  worker.images = g_malloc_n(MAX(total, 1), sizeof(int));
+  worker.done = g_malloc0_n(MAX(total, 1), sizeof(gboolean));
+  int k = 0;
+  for(const GList *l = t; l; l = g_list_next(l)) worker.images[k++] = GPOINTER_TO_INT(l->data);
+  // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
+  // sensible assumption?
+  dt_tag_new("darktable|changed", &worker.tagid);
+  dt_tag_new("darktable|exported", &worker.etagid);
+  dt_pthread_mutex_init(&worker.lock, NULL);
+
+  // storages which only need the file to exist once the job ends let the pixelpipe of the
+  // next image run while the previous one is encoded and written
+  const gboolean background_write = total > 1 && dt_conf_get_bool("export_background_write") && mstorage->flags
+                                    && (mstorage->flags(mstorage) & STORAGE_FLAGS_PARALLEL_STORE);
+  const int pipes = _export_parallel_pipes(mstorage, mformat, fdata, t, total, background_write);
+  // the writer gets as many slots as _export_parallel_pipes() budgeted for
+  if(background_write) worker.writer = dt_imageio_export_writer_new(pipes, pipes);
+  // share the cores between the pipes instead of oversubscribing them
+  worker.openmp_threads = MAX(1, darktable.num_openmp_threads / pipes);
+  dt_print(DT_DEBUG_CONTROL, "[export_job] exporting %u images with %d pipes, %d threads each\n", total, pipes,
+           worker.openmp_threads);
 
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), _("exporting %d / %d to %s"), MIN(1, total), total, mstorage->name(mstorage));
+  dt_control_job_set_progress_message(job, message);
 
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
+  // every extra thread gets its own fdata, a copy of the one set up above
+  dt_control_export_thread_t *threads = g_malloc0_n(MAX(pipes - 1, 1), sizeof(dt_control_export_thread_t));
+  int started = 0;
+  for(int i = 0; i < pipes - 1; i++)
+  {
+    dt_imageio_module_data_t *tdata = mformat->get_params(mformat);
+    if(!tdata) break;
+    memcpy(tdata, fdata, mformat->params_size(mformat));
+    threads[started].w = &worker;
+    threads[started].fdata = tdata;
+    if(dt_pthread_create(&threads[started].thread, _export_thread, &threads[started]))
     {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
+      mformat->free_params(mformat, tdata);
+      break;
     }
+    started++;
+  }
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+  _export_images(&worker, fdata);
+
+  for(int i = 0; i < started; i++)
+  {
+    pthread_join(threads[i].thread, NULL);
+    mformat->free_params(mformat, threads[i].fdata);
   }
+  g_free(threads);
+  // wait for the last images to be written
+  dt_imageio_export_writer_destroy(worker.writer);
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  tag_change = worker.tag_change;
+  dt_pthread_mutex_destroy(&worker.lock);
+  g_free(worker.images);
+  g_free(worker.done);
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -2143,21 +2357,116 @@ static void _collection_update(double *last_update, double *update_interval)
   }
 }
 
-static int _control_import_image_insitu(const char *filename, GList **imgs, double *last_update,
-                                        double *update_interval)
+// import the next DT_CONTROL_IMPORT_BATCH files of `files' in place, in three stages:
+// 1. stat the files and find those the library doesn't know yet. known files only get
+//    their flags and duplicates refreshed on import, there is nothing to read ahead for them.
+// 2. read the metadata of the new files and of their sidecars, in parallel.
+// 3. put everything into the library, a transaction per chunk of DT_CONTROL_IMPORT_CHUNK files.
+// returns the number of files handled. `filmid' is set to the film roll of the last one, `imported'
+// to the number of images which made it into the library.
+static int _control_import_insitu_batch(GList *files, GList **imgs, int *filmid, int *imported)
 {
-  char *dirname = g_path_get_dirname(filename);
-  dt_film_t film;
-  const int filmid = dt_film_new(&film, dirname);
-  const int32_t imgid = dt_image_import(filmid, filename, FALSE, FALSE);
-  if(!imgid) dt_control_log(_("error loading file `%s'"), filename);
-  else
+  gchar *filenames[DT_CONTROL_IMPORT_BATCH] = { NULL };
+  // the image and its sidecar for each file, NULL if not worth reading
+  gchar *paths[2 * DT_CONTROL_IMPORT_BATCH] = { NULL };
+  dt_exif_parsed_t *parsed[2 * DT_CONTROL_IMPORT_BATCH] = { NULL };
+
+  int k = 0;
+  for(; files && k < DT_CONTROL_IMPORT_BATCH; files = g_list_next(files), k++)
   {
-    *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
-    _collection_update(last_update, update_interval);
+    filenames[k] = g_strdup((char *)files->data);
+    gchar *normalized = dt_util_normalize_path(filenames[k]);
+    if(normalized && dt_util_test_image_file(normalized))
+    {
+      gchar *dirname = g_path_get_dirname(normalized);
+      gchar *basename = g_path_get_basename(normalized);
+      if(!dt_images_already_imported(dirname, basename))
+      {
+        paths[2 * k + 1] = g_strconcat(normalized, ".xmp", NULL);
+        if(!g_file_test(paths[2 * k + 1], G_FILE_TEST_IS_REGULAR))
+        {
+          g_free(paths[2 * k + 1]);
+          paths[2 * k + 1] = NULL;
+        }
+        paths[2 * k] = normalized;
+        normalized = NULL;
+      }
+      g_free(dirname);
+      g_free(basename);
+    }
+    g_free(normalized);
   }
-  g_free(dirname);
-  return filmid;
+  const int num = k;
+
+  dt_exif_parse_batch((const char *const *)paths, 2 * num, parsed);
+
+  gchar *film_dirname = NULL;
+  *imported = 0;
+  // sidecars are read inside savepoints of the chunk's transaction, a broken history only undoes its own part
+  gboolean transaction = FALSE;
+  GList *chunk_before = NULL;
+  int chunk = 0;
+  double chunk_start = 0.0;
+  for(k = 0; k < num; k++)
+  {
+    if(chunk == 0)
+    {
+      transaction = dt_database_start_transaction(darktable.db);
+      dt_image_cache_write_batch_begin(darktable.image_cache);
+      chunk_before = *imgs;
+      chunk_start = dt_get_wtime();
+    }
+
+    // files usually come a folder at a time
+    gchar *dirname = g_path_get_dirname(filenames[k]);
+    if(g_strcmp0(dirname, film_dirname))
+    {
+      dt_film_t film;
+      *filmid = dt_film_new(&film, dirname);
+      g_free(film_dirname);
+      film_dirname = dirname;
+    }
+    else
+      g_free(dirname);
+
+    const int32_t imgid
+        = dt_image_import_parsed(*filmid, filenames[k], FALSE, FALSE, parsed[2 * k], parsed[2 * k + 1]);
+    if(!imgid)
+      dt_control_log(_("error loading file `%s'"), filenames[k]);
+    else
+    {
+      *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
+      (*imported)++;
+    }
+
+    chunk++;
+    if(k + 1 < num && chunk < DT_CONTROL_IMPORT_CHUNK
+       && dt_get_wtime() - chunk_start < DT_CONTROL_IMPORT_CHUNK_SECONDS)
+      continue;
+
+    dt_image_cache_write_batch_end(darktable.image_cache);
+    if(transaction && !dt_database_release_transaction(darktable.db))
+    {
+      // the chunk was rolled back, none of its images exist
+      while(*imgs != chunk_before)
+      {
+        dt_image_cache_remove(darktable.image_cache, GPOINTER_TO_INT((*imgs)->data));
+        *imgs = g_list_delete_link(*imgs, *imgs);
+        (*imported)--;
+      }
+      dt_control_log(_("error importing %d images, the database could not be updated"), chunk);
+    }
+    chunk = 0;
+  }
+
+  for(k = 0; k < 2 * num; k++)
+  {
+    dt_exif_parsed_free(parsed[k]);
+    g_free(paths[k]);
+  }
+  for(k = 0; k < num; k++) g_free(filenames[k]);
+  g_free(film_dirname);
+  return num;
 }
 
 #ifdef USE_LUA
@@ -2242,7 +2551,7 @@ static int32_t _control_import_job_run(dt_job_t *job)
   double last_coll_update = dt_get_wtime() - (INIT_UPDATE_INTERVAL/2.0);
   double last_prog_update = last_coll_update;
   double update_interval = INIT_UPDATE_INTERVAL;
-  for(GList *img = t; img; img = g_list_next(img))
+  for(GList *img = t; img;)
   {
     if(data->session)
     {
@@ -2256,12 +2565,20 @@ static int32_t _control_import_job_run(dt_job_t *job)
         dt_conf_set_string("plugins/lighttable/collect/string0", output_path);
         _collection_update(&last_coll_update, &update_interval);
       }
+      if(filmid != -1)
+        cntr++;
+      img = g_list_next(img);
+      fraction += 1.0 / total;
     }
     else
-      filmid = _control_import_image_insitu((char *)img->data, &imgs, &last_coll_update, &update_interval);
-    if(filmid != -1)
-      cntr++;
-    fraction += 1.0 / total;
+    {
+      int imported = 0;
+      const int num = _control_import_insitu_batch(img, &imgs, &filmid, &imported);
+      cntr += imported;
+      img = g_list_nth(img, num);
+      fraction += (double)num / total;
+      _collection_update(&last_coll_update, &update_interval);
+    }
     double currtime  = dt_get_wtime();
     if (currtime - last_prog_update > PROGRESS_UPDATE_INTERVAL)
     {
@@ -24,12 +24,19 @@ typedef struct dt_image_load_t
 {
   int32_t imgid;
   dt_mipmap_size_t mip;
+  int32_t prefetch;   // can be called off by dt_image_prefetch_cancel()
+  int32_t generation; // of the prefetches when it was created
 } dt_image_load_t;
 
+// bumped by dt_image_prefetch_cancel(), prefetch jobs of an older generation don't load anything
+static gint _prefetch_generation = 0;
+
 static int32_t dt_image_load_job_run(dt_job_t *job)
 {
   dt_image_load_t *params = dt_control_job_get_params(job);
 
+  if(params->prefetch && params->generation != g_atomic_int_get(&_prefetch_generation)) return 0;
+
   // hook back into mipmap_cache:
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
@@ -46,7 +53,7 @@ static int32_t dt_image_load_job_run(dt_job_t *job)
   return 0;
 }
 
-dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
+static dt_job_t *_image_load_job_create(int32_t id, dt_mipmap_size_t mip, const gboolean prefetch)
 {
   dt_job_t *job = dt_control_job_create(&dt_image_load_job_run, "load image %d mip %d", id, mip);
   if(!job) return NULL;
@@ -59,9 +66,27 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
   dt_control_job_set_params_with_size(job, params, sizeof(dt_image_load_t), free);
   params->imgid = id;
   params->mip = mip;
+  params->prefetch = prefetch;
+  // plain loads keep 0 so the job queue still folds equal ones together
+  params->generation = prefetch ? g_atomic_int_get(&_prefetch_generation) : 0;
   return job;
 }
 
+dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
+{
+  return _image_load_job_create(id, mip, FALSE);
+}
+
+dt_job_t *dt_image_prefetch_job_create(int32_t id, dt_mipmap_size_t mip)
+{
+  return _image_load_job_create(id, mip, TRUE);
+}
+
+void dt_image_prefetch_cancel()
+{
+  g_atomic_int_inc(&_prefetch_generation);
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
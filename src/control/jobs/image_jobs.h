@@ -24,6 +24,10 @@
 #include <inttypes.h>
 
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
+// like a load job, but dropped without loading anything if dt_image_prefetch_cancel() is called
+// before it runs. for speculative loads which may turn out to be useless.
+dt_job_t *dt_image_prefetch_job_create(int32_t imgid, dt_mipmap_size_t mip);
+void dt_image_prefetch_cancel();
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
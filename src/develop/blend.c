@@ -420,6 +420,82 @@ static void _develop_blend_process_mask_tone_curve(float *const restrict mask, c
 }
 
 
+static inline uint64_t _blend_hash_bytes(uint64_t hash, const void *data, const size_t len)
+{
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < len; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// hash of everything the drawn mask of form depends on: its shapes, the distortions up to this
+// module and the roi, but not the pixels. 0 if the pipe is being changed.
+static uint64_t _blend_drawn_mask_hash(const dt_iop_module_t *const self, const dt_dev_pixelpipe_iop_t *const piece,
+                                       const dt_masks_form_t *const form, const dt_develop_blend_params_t *const d,
+                                       const dt_iop_roi_t *const roi_out)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const uint64_t distort
+      = dt_dev_hash_distort_plus(self->dev, pipe, self->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  if(distort == 0) return 0;
+
+  uint64_t hash = _blend_hash_bytes(5381, &form->formid, sizeof(int));
+  // the shapes are looked up like dt_masks_group_render_roi() does
+  for(const GList *pts = form->points; pts; pts = g_list_next(pts))
+  {
+    const dt_masks_point_group_t *fpt = (const dt_masks_point_group_t *)pts->data;
+    dt_masks_form_t *sel = dt_masks_get_from_id(self->dev, fpt->formid);
+    if(!sel) continue;
+    hash = _blend_hash_bytes(hash, &fpt->state, sizeof(int));
+    hash = _blend_hash_bytes(hash, &fpt->opacity, sizeof(float));
+    const int len = dt_masks_group_get_hash_buffer_length(self->dev, sel);
+    char *str = malloc(len);
+    if(!str) return 0;
+    dt_masks_group_get_hash_buffer(self->dev, sel, str);
+    hash = _blend_hash_bytes(hash, str, len);
+    free(str);
+  }
+
+  const int geometry[4] = { pipe->image.id, pipe->iwidth, pipe->iheight, d->mask_combine };
+  hash = _blend_hash_bytes(hash, geometry, sizeof(geometry));
+  hash = _blend_hash_bytes(hash, &pipe->iscale, sizeof(float));
+  hash = _blend_hash_bytes(hash, roi_out, sizeof(dt_iop_roi_t));
+  hash = _blend_hash_bytes(hash, &self->iop_order, sizeof(self->iop_order));
+  return ((hash << 5) + hash) ^ distort;
+}
+
+// hash of the final mask, after parametric and detail masks and post processing. these look at the
+// input and output of the module, which are covered by the hashes of the pipe up to this module.
+// 0 if the mask shouldn't be cached.
+static uint64_t _blend_mask_hash(const dt_iop_module_t *const self, dt_dev_pixelpipe_iop_t *const piece,
+                                 const dt_masks_form_t *const form, const dt_develop_blend_params_t *const d,
+                                 const void *const ivoid, const dt_iop_roi_t *const roi_in,
+                                 const dt_iop_roi_t *const roi_out,
+                                 const _develop_mask_post_processing *const post_operations,
+                                 const size_t post_operations_size)
+{
+  uint64_t hash = _blend_drawn_mask_hash(self, piece, form, d, roi_out);
+  if(hash == 0) return 0;
+  hash = _blend_hash_bytes(hash, d, sizeof(dt_develop_blend_params_t));
+  hash = _blend_hash_bytes(hash, roi_in, sizeof(dt_iop_roi_t));
+
+  gboolean pixels = (d->mask_mode & DEVELOP_MASK_CONDITIONAL) || d->details != 0.0f;
+  for(size_t k = 0; k < post_operations_size; k++)
+    pixels |= post_operations[k] == DEVELOP_MASK_POST_FEATHER_IN
+              || post_operations[k] == DEVELOP_MASK_POST_FEATHER_OUT;
+  if(pixels)
+  {
+    dt_dev_pixelpipe_t *pipe = piece->pipe;
+    // a mask of half float input would be handed on to a full precision run
+    if(dt_dev_pixelpipe_cache_rounded(&pipe->cache, (void *)ivoid)) return 0;
+    const uint64_t upstream = dt_dev_pixelpipe_cache_basichash_prior(pipe->image.id, pipe, self);
+    hash = ((hash << 5) + hash) ^ upstream;
+    hash = ((hash << 5) + hash) ^ piece->hash;
+    // the detail mask is left out while it isn't there
+    hash = ((hash << 5) + hash) ^ (pipe->rawdetail_mask_data != NULL);
+  }
+  return hash;
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -532,95 +608,112 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
     // get the drawn mask if there is one
     dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
-
-    if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
+    const gboolean drawn = form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK);
+
+    // masks with drawn shapes are kept in the cache of the pipe, they are expensive to get again
+    const uint64_t mask_hash = drawn ? _blend_mask_hash(self, piece, form, d, ivoid, roi_in, roi_out,
+                                                        post_operations, post_operations_size)
+                                     : 0;
+    const gboolean cached = mask_hash
+                            && !dt_dev_pixelpipe_cache_get_copy(&piece->pipe->cache, mask_hash, mask,
+                                                                sizeof(float) * buffsize);
+    if(!cached)
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      const double mask_start = dt_get_wtime();
 
-      if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+      if(drawn)
       {
-        // if we have a mask and this flag is set -> invert the mask
-        dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k];
-      }
-    }
-    else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
-    {
-      // no form defined but drawn mask active
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f;
-      dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
-    }
-    else
-    {
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
-      dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
-    }
-    _refine_with_detail_mask(self, piece, mask, roi_in, roi_out, d->details);
-
-    // get parametric mask (if any) and apply global opacity
-    switch(blend_csp)
-    {
-      case DEVELOP_BLEND_CS_LAB:
-        dt_develop_blendif_lab_make_mask(piece, (const float *const restrict)ivoid,
-                                         (const float *const restrict)ovoid, roi_in, roi_out, mask);
-        break;
-      case DEVELOP_BLEND_CS_RGB_DISPLAY:
-        dt_develop_blendif_rgb_hsl_make_mask(piece, (const float *const restrict)ivoid,
-                                             (const float *const restrict)ovoid, roi_in, roi_out, mask);
-        break;
-      case DEVELOP_BLEND_CS_RGB_SCENE:
-        dt_develop_blendif_rgb_jzczhz_make_mask(piece, (const float *const restrict)ivoid,
-                                                (const float *const restrict)ovoid, roi_in, roi_out, mask);
-        break;
-      case DEVELOP_BLEND_CS_RAW:
-        dt_develop_blendif_raw_make_mask(piece, (const float *const restrict)ivoid,
-                                         (const float *const restrict)ovoid, roi_in, roi_out, mask);
-        break;
-      default:
-        break;
-    }
+        dt_masks_group_render_roi(self, piece, form, roi_out, mask);
 
-    // post processing the mask
-    for(size_t index = 0; index < post_operations_size; ++index)
-    {
-      _develop_mask_post_processing operation = post_operations[index];
-      if(operation == DEVELOP_MASK_POST_FEATHER_IN)
+        if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+        {
+          // if we have a mask and this flag is set -> invert the mask
+          dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k];
+        }
+      }
+      else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
       {
-        const float guide_weight = cst == iop_cs_rgb ? 100.0f : 1.0f;
-        float *restrict guide = (float *restrict)ivoid;
-        if(!rois_equal)
-          guide = _develop_blend_process_copy_region(guide, iwidth * ch, xoffs * ch, yoffs * ch,
-                                                     owidth * ch, oheight * ch);
-        if(guide)
-          _develop_blend_process_feather(guide, mask, owidth, oheight, ch, guide_weight,
-                                         d->feathering_radius, roi_out->scale / piece->iscale);
-        if(!rois_equal)
-          _develop_blend_process_free_region(guide);
+        // no form defined but drawn mask active
+        // we fill the buffer with 1.0f or 0.0f depending on mask_combine
+        const float fill = (d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f;
+        dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
       }
-      else if(operation == DEVELOP_MASK_POST_FEATHER_OUT)
+      else
       {
-        const float guide_weight = cst == iop_cs_rgb ? 100.0f : 1.0f;
-        _develop_blend_process_feather((const float *const restrict)ovoid, mask, owidth, oheight, ch,
-                                       guide_weight, d->feathering_radius, roi_out->scale / piece->iscale);
+        // we fill the buffer with 1.0f or 0.0f depending on mask_combine
+        const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
+        dt_iop_image_fill(mask, fill, owidth, oheight, 1); //mask[k] = fill;
       }
-      else if(operation == DEVELOP_MASK_POST_BLUR)
+      _refine_with_detail_mask(self, piece, mask, roi_in, roi_out, d->details);
+
+      // get parametric mask (if any) and apply global opacity
+      switch(blend_csp)
       {
-        const float sigma = d->blur_radius * roi_out->scale / piece->iscale;
-        const float mmax[] = { 1.0f };
-        const float mmin[] = { 0.0f };
+        case DEVELOP_BLEND_CS_LAB:
+          dt_develop_blendif_lab_make_mask(piece, (const float *const restrict)ivoid,
+                                           (const float *const restrict)ovoid, roi_in, roi_out, mask);
+          break;
+        case DEVELOP_BLEND_CS_RGB_DISPLAY:
+          dt_develop_blendif_rgb_hsl_make_mask(piece, (const float *const restrict)ivoid,
+                                               (const float *const restrict)ovoid, roi_in, roi_out, mask);
+          break;
+        case DEVELOP_BLEND_CS_RGB_SCENE:
+          dt_develop_blendif_rgb_jzczhz_make_mask(piece, (const float *const restrict)ivoid,
+                                                  (const float *const restrict)ovoid, roi_in, roi_out, mask);
+          break;
+        case DEVELOP_BLEND_CS_RAW:
+          dt_develop_blendif_raw_make_mask(piece, (const float *const restrict)ivoid,
+                                           (const float *const restrict)ovoid, roi_in, roi_out, mask);
+          break;
+        default:
+          break;
+      }
 
-        dt_gaussian_t *g = dt_gaussian_init(owidth, oheight, 1, mmax, mmin, sigma, 0);
-        if(g)
+      // post processing the mask
+      for(size_t index = 0; index < post_operations_size; ++index)
+      {
+        _develop_mask_post_processing operation = post_operations[index];
+        if(operation == DEVELOP_MASK_POST_FEATHER_IN)
         {
-          dt_gaussian_blur(g, mask, mask);
-          dt_gaussian_free(g);
+          const float guide_weight = cst == iop_cs_rgb ? 100.0f : 1.0f;
+          float *restrict guide = (float *restrict)ivoid;
+          if(!rois_equal)
+            guide = _develop_blend_process_copy_region(guide, iwidth * ch, xoffs * ch, yoffs * ch,
+                                                       owidth * ch, oheight * ch);
+          if(guide)
+            _develop_blend_process_feather(guide, mask, owidth, oheight, ch, guide_weight,
+                                           d->feathering_radius, roi_out->scale / piece->iscale);
+          if(!rois_equal)
+            _develop_blend_process_free_region(guide);
+        }
+        else if(operation == DEVELOP_MASK_POST_FEATHER_OUT)
+        {
+          const float guide_weight = cst == iop_cs_rgb ? 100.0f : 1.0f;
+          _develop_blend_process_feather((const float *const restrict)ovoid, mask, owidth, oheight, ch,
+                                         guide_weight, d->feathering_radius, roi_out->scale / piece->iscale);
+        }
+        else if(operation == DEVELOP_MASK_POST_BLUR)
+        {
+          const float sigma = d->blur_radius * roi_out->scale / piece->iscale;
+          const float mmax[] = { 1.0f };
+          const float mmin[] = { 0.0f };
+
+          dt_gaussian_t *g = dt_gaussian_init(owidth, oheight, 1, mmax, mmin, sigma, 0);
+          if(g)
+          {
+            dt_gaussian_blur(g, mask, mask);
+            dt_gaussian_free(g);
+          }
+        }
+        else if(operation == DEVELOP_MASK_POST_TONE_CURVE)
+        {
+          _develop_blend_process_mask_tone_curve(mask, buffsize, d->contrast, d->brightness, opacity);
         }
       }
-      else if(operation == DEVELOP_MASK_POST_TONE_CURVE)
-      {
-        _develop_blend_process_mask_tone_curve(mask, buffsize, d->contrast, d->brightness, opacity);
-      }
+
+      if(mask_hash)
+        dt_dev_pixelpipe_cache_put_copy(&piece->pipe->cache, mask_hash, mask, sizeof(float) * buffsize,
+                                        1000.0 * (dt_get_wtime() - mask_start));
     }
   }
 
@@ -1032,12 +1125,23 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
 
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
-
-      if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+      // only the drawn part is kept in the cache of the pipe, the rest is done on the gpu
+      const uint64_t mask_hash = _blend_drawn_mask_hash(self, piece, form, d, roi_out);
+      if(!mask_hash
+         || dt_dev_pixelpipe_cache_get_copy(&piece->pipe->cache, mask_hash, mask, sizeof(float) * buffsize))
       {
-        // if we have a mask and this flag is set -> invert the mask
-        dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k]
+        const double mask_start = dt_get_wtime();
+        dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+
+        if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+        {
+          // if we have a mask and this flag is set -> invert the mask
+          dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k]
+        }
+
+        if(mask_hash)
+          dt_dev_pixelpipe_cache_put_copy(&piece->pipe->cache, mask_hash, mask, sizeof(float) * buffsize,
+                                          1000.0 * (dt_get_wtime() - mask_start));
       }
     }
     else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
@@ -889,9 +889,10 @@ static void _dev_add_history_item_ext(dt_develop_t *dev, dt_iop_module_t *module
     dev->history = g_list_append(dev->history, hist);
     if(!no_image)
     {
-      dev->pipe->changed |= DT_DEV_PIPE_SYNCH;
-      dev->preview_pipe->changed |= DT_DEV_PIPE_SYNCH; // topology remains, as modules are fixed for now.
-      dev->preview2_pipe->changed |= DT_DEV_PIPE_SYNCH; // topology remains, as modules are fixed for now.
+      // topology remains, as modules are fixed for now. only modules whose history changed are synched.
+      dev->pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED;
+      dev->preview_pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED;
+      dev->preview2_pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED;
     }
   }
   else
@@ -1251,9 +1252,9 @@ void dt_dev_pop_history_items(dt_develop_t *dev, int32_t cnt)
 
   if(!dev_iop_changed)
   {
-    dev->pipe->changed |= DT_DEV_PIPE_SYNCH;
-    dev->preview_pipe->changed |= DT_DEV_PIPE_SYNCH; // again, fixed topology for now.
-    dev->preview2_pipe->changed |= DT_DEV_PIPE_SYNCH; // again, fixed topology for now.
+    dev->pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED;
+    dev->preview_pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED; // again, fixed topology for now.
+    dev->preview2_pipe->changed |= DT_DEV_PIPE_HISTORY_CHANGED; // again, fixed topology for now.
   }
   else
   {
@@ -2798,7 +2799,8 @@ int dt_dev_sync_pixelpipe_hash(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pip
     return TRUE;
 
   // timed out. let's see if history stack has changed
-  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))
+  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH
+                       | DT_DEV_PIPE_HISTORY_CHANGED))
   {
     // history stack has changed. let's trigger reprocessing
     dt_control_queue_redraw_center();
@@ -2896,7 +2898,8 @@ int dt_dev_sync_pixelpipe_hash_distort(dt_develop_t *dev, struct dt_dev_pixelpip
     return TRUE;
 
   // timed out. let's see if history stack has changed
-  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))
+  if(pipe->changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH
+                       | DT_DEV_PIPE_HISTORY_CHANGED))
   {
     // history stack has changed. let's trigger reprocessing
     dt_control_queue_redraw_center();
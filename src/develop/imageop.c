@@ -180,6 +180,8 @@ static void default_process(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 
   if(darktable.codepath.OPENMP_SIMD && self->process_plain)
     self->process_plain(self, piece, i, o, roi_in, roi_out);
+  else if(darktable.codepath.AVX2 && self->process_plain && (self->flags() & IOP_FLAGS_WIDE_PLAIN))
+    self->process_plain(self, piece, i, o, roi_in, roi_out);
 #if defined(__SSE__)
   else if(darktable.codepath.SSE2 && self->process_sse2)
     self->process_sse2(self, piece, i, o, roi_in, roi_out);
@@ -1760,6 +1762,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
   if(module->flags() & IOP_FLAGS_ALLOW_TILING)
     piece->process_tiling_ready = 1;
 
+  // a module with a per-pixel kernel may be fused with its neighbours, commit_params can overwrite this.
+  piece->process_pointwise_ready = module->process_pointwise != NULL;
+
   if(darktable.unmuted & DT_DEBUG_PARAMS && module->so->get_introspection())
     _iop_validate_params(module->so->get_introspection()->field, params, TRUE);
 
@@ -1774,8 +1779,8 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
     /* construct module params data for hash calc */
     int length = module->params_size;
     if(module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) length += sizeof(dt_develop_blend_params_t);
-    dt_masks_form_t *grp = dt_masks_get_from_id(darktable.develop, blendop_params->mask_id);
-    length += dt_masks_group_get_hash_buffer_length(grp);
+    dt_masks_form_t *grp = dt_masks_get_from_id(module->dev, blendop_params->mask_id);
+    length += dt_masks_group_get_hash_buffer_length(module->dev, grp);
 
     char *str = malloc(length);
     memcpy(str, module->params, module->params_size);
@@ -1788,7 +1793,7 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
     }
 
     /* and we add masks */
-    dt_masks_group_get_hash_buffer(grp, str + pos);
+    dt_masks_group_get_hash_buffer(module->dev, grp, str + pos);
 
     uint64_t hash = 5381;
     for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
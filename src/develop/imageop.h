@@ -104,7 +104,10 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_NO_MASKS           = 1 << 10, // The module doesn't support masks (used with SUPPORT_BLENDING)
   IOP_FLAGS_FENCE              = 1 << 11, // No module can be moved pass this one
   IOP_FLAGS_ALLOW_FAST_PIPE    = 1 << 12, // Module can work with a fast pipe
-  IOP_FLAGS_UNSAFE_COPY        = 1 << 13  // Unsafe to copy as part of history
+  IOP_FLAGS_UNSAFE_COPY        = 1 << 13, // Unsafe to copy as part of history
+  IOP_FLAGS_WIDE_PLAIN         = 1 << 14, // process() is built for AVX2/AVX-512 too, prefer it over process_sse2() there
+  IOP_FLAGS_FULL_PRECISION     = 1 << 15, // Input must not come from a half float cache line
+  IOP_FLAGS_STRIP_SAFE         = 1 << 16  // Output only depends on a neighbourhood, exports may be processed in strips
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -305,6 +308,8 @@ typedef struct dt_iop_module_t
 void dt_iop_load_modules_so(void);
 /** cleans up the dlopen refs. */
 void dt_iop_unload_modules_so(void);
+/** loads the .so `libname' of the module `module_name' into the dt_iop_module_so_t `m'. returns 0 on success. */
+int dt_iop_load_module_so(void *m, const char *libname, const char *module_name);
 /** load a module for a given .so */
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, struct dt_develop_t *dev);
 /** returns a list of instances referencing stuff loaded in load_modules_so. */
@@ -323,6 +323,24 @@ static inline int dt_masks_get_mask_roi(const dt_iop_module_t *const module, con
   return form->functions ? form->functions->get_mask_roi(module, piece, form, roi, buffer) : 0;
 }
 
+/** the part of a roi a rasterized shape is not zero in */
+typedef struct dt_masks_raster_box_t
+{
+  int x, y, width, height;
+} dt_masks_raster_box_t;
+
+/** like dt_masks_get_mask_roi(), but single shapes are kept in a cache shared by all pipes. only the part of
+ * the roi the shape covers is written to buffer, packed as box->width * box->height values. buffer still
+ * has to hold the whole roi to draw the shape on a cache miss. */
+int dt_masks_get_mask_roi_cached(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                                 dt_masks_form_t *const form, const dt_iop_roi_t *const roi, float *const buffer,
+                                 dt_masks_raster_box_t *box);
+/** unpack a result of dt_masks_get_mask_roi_cached() in place to the whole width x height roi */
+void dt_masks_raster_expand(float *const buffer, const dt_masks_raster_box_t *const box, const int width,
+                            const int height);
+void dt_masks_raster_cache_init();
+void dt_masks_raster_cache_cleanup();
+
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
@@ -400,8 +418,9 @@ void dt_masks_set_edit_mode_single_form(struct dt_iop_module_t *module, const in
 void dt_masks_iop_update(struct dt_iop_module_t *module);
 void dt_masks_iop_combo_populate(GtkWidget *w, struct dt_iop_module_t **m);
 void dt_masks_iop_use_same_as(struct dt_iop_module_t *module, struct dt_iop_module_t *src);
-int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form);
-char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str);
+/** the member shapes of a group are looked up in dev */
+int dt_masks_group_get_hash_buffer_length(dt_develop_t *dev, dt_masks_form_t *form);
+char *dt_masks_group_get_hash_buffer(dt_develop_t *dev, dt_masks_form_t *form, char *str);
 
 void dt_masks_form_remove(struct dt_iop_module_t *module, dt_masks_form_t *grp, dt_masks_form_t *form);
 void dt_masks_form_change_opacity(dt_masks_form_t *form, int parentid, int up);
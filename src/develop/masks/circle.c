@@ -1245,28 +1245,27 @@ static int _circle_get_mask_roi(const dt_iop_module_t *const restrict module,
 
   // we calculate the mask values at the transformed points;
   // for results: re-use the points array
+  const size_t npoints = (size_t)bbw * bbh;
 #ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(bbh, bbw, centerx, centery, border2, total2) \
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(npoints, centerx, centery, border2, total2) \
   dt_omp_sharedconst(points) \
-  schedule(static) collapse(2) if(bbh*bbw > 50000) num_threads(MIN(darktable.num_openmp_threads,(h*w)/20000))
+  schedule(simd:static) if(npoints > 50000) num_threads(MIN(darktable.num_openmp_threads,(h*w)/20000))
 #else
 #pragma omp parallel for shared(points)
 #endif
 #endif
-  for(int j = 0; j < bbh; j++)
-    for(int i = 0; i < bbw; i++)
-    {
-      const size_t index = (size_t)j * bbw + i;
-      // find the square of the distance from the center
-      const float l2 = sqf(points[2 * index] - centerx) + sqf(points[2 * index + 1] - centery);
-      // quadratic falloff between the circle's radius and the radius of the outside of the feathering
-      const float ratio = (total2 - l2) / border2;
-      // enforce 1.0 inside the circle and 0.0 outside the feathering
-      const float f = CLAMP(ratio, 0.0f, 1.0f);
-      points[2*index] = f * f;
-    }
+  for(size_t index = 0; index < npoints; index++)
+  {
+    // find the square of the distance from the center
+    const float l2 = sqf(points[2 * index] - centerx) + sqf(points[2 * index + 1] - centery);
+    // quadratic falloff between the circle's radius and the radius of the outside of the feathering
+    const float ratio = (total2 - l2) / border2;
+    // enforce 1.0 inside the circle and 0.0 outside the feathering
+    const float f = CLAMP(ratio, 0.0f, 1.0f);
+    points[2*index] = f * f;
+  }
 
   if(darktable.unmuted & DT_DEBUG_PERF)
   {
@@ -1874,31 +1874,6 @@ static int _ellipse_get_mask(const dt_iop_module_t *const module, const dt_dev_p
 }
 
 
-static inline float fast_atan2(float y, float x)
-{
-    float r = 0.0F, s = 0.0F, t = 0.0F, c = 0.0F, q = 0.0F;
-    const float ax = ABS(x);
-    const float ay = ABS(y);
-    const float mx = MAX(ay, ax);
-    const float mn = MIN(ay, ax);
-    const float a = mn / mx;
-
-    s = a * a;
-    c = s * a;
-    q = s * s;
-    r =  0.024840285f * q + 0.18681418f;
-    t = -0.094097948f * q - 0.33213072f;
-    r = r * s + t;
-    r = r * c + a;
-
-    r = ay > ax ? 1.57079632679489661923f - r : r;
-    r = x < 0 ? 3.14159265358979323846f - r : r;
-    r = y < 0 ? -r : r;
-    r = isnormal(r) ? r : 0.0f;
-    return r;
-}
-
-
 static int _ellipse_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
                                  dt_masks_form_t *const form, const dt_iop_roi_t *roi, float *buffer)
 {
@@ -2082,39 +2057,32 @@ static int _ellipse_get_mask_roi(const dt_iop_module_t *const module, const dt_d
 
   // we calculate the mask values at the transformed points;
   // for results: re-use the points array
+  // sin(atan2(y, x) - alpha) is (y * cos(alpha) - x * sin(alpha)) / sqrt(l2), so the loop
+  // gets along without trigonometric functions and vectorizes
+  const size_t npoints = (size_t)bbw * bbh;
 #ifdef _OPENMP
 #if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(bbh, bbw, center, alpha, a2, b2, ta2, tb2) \
-  shared(points)
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(npoints, center, cosa, sina, a2, b2, ta2, tb2) \
+  shared(points) schedule(simd:static)
 #else
 #pragma omp parallel for shared(points)
 #endif
 #endif
-  for(int j = 0; j < bbh; j++)
-    for(int i = 0; i < bbw; i++)
-    {
-      const size_t index = (size_t)j * bbw + i;
-      const float x = points[index * 2] - center[0];
-      const float y = points[index * 2 + 1] - center[1];
-      const float v = fast_atan2(y, x) - alpha;
-      const float sinv = sinf(v);
-      const float sinv2 = sinv * sinv;
-      const float cosv2 = 1.0f - sinv2;
-      const float radius2 = a2 * b2 / (a2 * sinv2 + b2 * cosv2);
-      const float total2 = ta2 * tb2 / (ta2 * sinv2 + tb2 * cosv2);
-      float l2 = x * x + y * y;
+  for(size_t index = 0; index < npoints; index++)
+  {
+    const float x = points[index * 2] - center[0];
+    const float y = points[index * 2 + 1] - center[1];
+    const float l2 = x * x + y * y;
+    const float s = y * cosa - x * sina;
+    const float sinv2 = l2 > 0.0f ? s * s / l2 : 0.0f;
+    const float cosv2 = 1.0f - sinv2;
+    const float radius2 = a2 * b2 / (a2 * sinv2 + b2 * cosv2);
+    const float total2 = ta2 * tb2 / (ta2 * sinv2 + tb2 * cosv2);
+    const float f = (total2 - l2) / (total2 - radius2);
 
-      if(l2 < radius2)
-        points[index * 2] = 1.0f;
-      else if(l2 < total2)
-      {
-        const float f = (total2 - l2) / (total2 - radius2);
-        points[index * 2] = f * f;
-      }
-      else
-        points[index * 2] = 0.0f;
-    }
+    points[index * 2] = (l2 < radius2) ? 1.0f : (l2 < total2) ? f * f : 0.0f;
+  }
 
   if(darktable.unmuted & DT_DEBUG_PERF)
   {
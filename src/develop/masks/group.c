@@ -580,6 +580,61 @@ static void _combine_masks_exclusion(float *const restrict dest, float *const re
   }
 }
 
+// combine a shape which is zero outside of box, packed to the box. the non-inverted union, difference
+// and exclusion leave dest as is where the shape is zero, so everything outside the box is skipped.
+static void _combine_masks_box(float *const restrict dest, const float *const restrict newmask, const int width,
+                               const dt_masks_raster_box_t *const box, const float opacity, const int state)
+{
+  const int bx = box->x;
+  const int by = box->y;
+  const int bw = box->width;
+  const int bh = box->height;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bx, by, bw, bh, width, opacity, state) \
+  dt_omp_sharedconst(dest, newmask) \
+  schedule(static) if((size_t)bw * bh > 50000)
+#endif
+  for(int j = 0; j < bh; j++)
+  {
+    float *const restrict d = dest + (size_t)(by + j) * width + bx;
+    const float *const restrict m = newmask + (size_t)j * bw;
+    if(state & DT_MASKS_STATE_UNION)
+    {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < bw; i++) d[i] = MAX(d[i], opacity * m[i]);
+    }
+    else if(state & DT_MASKS_STATE_DIFFERENCE)
+    {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < bw; i++)
+      {
+        const float mask = opacity * m[i];
+        d[i] *= (1.0f - mask * both_positive(d[i], mask));
+      }
+    }
+    else
+    {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < bw; i++)
+      {
+        const float mask = opacity * m[i];
+        const float pos = both_positive(d[i], mask);
+        const float neg = (1.0f - pos);
+        const float b1 = d[i];
+        d[i] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
+      }
+    }
+  }
+}
+
 static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
                                const dt_dev_pixelpipe_iop_t *const restrict piece,
                                dt_masks_form_t *const form, const dt_iop_roi_t *const roi,
@@ -608,7 +663,8 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
 
     if(sel)
     {
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
+      dt_masks_raster_box_t box;
+      const int ok = dt_masks_get_mask_roi_cached(module, piece, sel, roi, bufs, &box);
       const float op = fpt->opacity;
       const int state = fpt->state;
 
@@ -616,8 +672,17 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
       {
         // first see if we need to invert this shape
         const int inverted = (state & DT_MASKS_STATE_INVERSE);
+        // only the shape's box matters for some combinations, the others need it in the whole roi
+        const gboolean boxed = !inverted
+                               && (state & (DT_MASKS_STATE_UNION | DT_MASKS_STATE_DIFFERENCE
+                                            | DT_MASKS_STATE_EXCLUSION));
+        if(!boxed) dt_masks_raster_expand(bufs, &box, width, height);
 
-        if(state & DT_MASKS_STATE_UNION)
+        if(boxed)
+        {
+          if(box.width && box.height) _combine_masks_box(buffer, bufs, width, &box, op, state);
+        }
+        else if(state & DT_MASKS_STATE_UNION)
         {
           _combine_masks_union(buffer, bufs, npixels, op, inverted);
         }
@@ -1858,7 +1858,7 @@ void dt_masks_group_ungroup(dt_masks_form_t *dest_grp, dt_masks_form_t *grp)
   }
 }
 
-int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
+int dt_masks_group_get_hash_buffer_length(dt_develop_t *dev, dt_masks_form_t *form)
 {
   if(!form) return 0;
   int pos = 0;
@@ -1873,14 +1873,14 @@ int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
     if(form->type & DT_MASKS_GROUP)
     {
       dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-      dt_masks_form_t *f = dt_masks_get_from_id(darktable.develop, grpt->formid);
+      dt_masks_form_t *f = dt_masks_get_from_id(dev, grpt->formid);
       if(f)
       {
         // state & opacity
         pos += sizeof(int);
         pos += sizeof(float);
         // the form itself
-        pos += dt_masks_group_get_hash_buffer_length(f);
+        pos += dt_masks_group_get_hash_buffer_length(dev, f);
       }
     }
     else if(form->functions)
@@ -1891,7 +1891,7 @@ int dt_masks_group_get_hash_buffer_length(dt_masks_form_t *form)
   return pos;
 }
 
-char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
+char *dt_masks_group_get_hash_buffer(dt_develop_t *dev, dt_masks_form_t *form, char *str)
 {
   if(!form) return str;
   int pos = 0;
@@ -1910,7 +1910,7 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
     if(form->type & DT_MASKS_GROUP)
     {
       dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-      dt_masks_form_t *f = dt_masks_get_from_id(darktable.develop, grpt->formid);
+      dt_masks_form_t *f = dt_masks_get_from_id(dev, grpt->formid);
       if(f)
       {
         // state & opacity
@@ -1919,7 +1919,7 @@ char *dt_masks_group_get_hash_buffer(dt_masks_form_t *form, char *str)
         memcpy(str + pos, &grpt->opacity, sizeof(float));
         pos += sizeof(float);
         // the form itself
-        str = dt_masks_group_get_hash_buffer(f, str + pos) - pos;
+        str = dt_masks_group_get_hash_buffer(dev, f, str + pos) - pos;
       }
     }
     else if(form->functions)
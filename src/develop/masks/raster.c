@@ -0,0 +1,295 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/masks.h"
+#include "develop/pixelpipe_hb.h"
+
+// rasterized shapes, shared by all pipes.
+//
+// drawing a shape means back-transforming a grid or a polygon through all distorting
+// modules below the one the mask belongs to, which is the expensive part of a mask. while
+// another shape of the same group is edited, or another module of the pipe changes, the
+// result is the same as before, so it is kept here. only the part of the roi the shape
+// covers is stored, tightly packed.
+
+typedef struct _raster_entry_t
+{
+  uint64_t hash;
+  dt_masks_raster_box_t box;
+  float *data;   // box.width * box.height values
+  size_t bytes;
+  uint64_t used; // cache clock of the last lookup
+} _raster_entry_t;
+
+typedef struct _raster_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries; // hash -> _raster_entry_t
+  size_t bytes;
+  size_t max_bytes;
+  uint64_t clock;
+  // statistics:
+  uint64_t hits;
+  uint64_t misses;
+} _raster_cache_t;
+
+static _raster_cache_t _cache = { 0 };
+
+static void _raster_entry_free(gpointer data)
+{
+  _raster_entry_t *entry = (_raster_entry_t *)data;
+  dt_free_align(entry->data);
+  free(entry);
+}
+
+void dt_masks_raster_cache_init()
+{
+  dt_pthread_mutex_init(&_cache.lock, NULL);
+  _cache.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _raster_entry_free);
+  _cache.bytes = 0;
+  _cache.max_bytes = MAX(dt_conf_get_int64("masks_raster_cache_memory"), 0);
+  _cache.clock = 0;
+  _cache.hits = _cache.misses = 0;
+}
+
+void dt_masks_raster_cache_cleanup()
+{
+  if(!_cache.entries) return;
+  dt_print(DT_DEBUG_MASKS, "[masks raster cache] %" PRIu64 " hits, %" PRIu64 " misses, %zu kB in use\n",
+           _cache.hits, _cache.misses, _cache.bytes >> 10);
+  g_hash_table_destroy(_cache.entries);
+  _cache.entries = NULL;
+  dt_pthread_mutex_destroy(&_cache.lock);
+}
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t len)
+{
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < len; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// everything the rasterized shape depends on: the shape itself, the image and roi it is drawn
+// for and the distortions of all modules up to the one the mask belongs to. 0 if the pipe is
+// being changed and the distortions can't be told.
+static uint64_t _raster_hash(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                             dt_masks_form_t *const form, const dt_iop_roi_t *const roi)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const uint64_t distort
+      = dt_dev_hash_distort_plus(module->dev, pipe, module->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  if(distort == 0) return 0;
+
+  const int len = dt_masks_group_get_hash_buffer_length(module->dev, form);
+  char *str = malloc(len);
+  if(!str) return 0;
+  dt_masks_group_get_hash_buffer(module->dev, form, str);
+
+  uint64_t hash = _hash_bytes(5381, str, len);
+  free(str);
+
+  const int geometry[7] = { pipe->image.id, pipe->iwidth, pipe->iheight, roi->x, roi->y, roi->width, roi->height };
+  const float scale[2] = { pipe->iscale, roi->scale };
+  hash = _hash_bytes(hash, geometry, sizeof(geometry));
+  hash = _hash_bytes(hash, scale, sizeof(scale));
+  hash = _hash_bytes(hash, &module->iop_order, sizeof(module->iop_order));
+  hash = ((hash << 5) + hash) ^ distort;
+  return hash ? hash : 1;
+}
+
+// the part of a width x height buffer which isn't zero, an empty box if there is none
+static void _raster_bounding_box(const float *const buffer, const int width, const int height,
+                                 dt_masks_raster_box_t *box)
+{
+  int xmin = width, xmax = -1, ymin = height, ymax = -1;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, width, height) \
+  reduction(min : xmin, ymin) reduction(max : xmax, ymax) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const float *const row = buffer + (size_t)j * width;
+    int first = 0;
+    while(first < width && row[first] == 0.0f) first++;
+    if(first == width) continue;
+    int last = width - 1;
+    while(row[last] == 0.0f) last--;
+    xmin = MIN(xmin, first);
+    xmax = MAX(xmax, last);
+    ymin = MIN(ymin, j);
+    ymax = MAX(ymax, j);
+  }
+
+  if(xmax < 0)
+  {
+    box->x = box->y = box->width = box->height = 0;
+    return;
+  }
+  box->x = xmin;
+  box->y = ymin;
+  box->width = xmax - xmin + 1;
+  box->height = ymax - ymin + 1;
+}
+
+// move the box of a width wide buffer to its start, rows one after the other
+static void _raster_pack(float *const buffer, const int width, const dt_masks_raster_box_t *const box)
+{
+  if(box->width == width) // already in place if the box starts at row 0
+  {
+    if(box->y) memmove(buffer, buffer + (size_t)box->y * width, sizeof(float) * width * box->height);
+    return;
+  }
+  for(int j = 0; j < box->height; j++)
+    memmove(buffer + (size_t)j * box->width, buffer + (size_t)(box->y + j) * width + box->x,
+            sizeof(float) * box->width);
+}
+
+void dt_masks_raster_expand(float *const buffer, const dt_masks_raster_box_t *const box, const int width,
+                            const int height)
+{
+  const int bx = box->x, by = box->y, bw = box->width, bh = box->height;
+  if(bw == 0 || bh == 0)
+  {
+    memset(buffer, 0, sizeof(float) * width * height);
+    return;
+  }
+
+  // last row first, the packed rows are never behind their place in the roi
+  for(int j = bh - 1; j >= 0; j--)
+    memmove(buffer + (size_t)(by + j) * width + bx, buffer + (size_t)j * bw, sizeof(float) * bw);
+
+  memset(buffer, 0, sizeof(float) * width * by);
+  memset(buffer + (size_t)(by + bh) * width, 0, sizeof(float) * width * (height - by - bh));
+  if(bw == width) return;
+  for(int j = by; j < by + bh; j++)
+  {
+    float *const row = buffer + (size_t)j * width;
+    memset(row, 0, sizeof(float) * bx);
+    memset(row + bx + bw, 0, sizeof(float) * (width - bx - bw));
+  }
+}
+
+// drop the least recently used entries until `bytes' more fit. called with the lock held.
+static void _raster_cache_make_room(const size_t bytes)
+{
+  while(_cache.bytes + bytes > _cache.max_bytes && g_hash_table_size(_cache.entries))
+  {
+    GHashTableIter iter;
+    gpointer key, value;
+    _raster_entry_t *oldest = NULL;
+    g_hash_table_iter_init(&iter, _cache.entries);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      _raster_entry_t *entry = (_raster_entry_t *)value;
+      if(!oldest || entry->used < oldest->used) oldest = entry;
+    }
+    _cache.bytes -= oldest->bytes;
+    g_hash_table_remove(_cache.entries, &oldest->hash);
+  }
+}
+
+static void _raster_cache_insert(const uint64_t hash, const float *const data, const dt_masks_raster_box_t *box)
+{
+  const size_t values = (size_t)box->width * box->height;
+  const size_t bytes = sizeof(_raster_entry_t) + sizeof(float) * values;
+  // don't let a single full sized shape flush everything else
+  if(bytes > _cache.max_bytes / 4) return;
+
+  _raster_entry_t *entry = (_raster_entry_t *)calloc(1, sizeof(_raster_entry_t));
+  if(!entry) return;
+  if(values)
+  {
+    entry->data = dt_alloc_align_float(values);
+    if(!entry->data)
+    {
+      free(entry);
+      return;
+    }
+    memcpy(entry->data, data, sizeof(float) * values);
+  }
+  entry->hash = hash;
+  entry->box = *box;
+  entry->bytes = bytes;
+
+  dt_pthread_mutex_lock(&_cache.lock);
+  if(g_hash_table_contains(_cache.entries, &hash))
+  {
+    // another pipe was faster
+    dt_pthread_mutex_unlock(&_cache.lock);
+    _raster_entry_free(entry);
+    return;
+  }
+  _raster_cache_make_room(bytes);
+  entry->used = ++_cache.clock;
+  g_hash_table_insert(_cache.entries, &entry->hash, entry);
+  _cache.bytes += bytes;
+  dt_pthread_mutex_unlock(&_cache.lock);
+}
+
+int dt_masks_get_mask_roi_cached(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                                 dt_masks_form_t *const form, const dt_iop_roi_t *const roi, float *const buffer,
+                                 dt_masks_raster_box_t *box)
+{
+  const int width = roi->width;
+  const int height = roi->height;
+
+  // groups are a combination of cached shapes already
+  if(form->type & DT_MASKS_GROUP)
+  {
+    box->x = box->y = 0;
+    box->width = width;
+    box->height = height;
+    return dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+  }
+
+  const uint64_t hash = (_cache.entries && _cache.max_bytes) ? _raster_hash(module, piece, form, roi) : 0;
+  if(hash)
+  {
+    dt_pthread_mutex_lock(&_cache.lock);
+    _raster_entry_t *entry = (_raster_entry_t *)g_hash_table_lookup(_cache.entries, &hash);
+    if(entry)
+    {
+      entry->used = ++_cache.clock;
+      _cache.hits++;
+      *box = entry->box;
+      if(entry->data) memcpy(buffer, entry->data, sizeof(float) * box->width * box->height);
+      dt_pthread_mutex_unlock(&_cache.lock);
+      return 1;
+    }
+    _cache.misses++;
+    dt_pthread_mutex_unlock(&_cache.lock);
+  }
+
+  if(!dt_masks_get_mask_roi(module, piece, form, roi, buffer)) return 0;
+
+  _raster_bounding_box(buffer, width, height, box);
+  _raster_pack(buffer, width, box);
+  if(hash) _raster_cache_insert(hash, buffer, box);
+
+  return 1;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,181 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_arena.h"
+#include "common/darktable.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// every slab starts with this, padded to keep the buffer behind it aligned
+typedef struct _arena_slab_t
+{
+  size_t size; // usable bytes behind the header
+} _arena_slab_t;
+
+#define DT_ARENA_HEADER 64
+#define DT_ARENA_GRANULARITY 4096
+
+static inline _arena_slab_t *_slab_of(void *mem)
+{
+  return (_arena_slab_t *)((char *)mem - DT_ARENA_HEADER);
+}
+
+static inline void *_slab_mem(_arena_slab_t *slab)
+{
+  return __builtin_assume_aligned((char *)slab + DT_ARENA_HEADER, 64);
+}
+
+static gint _slab_sort_by_size(gconstpointer a, gconstpointer b)
+{
+  const size_t sa = ((const _arena_slab_t *)a)->size;
+  const size_t sb = ((const _arena_slab_t *)b)->size;
+  return (sa > sb) - (sa < sb);
+}
+
+void dt_dev_pixelpipe_arena_init(dt_dev_pixelpipe_arena_t *arena, const size_t max_free)
+{
+  dt_pthread_mutex_init(&arena->lock, NULL);
+  arena->free = NULL;
+  arena->free_bytes = 0;
+  arena->max_free = max_free;
+  arena->used_bytes = 0;
+  arena->peak_bytes = 0;
+  arena->requests = 0;
+  arena->reused = 0;
+}
+
+// release the largest free slabs until at most `keep' bytes are left. called with the lock held.
+static void _arena_shrink(dt_dev_pixelpipe_arena_t *arena, const size_t keep)
+{
+  GList *iter = g_list_last(arena->free);
+  while(iter && arena->free_bytes > keep)
+  {
+    GList *prev = g_list_previous(iter);
+    _arena_slab_t *slab = (_arena_slab_t *)iter->data;
+    arena->free_bytes -= slab->size;
+    arena->free = g_list_delete_link(arena->free, iter);
+    dt_free_align(slab);
+    iter = prev;
+  }
+}
+
+void dt_dev_pixelpipe_arena_cleanup(dt_dev_pixelpipe_arena_t *arena, const char *name)
+{
+  dt_print(DT_DEBUG_MEMORY,
+           "[pixelpipe_arena] [%s] peak %zu MB scratch, %" PRIu64 " of %" PRIu64 " requests reused a slab\n",
+           name, arena->peak_bytes >> 20, arena->reused, arena->requests);
+  if(arena->used_bytes)
+    fprintf(stderr, "[pixelpipe_arena] [%s] %zu bytes of scratch still in use at cleanup\n", name,
+            arena->used_bytes);
+
+  dt_pthread_mutex_lock(&arena->lock);
+  _arena_shrink(arena, 0);
+  dt_pthread_mutex_unlock(&arena->lock);
+  dt_pthread_mutex_destroy(&arena->lock);
+}
+
+void dt_dev_pixelpipe_arena_trim(dt_dev_pixelpipe_arena_t *arena)
+{
+  dt_pthread_mutex_lock(&arena->lock);
+  _arena_shrink(arena, arena->max_free);
+  dt_pthread_mutex_unlock(&arena->lock);
+}
+
+void *dt_dev_pixelpipe_arena_alloc(dt_dev_pixelpipe_arena_t *arena, const size_t size)
+{
+  const size_t wanted = MAX((size + DT_ARENA_GRANULARITY - 1) & ~(size_t)(DT_ARENA_GRANULARITY - 1),
+                            DT_ARENA_GRANULARITY);
+
+  dt_pthread_mutex_lock(&arena->lock);
+  arena->requests++;
+
+  // best fit, but don't waste more than a quarter of a slab on a smaller request
+  _arena_slab_t *slab = NULL;
+  for(GList *iter = arena->free; iter; iter = g_list_next(iter))
+  {
+    _arena_slab_t *s = (_arena_slab_t *)iter->data;
+    if(s->size < wanted) continue;
+    if(s->size - wanted <= s->size / 4)
+    {
+      slab = s;
+      arena->free = g_list_delete_link(arena->free, iter);
+      arena->free_bytes -= s->size;
+      arena->reused++;
+    }
+    break;
+  }
+
+  if(!slab)
+  {
+    slab = dt_alloc_align(64, DT_ARENA_HEADER + wanted);
+    if(!slab && arena->free)
+    {
+      // memory is tight, what we keep around won't help this request
+      _arena_shrink(arena, 0);
+      slab = dt_alloc_align(64, DT_ARENA_HEADER + wanted);
+    }
+    if(!slab)
+    {
+      dt_pthread_mutex_unlock(&arena->lock);
+      return NULL;
+    }
+    slab->size = wanted;
+  }
+
+  arena->used_bytes += slab->size;
+  arena->peak_bytes = MAX(arena->peak_bytes, arena->used_bytes);
+  dt_pthread_mutex_unlock(&arena->lock);
+  return _slab_mem(slab);
+}
+
+void dt_dev_pixelpipe_arena_free(dt_dev_pixelpipe_arena_t *arena, void *mem)
+{
+  if(!mem) return;
+  _arena_slab_t *slab = _slab_of(mem);
+
+  dt_pthread_mutex_lock(&arena->lock);
+  arena->used_bytes -= slab->size;
+  arena->free = g_list_insert_sorted(arena->free, slab, _slab_sort_by_size);
+  arena->free_bytes += slab->size;
+  dt_pthread_mutex_unlock(&arena->lock);
+}
+
+float *dt_dev_pixelpipe_scratch_alloc(dt_dev_pixelpipe_iop_t *piece, const size_t nfloats)
+{
+  return (float *)dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena, nfloats * sizeof(float));
+}
+
+float *dt_dev_pixelpipe_scratch_alloc_perthread(dt_dev_pixelpipe_iop_t *piece, const size_t nfloats,
+                                                size_t *padded_size)
+{
+  // same layout as dt_alloc_perthread(), one cache line aligned block per thread
+  const size_t cache_lines = (nfloats * sizeof(float) + 63) / 64;
+  *padded_size = 64 * cache_lines / sizeof(float);
+  return (float *)dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena, 64 * cache_lines * dt_get_num_threads());
+}
+
+void dt_dev_pixelpipe_scratch_free(dt_dev_pixelpipe_iop_t *piece, void *mem)
+{
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, mem);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,73 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/dtpthread.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_iop_t;
+
+/**
+ * scratch memory of one pixelpipe.
+ *
+ * modules and tiling need large temporary buffers on every run. instead of going
+ * to malloc (and the kernel, for page faults) each time, released buffers are kept
+ * as slabs and handed out again to the next request of about the same size, by any
+ * module and in any later run of the pipe. after each run the free slabs are trimmed
+ * to the `pixelpipe_scratch_memory' budget.
+ */
+
+typedef struct dt_dev_pixelpipe_arena_t
+{
+  dt_pthread_mutex_t lock;
+  GList *free;        // released slabs, smallest first
+  size_t free_bytes;  // bytes held by `free'
+  size_t max_free;    // bytes of `free' kept between runs
+  // statistics:
+  size_t used_bytes;  // bytes handed out right now
+  size_t peak_bytes;  // high-water mark of used_bytes
+  uint64_t requests;
+  uint64_t reused;    // requests served from `free'
+} dt_dev_pixelpipe_arena_t;
+
+void dt_dev_pixelpipe_arena_init(dt_dev_pixelpipe_arena_t *arena, const size_t max_free);
+// frees all slabs. everything handed out has to be released before.
+void dt_dev_pixelpipe_arena_cleanup(dt_dev_pixelpipe_arena_t *arena, const char *name);
+// drop free slabs beyond the budget, called at the end of each pipe run.
+void dt_dev_pixelpipe_arena_trim(dt_dev_pixelpipe_arena_t *arena);
+
+// 64 byte aligned buffer of at least `size' bytes, NULL if out of memory.
+void *dt_dev_pixelpipe_arena_alloc(dt_dev_pixelpipe_arena_t *arena, const size_t size);
+// give a buffer of dt_dev_pixelpipe_arena_alloc() back. NULL is ignored.
+void dt_dev_pixelpipe_arena_free(dt_dev_pixelpipe_arena_t *arena, void *mem);
+
+// the same for modules, from the arena of the pipe `piece' belongs to. these are
+// drop-in replacements of dt_alloc_align_float(), dt_alloc_perthread_float() and
+// dt_free_align() for scratch buffers that don't outlive process().
+float *dt_dev_pixelpipe_scratch_alloc(struct dt_dev_pixelpipe_iop_t *piece, const size_t nfloats);
+float *dt_dev_pixelpipe_scratch_alloc_perthread(struct dt_dev_pixelpipe_iop_t *piece, const size_t nfloats,
+                                                size_t *padded_size);
+void dt_dev_pixelpipe_scratch_free(struct dt_dev_pixelpipe_iop_t *piece, void *mem);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
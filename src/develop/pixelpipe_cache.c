@@ -17,9 +17,11 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/halffloat.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
+#include <math.h>
 #include <stdlib.h>
 
 
@@ -32,36 +34,69 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+// lines used by the current or the previous request are still in use by the pipe
+// (it reads the input while writing the output) and must never be handed out again.
+#define DT_PIXELPIPE_CACHE_MIN_AGE 2
+
+static dt_dev_pixelpipe_cache_line_t *_cache_line_new(dt_dev_pixelpipe_cache_t *cache, const size_t size)
 {
-  cache->entries = entries;
-  cache->data = (void **)calloc(entries, sizeof(void *));
-  cache->size = (size_t *)calloc(entries, sizeof(size_t));
-  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
-#ifdef _DEBUG
-  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
-#endif
-  cache->basichash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
-  for(int k = 0; k < entries; k++)
-  {
-    cache->size[k] = size;
-    if(size)
-    { // allow 0 initial buffer size (yet unknown dimensions)
-      cache->data[k] = (void *)dt_alloc_align(64, size);
-      if(!cache->data[k]) goto alloc_memory_fail;
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_line_t));
+  if(!line) return NULL;
+  if(size)
+  { // allow 0 initial buffer size (yet unknown dimensions)
+    line->data = (void *)dt_alloc_align(64, size);
+    if(!line->data)
+    {
+      free(line);
+      return NULL;
+    }
 #ifdef _DEBUG
-      memset(cache->data[k], 0x5d, size);
+    memset(line->data, 0x5d, size);
+    memset(&line->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t));
 #endif
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
-    }
-    else cache->data[k] = 0;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
+    ASAN_POISON_MEMORY_REGION(line->data, size);
   }
+  line->size = size;
+  line->basichash = -1;
+  line->hash = -1;
+  line->used = cache->clock - DT_PIXELPIPE_CACHE_MIN_AGE;
+  cache->memory += size;
+  g_ptr_array_add(cache->lines, line);
+  return line;
+}
+
+static void _cache_line_free(gpointer data)
+{
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)data;
+  dt_free_align(line->data);
+  free(line);
+}
+
+// drop the line from the hash index, keeping its memory
+static void _cache_line_clear(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  if(line->hash != (uint64_t)-1) g_hash_table_remove(cache->index, &line->hash);
+  line->basichash = -1;
+  line->hash = -1;
+  line->cost = 0.0f;
+  line->half = line->rounded = line->keep_float = FALSE;
+  ASAN_POISON_MEMORY_REGION(line->data, line->size);
+}
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t max_memory)
+{
+  cache->entries = entries;
+  cache->lines = g_ptr_array_new_with_free_func(_cache_line_free);
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  cache->memory = 0;
+  cache->max_memory = MAX(max_memory, entries * size);
+  cache->clock = 0;
+  cache->pinned = NULL;
+  cache->fp16 = FALSE;
   cache->queries = cache->misses = 0;
+  for(int k = 0; k < entries; k++)
+    if(!_cache_line_new(cache, size)) goto alloc_memory_fail;
   return 1;
 
 alloc_memory_fail:
@@ -70,24 +105,19 @@ alloc_memory_fail:
   // should not cleanup the whole pixelpipe cache but only reset the buffers to null.
   // A warning about low memory will appear but the pipeline still has valid data so dt won't crash
   // but will only fail to generate thumbnails for example.
-  for(int k = 0; k < cache->entries; k++)
-  {
-    dt_free_align(cache->data[k]);
-    cache->size[k] = 0;
-    cache->data[k] = NULL;
-  }
+  g_ptr_array_set_size(cache->lines, 0);
+  cache->memory = 0;
   return 0;
 }
 
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
-  free(cache->data);
-  free(cache->dsc);
-  free(cache->basichash);
-  free(cache->hash);
-  free(cache->used);
-  free(cache->size);
+  g_hash_table_destroy(cache->index);
+  g_hash_table_destroy(cache->stats);
+  g_ptr_array_free(cache->lines, TRUE);
+  cache->index = cache->stats = NULL;
+  cache->lines = NULL;
+  cache->memory = 0;
 }
 
 uint64_t dt_dev_pixelpipe_cache_basichash(int imgid, struct dt_dev_pixelpipe_t *pipe, int module)
@@ -166,19 +196,29 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
   return hash;
 }
 
+static dt_dev_pixelpipe_cache_line_t *_cache_line_for_data(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  for(guint k = 0; k < cache->lines->len; k++)
+  {
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    if(line->data == data) return line;
+  }
+  return NULL;
+}
+
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
-  // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  return g_hash_table_contains(cache->index, &hash);
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash,
                                          const uint64_t hash, const size_t size,
                                          void **data, dt_iop_buffer_dsc_t **dsc)
 {
-  return dt_dev_pixelpipe_cache_get_weighted(cache, basichash, hash, size, data, dsc, -cache->entries);
+  const int res = dt_dev_pixelpipe_cache_get_weighted(cache, basichash, hash, size, data, dsc, -cache->entries);
+  // this is the pipe's output, the gui keeps drawing it while the next run goes on
+  cache->pinned = *data ? _cache_line_for_data(cache, *data) : NULL;
+  return res;
 }
 
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash, const uint64_t hash,
@@ -187,122 +227,362 @@ int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t b
   return dt_dev_pixelpipe_cache_get_weighted(cache, basichash, hash, size, data, dsc, 0);
 }
 
-int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash, const uint64_t hash,
-                                        const size_t size, void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+// which line to drop first: the one freeing most memory for the least recompute time,
+// older lines first. unused lines go before everything else.
+static double _cache_line_score(const dt_dev_pixelpipe_cache_t *cache, const dt_dev_pixelpipe_cache_line_t *line)
 {
-  cache->queries++;
-  *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
-  for(int k = 0; k < cache->entries; k++)
+  const int64_t age = cache->clock - line->used;
+  if(age < DT_PIXELPIPE_CACHE_MIN_AGE || line == cache->pinned) return -1.0;
+  if(line->hash == (uint64_t)-1) return INFINITY;
+  return (double)age * (double)(line->size + 1) / (1.0 + line->cost);
+}
+
+static dt_dev_pixelpipe_cache_line_t *_cache_find_victim(dt_dev_pixelpipe_cache_t *cache,
+                                                   const dt_dev_pixelpipe_cache_line_t *keep)
+{
+  dt_dev_pixelpipe_cache_line_t *victim = NULL;
+  double max_score = -1.0;
+  for(guint k = 0; k < cache->lines->len; k++)
   {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    if(line == keep) continue;
+    const double score = _cache_line_score(cache, line);
+    if(score > max_score)
     {
-      max_used = cache->used[k];
-      max = k;
-    }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
-
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
+      max_score = score;
+      victim = line;
     }
   }
+  return victim;
+}
 
-  if(!*data || sz < size)
+static gboolean _cache_line_compressible(const dt_dev_pixelpipe_cache_t *cache,
+                                         const dt_dev_pixelpipe_cache_line_t *line)
+{
+  return line->hash != (uint64_t)-1 && !line->half && !line->keep_float && line->dsc.channels == 4
+         && line->dsc.datatype == TYPE_FLOAT && _cache_line_score(cache, line) >= 0.0;
+}
+
+// store the line as half floats, FALSE if out of memory
+static gboolean _cache_line_compress(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  const size_t n = line->bytes / sizeof(float);
+  uint16_t *half = (uint16_t *)dt_alloc_align(64, n * sizeof(uint16_t));
+  if(!half) return FALSE;
+  ASAN_UNPOISON_MEMORY_REGION(line->data, line->bytes);
+  dt_float_to_half_buf(half, (const float *)line->data, n);
+  cache->memory -= line->size;
+  dt_free_align(line->data);
+  line->data = half;
+  line->size = n * sizeof(uint16_t);
+  cache->memory += line->size;
+  line->half = line->rounded = TRUE;
+  return TRUE;
+}
+
+// back to floats, FALSE if out of memory
+static gboolean _cache_line_expand(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  float *full = (float *)dt_alloc_align(64, line->bytes);
+  if(!full) return FALSE;
+  dt_half_to_float_buf(full, (const uint16_t *)line->data, line->bytes / sizeof(float));
+  cache->memory -= line->size;
+  dt_free_align(line->data);
+  line->data = full;
+  line->size = line->bytes;
+  cache->memory += line->size;
+  line->half = FALSE;
+  return TRUE;
+}
+
+// store the least valuable lines as half floats until another `size' bytes fit into the
+// budget. returns TRUE if they do.
+static gboolean _cache_compress(dt_dev_pixelpipe_cache_t *cache, const dt_dev_pixelpipe_cache_line_t *keep,
+                                const size_t size)
+{
+  while(cache->memory + size > cache->max_memory)
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
-    // weight);
-    if(cache->size[max] < size)
+    dt_dev_pixelpipe_cache_line_t *candidate = NULL;
+    double max_score = -1.0;
+    for(guint k = 0; k < cache->lines->len; k++)
     {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(64, size);
-      cache->size[max] = size;
+      dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+      if(line == keep || !_cache_line_compressible(cache, line)) continue;
+      const double score = _cache_line_score(cache, line);
+      if(score > max_score)
+      {
+        max_score = score;
+        candidate = line;
+      }
     }
-    *data = cache->data[max];
-    sz = cache->size[max];
+    if(!candidate || !_cache_line_compress(cache, candidate)) return FALSE;
+  }
+  return TRUE;
+}
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
-    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+// `query' is FALSE for side buffers, which neither age the other lines nor count in the statistics
+static int _cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash, const uint64_t hash,
+                      const size_t size, void **data, dt_iop_buffer_dsc_t **dsc, int weight, const gboolean query)
+{
+  if(query)
+  {
+    cache->queries++;
+    cache->clock++; // age all entries
+  }
+  *data = NULL;
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
+  // search for hash in cache
+  dt_dev_pixelpipe_cache_line_t *line = g_hash_table_lookup(cache->index, &hash);
+  if(line && line->half && line->bytes >= size && !_cache_line_expand(cache, line))
+  {
+    // no memory to expand it, it will be computed again
+    dt_print(DT_DEBUG_MEMORY, "[pixelpipe_cache_get] failed to expand half float line of %zu bytes\n",
+             line->bytes);
+    _cache_line_clear(cache, line);
+  }
+  else if(line && !line->half && line->size >= size)
+  {
+    line->used = cache->clock - weight; // this is the MRU entry
+    *data = line->data;
+    *dsc = &line->dsc;
+
+    ASAN_POISON_MEMORY_REGION(*data, line->size);
+    ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
+  }
 
-    cache->basichash[max] = basichash;
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
-    cache->misses++;
-    return 1;
+  // the pinned line may still be read, it can't grow
+  if(line && line == cache->pinned)
+  {
+    _cache_line_clear(cache, line);
+    line = NULL;
+  }
+  // a too small line with this hash is reused right away. otherwise grow while within
+  // the memory budget, else drop the least valuable line.
+  if(!line)
+  {
+    dt_dev_pixelpipe_cache_line_t *victim = _cache_find_victim(cache, NULL);
+    // rather keep everything at half the size than drop the victim
+    if(victim && victim->hash != (uint64_t)-1 && cache->fp16 && _cache_compress(cache, NULL, size))
+      victim = NULL;
+    if(victim && (victim->hash == (uint64_t)-1 || cache->memory + size > cache->max_memory))
+      line = victim;
+  }
+  if(line)
+  {
+    _cache_line_clear(cache, line);
+    if(line->size < size)
+    {
+      cache->memory -= line->size;
+      dt_free_align(line->data);
+      line->data = (void *)dt_alloc_align(64, size);
+      line->size = line->data ? size : 0;
+      cache->memory += line->size;
+    }
   }
   else
-    return 0;
+  {
+    // all lines are in use, we have to exceed the budget
+    line = _cache_line_new(cache, size);
+  }
+  if(!line || !line->data)
+  {
+    // out of memory, there is nothing we can hand out
+    dt_print(DT_DEBUG_MEMORY, "[pixelpipe_cache_get] failed to allocate %zu bytes\n", size);
+    return -1;
+  }
+
+  // drop lines until we're within the budget again, keeping the minimal number of lines
+  if(cache->fp16) _cache_compress(cache, line, 0);
+  while(cache->memory > cache->max_memory && cache->lines->len > cache->entries)
+  {
+    dt_dev_pixelpipe_cache_line_t *victim = _cache_find_victim(cache, line);
+    if(!victim) break;
+    _cache_line_clear(cache, victim);
+    cache->memory -= victim->size;
+    g_ptr_array_remove_fast(cache->lines, victim);
+  }
+
+  *data = line->data;
+
+  ASAN_POISON_MEMORY_REGION(*data, line->size);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  line->dsc = **dsc;
+  *dsc = &line->dsc;
+
+  line->basichash = basichash;
+  line->hash = hash;
+  line->used = cache->clock - weight;
+  line->cost = 0.0f;
+  line->bytes = size;
+  g_hash_table_insert(cache->index, &line->hash, line);
+  if(query) cache->misses++;
+  return 1;
+}
+
+int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash, const uint64_t hash,
+                                        const size_t size, void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  return _cache_get(cache, basichash, hash, size, data, dsc, weight, TRUE);
+}
+
+int dt_dev_pixelpipe_cache_get_copy(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, void *data,
+                                    const size_t size)
+{
+  dt_dev_pixelpipe_cache_line_t *line = g_hash_table_lookup(cache->index, &hash);
+  if(!line || line->half || line->bytes != size) return 1;
+  line->used = cache->clock;
+  memcpy(data, line->data, size);
+  return 0;
+}
+
+void dt_dev_pixelpipe_cache_put_copy(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const void *data,
+                                     const size_t size, const double ms)
+{
+  if(hash == (uint64_t)-1 || g_hash_table_contains(cache->index, &hash)) return;
+
+  dt_iop_buffer_dsc_t side = { 0 };
+  side.channels = 1;
+  side.datatype = TYPE_FLOAT;
+  dt_iop_buffer_dsc_t *dsc = &side;
+  void *buf = NULL;
+  _cache_get(cache, 0, hash, size, &buf, &dsc, 0, FALSE);
+  if(!buf) return;
+
+  memcpy(buf, data, size);
+  dt_dev_pixelpipe_cache_line_t *line = _cache_line_for_data(cache, buf);
+  line->cost = ms;
+  line->keep_float = TRUE;
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++)
+  for(guint k = 0; k < cache->lines->len; k++)
   {
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
-    ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    _cache_line_clear(cache, line);
+    line->used = cache->clock - DT_PIXELPIPE_CACHE_MIN_AGE;
+  }
+}
+
+void dt_dev_pixelpipe_cache_release(dt_dev_pixelpipe_cache_t *cache)
+{
+  dt_dev_pixelpipe_cache_flush(cache);
+  cache->pinned = NULL;
+  for(guint k = 0; k < cache->lines->len; k++)
+  {
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    cache->memory -= line->size;
+    dt_free_align(line->data);
+    line->data = NULL;
+    line->size = 0;
   }
 }
 
 void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint64_t basichash)
 {
-  for(int k = 0; k < cache->entries; k++)
+  for(guint k = 0; k < cache->lines->len; k++)
   {
-    if (cache->basichash[k] == basichash)
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    if(line->basichash == basichash)
       continue;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
-    ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+    _cache_line_clear(cache, line);
+    line->used = cache->clock - DT_PIXELPIPE_CACHE_MIN_AGE;
   }
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
-  for(int k = 0; k < cache->entries; k++)
+  dt_dev_pixelpipe_cache_line_t *line = _cache_line_for_data(cache, data);
+  if(line) line->used = cache->clock + cache->entries;
+}
+
+void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  dt_dev_pixelpipe_cache_line_t *line = _cache_line_for_data(cache, data);
+  if(line) _cache_line_clear(cache, line);
+}
+
+void dt_dev_pixelpipe_cache_keep_float(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  dt_dev_pixelpipe_cache_line_t *line = data ? _cache_line_for_data(cache, data) : NULL;
+  if(line) line->keep_float = TRUE;
+}
+
+int dt_dev_pixelpipe_cache_rounded(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  const dt_dev_pixelpipe_cache_line_t *line = data ? _cache_line_for_data(cache, data) : NULL;
+  return line && line->rounded;
+}
+
+void dt_dev_pixelpipe_cache_inherit_rounded(dt_dev_pixelpipe_cache_t *cache, void *output, void *input)
+{
+  if(!cache->fp16 || !dt_dev_pixelpipe_cache_rounded(cache, input)) return;
+  dt_dev_pixelpipe_cache_line_t *line = output ? _cache_line_for_data(cache, output) : NULL;
+  if(line) line->rounded = TRUE;
+}
+
+void dt_dev_pixelpipe_cache_invalidate_rounded(dt_dev_pixelpipe_cache_t *cache)
+{
+  for(guint k = 0; k < cache->lines->len; k++)
   {
-    if(cache->data[k] == data)
-    {
-      cache->used[k] = -cache->entries;
-    }
+    dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
+    if(line->rounded) _cache_line_clear(cache, line);
   }
 }
 
-void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
+static dt_dev_pixelpipe_cache_stats_t *_cache_stats(dt_dev_pixelpipe_cache_t *cache, const char *op)
 {
-  for(int k = 0; k < cache->entries; k++)
+  dt_dev_pixelpipe_cache_stats_t *stats = g_hash_table_lookup(cache->stats, op);
+  if(!stats)
   {
-    if(cache->data[k] == data)
-    {
-      cache->basichash[k] = -1;
-      cache->hash[k] = -1;
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
-    }
+    stats = (dt_dev_pixelpipe_cache_stats_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_stats_t));
+    g_hash_table_insert(cache->stats, g_strdup(op), stats);
   }
+  return stats;
+}
+
+void dt_dev_pixelpipe_cache_processed(dt_dev_pixelpipe_cache_t *cache, void *data, const char *op, const double ms)
+{
+  dt_dev_pixelpipe_cache_line_t *line = _cache_line_for_data(cache, data);
+  if(line) line->cost = ms;
+  if(!op) return;
+  dt_dev_pixelpipe_cache_stats_t *stats = _cache_stats(cache, op);
+  stats->misses++;
+  stats->recompute_ms += ms;
+}
+
+void dt_dev_pixelpipe_cache_reused(dt_dev_pixelpipe_cache_t *cache, const char *op)
+{
+  if(!op) return;
+  _cache_stats(cache, op)->hits++;
 }
 
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++)
+  for(guint k = 0; k < cache->lines->len; k++)
   {
+    const dt_dev_pixelpipe_cache_line_t *line = g_ptr_array_index(cache->lines, k);
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 " (%" PRIu64 ")", cache->used[k], cache->hash[k], cache->basichash[k]);
+    printf("age %" PRId64 " by %" PRIu64 " (%" PRIu64 ") size %zu cost %.1fms%s", cache->clock - line->used,
+           line->hash, line->basichash, line->size, line->cost, line->half ? " half" : "");
     printf("\n");
   }
+  printf("cache memory %zu of %zu MB in %u lines\n", cache->memory >> 20, cache->max_memory >> 20,
+         cache->lines->len);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cache->stats);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const dt_dev_pixelpipe_cache_stats_t *stats = (dt_dev_pixelpipe_cache_stats_t *)value;
+    printf("  %-20s hits %6" PRIu64 " misses %6" PRIu64 " recompute %9.1fms\n", (const char *)key, stats->hits,
+           stats->misses, stats->recompute_ms);
+  }
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
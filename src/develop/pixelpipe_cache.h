@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include "develop/format.h"
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -25,32 +27,64 @@ struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
 /**
- * implements a simple pixel cache suitable for caching float images
+ * implements a pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * cache lines have variable size and are found through a hash index. the cache
+ * keeps at least `entries' lines and grows beyond that as long as all lines
+ * together fit into a memory budget. when a line has to be dropped, the one
+ * freeing the most memory for the least expected recompute time goes first.
+ * optionally, rgba float lines are first stored as half floats, which keeps them
+ * at half the memory. they are expanded again when they are asked for.
  */
 
+typedef struct dt_dev_pixelpipe_cache_line_t
+{
+  void *data;
+  size_t size;
+  struct dt_iop_buffer_dsc_t dsc;
+  uint64_t basichash;
+  uint64_t hash;
+  // query count of the last use, minus the weight. the age of a line is clock - used.
+  int64_t used;
+  // time in ms the module took to compute this line
+  float cost;
+  // bytes asked for by the last request, the float size of a half line
+  size_t bytes;
+  gboolean half;       // data holds half floats, size is bytes / 2
+  gboolean rounded;    // data went through half floats, or was computed from such
+  gboolean keep_float; // never store it as half floats
+} dt_dev_pixelpipe_cache_line_t;
+
+// per module statistics
+typedef struct dt_dev_pixelpipe_cache_stats_t
+{
+  uint64_t hits;
+  uint64_t misses;
+  double recompute_ms;
+} dt_dev_pixelpipe_cache_stats_t;
+
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t entries;
-  void **data;
-  size_t *size;
-  struct dt_iop_buffer_dsc_t *dsc;
-  uint64_t *basichash;
-  uint64_t *hash;
-  int32_t *used;
-#ifdef HAVE_OPENCL
-  void **gpu_mem;
-#endif
+  int32_t entries; // minimal number of lines
+  GPtrArray *lines;
+  GHashTable *index; // hash -> line
+  size_t memory, max_memory;
+  int64_t clock;
+  // line of the last important request, it's never handed out again or freed
+  dt_dev_pixelpipe_cache_line_t *pinned;
+  // store lines as half floats before dropping them
+  gboolean fp16;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  GHashTable *stats; // module op -> dt_dev_pixelpipe_cache_stats_t
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+  the cache keeps up to max_memory bytes, at least entries * size.
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t max_memory);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -67,7 +101,8 @@ uint64_t dt_dev_pixelpipe_cache_basichash_prior(int imgid, struct dt_dev_pixelpi
 
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
   * cache line, the least recently used cache line will be cleared and an empty buffer is returned
-  * together with a non-zero return value. */
+  * together with a return value of 1. returns -1 and sets *data to NULL if there is no memory for
+  * the buffer. */
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash, const uint64_t hash,
                                const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc);
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash,
@@ -77,12 +112,24 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
                                         const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
+/** side buffers of a module, like its blend mask, share the memory budget with the module outputs.
+  they are copied in and out, and looking them up doesn't age other lines, so the buffers of the
+  module being processed stay where they are. get_copy returns 0 if hash was found, put_copy stores
+  size bytes of data which took ms milliseconds to compute. */
+int dt_dev_pixelpipe_cache_get_copy(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, void *data,
+                                    const size_t size);
+void dt_dev_pixelpipe_cache_put_copy(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const void *data,
+                                     const size_t size, const double ms);
+
 /** test availability of a cache line without destroying another, if it is not found. */
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
 
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** invalidates all cachelines and frees their memory, they are allocated again at the size asked for next */
+void dt_dev_pixelpipe_cache_release(dt_dev_pixelpipe_cache_t *cache);
+
 /** invalidates all cachelines except those containing items for the given module/parameter combination */
 void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint64_t basichash);
 
@@ -92,6 +139,24 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** the line holding data was just computed by module op, taking ms milliseconds. */
+void dt_dev_pixelpipe_cache_processed(dt_dev_pixelpipe_cache_t *cache, void *data, const char *op, const double ms);
+
+/** the output of module op was taken from the cache. */
+void dt_dev_pixelpipe_cache_reused(dt_dev_pixelpipe_cache_t *cache, const char *op);
+
+/** never store this buffer as half floats, its consumer needs full precision. */
+void dt_dev_pixelpipe_cache_keep_float(dt_dev_pixelpipe_cache_t *cache, void *data);
+
+/** returns non-zero if this buffer was stored as half floats, or computed from such a buffer. */
+int dt_dev_pixelpipe_cache_rounded(dt_dev_pixelpipe_cache_t *cache, void *data);
+
+/** output was computed from input, so it is rounded if input was. */
+void dt_dev_pixelpipe_cache_inherit_rounded(dt_dev_pixelpipe_cache_t *cache, void *output, void *input);
+
+/** invalidates all cachelines that are rounded. */
+void dt_dev_pixelpipe_cache_invalidate_rounded(dt_dev_pixelpipe_cache_t *cache);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
@@ -0,0 +1,267 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_disk_cache.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_PIPE_DISK_CACHE_DIR "pixelpipe"
+#define DT_PIPE_DISK_CACHE_MAGIC "dtpipe01"
+
+typedef struct _disk_cache_header_t
+{
+  char magic[8];
+  uint64_t key;
+  uint64_t size;
+  dt_iop_buffer_dsc_t dsc;
+} _disk_cache_header_t;
+
+typedef struct _disk_cache_file_t
+{
+  gchar *filename;
+  gint64 mtime;
+  size_t size;
+} _disk_cache_file_t;
+
+// bytes currently used by the cache directory, -1 until it has been scanned once
+static GMutex _disk_cache_lock;
+static int64_t _disk_cache_used = -1;
+static gint _disk_cache_tmp_counter = 0;
+
+static void _disk_cache_dir(char *dir, const size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dir, size, "%s/" DT_PIPE_DISK_CACHE_DIR, cachedir);
+}
+
+static void _disk_cache_filename(const uint64_t key, char *filename, const size_t size)
+{
+  char dir[PATH_MAX] = { 0 };
+  _disk_cache_dir(dir, sizeof(dir));
+  snprintf(filename, size, "%s/%016" PRIx64 ".dtpipe", dir, key);
+}
+
+void dt_dev_pixelpipe_disk_cache_prepare(dt_dev_pixelpipe_t *pipe)
+{
+  g_strfreev(pipe->disk_cache_ops);
+  pipe->disk_cache_ops = NULL;
+
+  if((pipe->type & DT_DEV_PIXELPIPE_ANY) != DT_DEV_PIXELPIPE_EXPORT) return;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return;
+  // the details mask is written by demosaic or rawprepare while they run, it isn't stored with the buffers
+  if(pipe->want_detail_mask & DT_DEV_DETAIL_MASK_REQUIRED) return;
+  if(!dt_conf_get_bool("cache_pixelpipe_disk")) return;
+
+  // a raster mask is produced while its module runs. skipping that module would leave
+  // the consumer without its mask, so don't skip anything in such pipes.
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && piece->module->raster_mask.sink.source) return;
+  }
+
+  gchar *ops = dt_conf_get_string("cache_pixelpipe_disk_modules");
+  pipe->disk_cache_ops = g_strsplit(ops, ",", -1);
+  g_free(ops);
+  for(int k = 0; pipe->disk_cache_ops[k]; k++) g_strstrip(pipe->disk_cache_ops[k]);
+}
+
+gboolean dt_dev_pixelpipe_disk_cache_wanted(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module)
+{
+  if(!module || !pipe->disk_cache_ops) return FALSE;
+  for(int k = 0; pipe->disk_cache_ops[k]; k++)
+    if(!strcmp(pipe->disk_cache_ops[k], module->op)) return TRUE;
+  return FALSE;
+}
+
+uint64_t dt_dev_pixelpipe_disk_cache_key(const dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  // the pixelpipe hash only covers image id, history and roi. image ids are reused after
+  // removal and modules may change between releases, so mix in what identifies both.
+  uint64_t key = 5381;
+  const char *str = (const char *)&hash;
+  for(size_t i = 0; i < sizeof(hash); i++) key = ((key << 5) + key) ^ str[i];
+  for(str = pipe->image.filename; *str; str++) key = ((key << 5) + key) ^ *str;
+  for(str = darktable_package_version; *str; str++) key = ((key << 5) + key) ^ *str;
+  const int64_t ident[] = { pipe->image.film_id, pipe->image.import_timestamp, pipe->iwidth, pipe->iheight };
+  str = (const char *)ident;
+  for(size_t i = 0; i < sizeof(ident); i++) key = ((key << 5) + key) ^ str[i];
+  return key;
+}
+
+gboolean dt_dev_pixelpipe_disk_cache_contains(const uint64_t key, const size_t size)
+{
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_filename(key, filename, sizeof(filename));
+  GStatBuf st;
+  return !g_stat(filename, &st) && (size_t)st.st_size == sizeof(_disk_cache_header_t) + size;
+}
+
+int dt_dev_pixelpipe_disk_cache_read(const uint64_t key, void *data, const size_t size, dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_filename(key, filename, sizeof(filename));
+
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 1;
+
+  _disk_cache_header_t header;
+  int err = fread(&header, sizeof(header), 1, f) != 1
+            || memcmp(header.magic, DT_PIPE_DISK_CACHE_MAGIC, sizeof(header.magic))
+            || header.key != key || header.size != size
+            || fread(data, 1, size, f) != size;
+  fclose(f);
+
+  if(err)
+  {
+    fprintf(stderr, "[pixelpipe_disk_cache] dropping unusable `%s'\n", filename);
+    g_unlink(filename);
+    return 1;
+  }
+
+  *dsc = header.dsc;
+  // the file modification time is what the eviction goes by
+  g_utime(filename, NULL);
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_disk_cache] read %016" PRIx64 " (%zu MB)\n", key, size >> 20);
+  return 0;
+}
+
+static gint _disk_cache_sort_by_mtime(gconstpointer a, gconstpointer b)
+{
+  const _disk_cache_file_t *fa = (const _disk_cache_file_t *)a;
+  const _disk_cache_file_t *fb = (const _disk_cache_file_t *)b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static GList *_disk_cache_scan(const char *dir, int64_t *used)
+{
+  GList *files = NULL;
+  *used = 0;
+  GDir *d = g_dir_open(dir, 0, NULL);
+  if(!d) return NULL;
+
+  const gchar *name;
+  while((name = g_dir_read_name(d)))
+  {
+    gchar *filename = g_build_filename(dir, name, NULL);
+    GStatBuf st;
+    if(g_stat(filename, &st) || !S_ISREG(st.st_mode))
+    {
+      g_free(filename);
+      continue;
+    }
+    _disk_cache_file_t *file = g_malloc(sizeof(_disk_cache_file_t));
+    file->filename = filename;
+    file->mtime = st.st_mtime;
+    file->size = st.st_size;
+    files = g_list_prepend(files, file);
+    *used += st.st_size;
+  }
+  g_dir_close(d);
+  return g_list_sort(files, _disk_cache_sort_by_mtime);
+}
+
+static void _disk_cache_free_file(gpointer data)
+{
+  _disk_cache_file_t *file = (_disk_cache_file_t *)data;
+  g_free(file->filename);
+  g_free(file);
+}
+
+// account for `size' new bytes and drop the oldest files while over budget. called with the lock held.
+static void _disk_cache_trim(const char *dir, const size_t size)
+{
+  const int64_t max_size = dt_conf_get_int64("cache_pixelpipe_disk_size");
+
+  if(_disk_cache_used < 0)
+    g_list_free_full(_disk_cache_scan(dir, &_disk_cache_used), _disk_cache_free_file);
+  else
+    _disk_cache_used += size;
+
+  if(_disk_cache_used <= max_size) return;
+
+  // shrink a bit below the budget so not every write has to rescan the directory
+  GList *files = _disk_cache_scan(dir, &_disk_cache_used);
+  for(GList *iter = files; iter && _disk_cache_used > max_size - max_size / 8; iter = g_list_next(iter))
+  {
+    _disk_cache_file_t *file = (_disk_cache_file_t *)iter->data;
+    if(!g_unlink(file->filename)) _disk_cache_used -= file->size;
+  }
+  g_list_free_full(files, _disk_cache_free_file);
+}
+
+int dt_dev_pixelpipe_disk_cache_write(const uint64_t key, const void *data, const size_t size,
+                                      const dt_iop_buffer_dsc_t *dsc)
+{
+  const int64_t max_size = dt_conf_get_int64("cache_pixelpipe_disk_size");
+  if((int64_t)(sizeof(_disk_cache_header_t) + size) > max_size) return 1;
+
+  char dir[PATH_MAX] = { 0 };
+  _disk_cache_dir(dir, sizeof(dir));
+  if(g_mkdir_with_parents(dir, 0750)) return 1;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_filename(key, filename, sizeof(filename));
+
+  // write to a unique temporary file and rename it, so concurrent exports and
+  // crashes never leave a half written buffer under the final name
+  gchar *tmpname = g_strdup_printf("%s.%d.tmp", filename, g_atomic_int_add(&_disk_cache_tmp_counter, 1));
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f)
+  {
+    g_free(tmpname);
+    return 1;
+  }
+
+  _disk_cache_header_t header = { { 0 } };
+  memcpy(header.magic, DT_PIPE_DISK_CACHE_MAGIC, sizeof(header.magic));
+  header.key = key;
+  header.size = size;
+  header.dsc = *dsc;
+
+  int err = fwrite(&header, sizeof(header), 1, f) != 1 || fwrite(data, 1, size, f) != size;
+  err = fclose(f) || err;
+  if(err || g_rename(tmpname, filename))
+  {
+    fprintf(stderr, "[pixelpipe_disk_cache] failed to write `%s'\n", filename);
+    g_unlink(tmpname);
+    g_free(tmpname);
+    return 1;
+  }
+  g_free(tmpname);
+
+  g_mutex_lock(&_disk_cache_lock);
+  _disk_cache_trim(dir, sizeof(header) + size);
+  g_mutex_unlock(&_disk_cache_lock);
+
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_disk_cache] wrote %016" PRIx64 " (%zu MB)\n", key, size >> 20);
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,61 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "develop/format.h"
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+struct dt_iop_module_t;
+
+// persistent cache for the output of a few expensive, early modules of export pipes.
+//
+// re-exporting an image with only late changes (size, watermark, output profile)
+// would otherwise run demosaic and denoising again. the buffers are stored
+// losslessly in the user's cache directory, one file per intermediate, named after
+// the pixelpipe hash of that module output. the hash is salted with the image file
+// identity and darktable's version so stale files are never picked up.
+
+// decide which modules of `pipe' go through the disk cache, once per run of the pipe.
+void dt_dev_pixelpipe_disk_cache_prepare(struct dt_dev_pixelpipe_t *pipe);
+
+// TRUE if the output of `module' in `pipe' should be looked up in and stored to the disk cache.
+gboolean dt_dev_pixelpipe_disk_cache_wanted(const struct dt_dev_pixelpipe_t *pipe,
+                                            const struct dt_iop_module_t *module);
+
+// turn the pixelpipe cache hash of a module output into the disk cache key.
+uint64_t dt_dev_pixelpipe_disk_cache_key(const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash);
+
+// cheap check (a single stat) whether a buffer of `size' bytes is stored for `key'.
+gboolean dt_dev_pixelpipe_disk_cache_contains(const uint64_t key, const size_t size);
+
+// read the buffer stored for `key' into `data'. returns 0 on success.
+int dt_dev_pixelpipe_disk_cache_read(const uint64_t key, void *data, const size_t size, dt_iop_buffer_dsc_t *dsc);
+
+// store `size' bytes of `data' for `key', evicting the least recently used
+// files if the cache grows beyond its budget. returns 0 on success.
+int dt_dev_pixelpipe_disk_cache_write(const uint64_t key, const void *data, const size_t size,
+                                      const dt_iop_buffer_dsc_t *dsc);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -20,13 +20,16 @@
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
+#include "common/trace.h"
 #include "common/iop_order.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_disk_cache.h"
 #include "develop/tiling.h"
 #include "develop/masks.h"
 #include "gui/gtk.h"
@@ -52,7 +55,8 @@ typedef enum dt_pixelpipe_flow_t
   PIXELPIPE_FLOW_PROCESSED_ON_GPU = 1 << 4,
   PIXELPIPE_FLOW_PROCESSED_WITH_TILING = 1 << 5,
   PIXELPIPE_FLOW_BLENDED_ON_CPU = 1 << 6,
-  PIXELPIPE_FLOW_BLENDED_ON_GPU = 1 << 7
+  PIXELPIPE_FLOW_BLENDED_ON_GPU = 1 << 7,
+  PIXELPIPE_FLOW_OPENCL_FALLBACK = 1 << 8
 } dt_pixelpipe_flow_t;
 
 typedef enum dt_pixelpipe_picker_source_t
@@ -164,8 +168,15 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  // pipes of unknown size (darkroom) keep intermediates up to a memory budget, the others stay at their lines
+  const size_t max_memory = size ? 0 : (size_t)MAX(dt_conf_get_int64("pixelpipe_cache_memory"), 0);
+  dt_dev_pixelpipe_arena_init(&pipe->arena, (size_t)MAX(dt_conf_get_int64("pixelpipe_scratch_memory"), 0));
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, max_memory)) return 0;
   pipe->cache_obsolete = 0;
+  pipe->strip_backbuf = NULL;
+  pipe->disk_cache_ops = NULL;
+  pipe->fuse_pointwise = dt_conf_get_bool("pixelpipe_fuse_pointwise");
+  pipe->cache.fp16 = !size && dt_conf_get_bool("pixelpipe_cache_fp16");
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
   pipe->backbuf_zoom_x = 0.0f;
@@ -227,10 +238,15 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
 {
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf = NULL;
+  dt_free_align(pipe->strip_backbuf);
+  pipe->strip_backbuf = NULL;
+  g_strfreev(pipe->disk_cache_ops);
+  pipe->disk_cache_ops = NULL;
   // blocks while busy and sets shutdown bit:
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_dev_pixelpipe_arena_cleanup(&pipe->arena, _pipe_type_to_str(pipe->type));
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -324,6 +340,8 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->hash = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
+    piece->process_pointwise_ready = 0;
+    piece->synch_hash = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
@@ -333,6 +351,57 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   dt_pthread_mutex_unlock(&pipe->busy_mutex); // safe for others to use/mess with the pipe now
 }
 
+// everything a commit of the piece is made of, besides the state of the pipe and the image.
+// hist is the history item it's synched with, NULL for the defaults. the masks are looked up in
+// dev, the develop the pipe belongs to, which the caller holds the history_mutex of.
+static uint64_t _piece_synch_hash(dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece,
+                                  const dt_dev_history_item_t *hist)
+{
+  dt_iop_module_t *module = piece->module;
+  const char *params = (const char *)(hist ? hist->params : module->default_params);
+  const dt_develop_blend_params_t *bp = hist ? hist->blend_params : module->default_blendop_params;
+
+  uint64_t hash = 5381 + (hist ? hist->enabled : module->default_enabled);
+  for(int i = 0; i < module->params_size; i++) hash = ((hash << 5) + hash) ^ params[i];
+  const char *str = (const char *)bp;
+  for(size_t i = 0; i < sizeof(dt_develop_blend_params_t); i++) hash = ((hash << 5) + hash) ^ str[i];
+
+  dt_masks_form_t *grp = dt_masks_get_from_id(dev, bp->mask_id);
+  const int length = dt_masks_group_get_hash_buffer_length(dev, grp);
+  if(length)
+  {
+    char *masks = malloc(length);
+    dt_masks_group_get_hash_buffer(dev, grp, masks);
+    for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ masks[i];
+    free(masks);
+  }
+  return hash;
+}
+
+// commit the defaults of a module without history
+static void _pixelpipe_synch_defaults(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_dev_pixelpipe_iop_t *piece)
+{
+  piece->hash = 0;
+  piece->enabled = piece->module->default_enabled;
+  dt_iop_commit_params(piece->module, piece->module->default_params, piece->module->default_blendop_params,
+                       pipe, piece);
+  piece->synch_hash = _piece_synch_hash(dev, piece, NULL);
+}
+
+// module -> GList node of its history item in effect, the last one below history_end
+static GHashTable *_pixelpipe_history_in_effect(dt_develop_t *dev)
+{
+  GHashTable *items = g_hash_table_new(g_direct_hash, g_direct_equal);
+  GList *history = dev->history;
+  for(int k = 0; k < dev->history_end && history; k++)
+  {
+    const dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+    g_hash_table_insert(items, hist->module, history);
+    history = g_list_next(history);
+  }
+  return items;
+}
+
 // helper
 void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *history)
 {
@@ -385,6 +454,7 @@ void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *
         dt_print(DT_DEBUG_PARAMS, "[pixelpipe_synch] enabling mismatch for module %s in image %i\n", piece->module->op, imgid);
       }
       dt_iop_commit_params(hist->module, hist->params, hist->blend_params, pipe, piece);
+      piece->synch_hash = _piece_synch_hash(dev, piece, hist);
 
       if(piece->blendop_data)
       {
@@ -400,27 +470,46 @@ void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&pipe->busy_mutex);
 
-  dt_print(DT_DEBUG_PARAMS, "[pixelpipe] synch all modules with defaults_params for pipe %i\n", pipe->type);
+  dt_print(DT_DEBUG_PARAMS, "[pixelpipe] synch all modules with history for pipe %i\n", pipe->type);
 
-  // call reset_params on all pieces first. This is mandatory to init utility modules that don't have an history stack
+  // each module is committed once, with the history item in effect for it. the ones without
+  // history get their defaults, this is mandatory to init utility modules that don't have an history stack
+  GHashTable *items = _pixelpipe_history_in_effect(dev);
   for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
   {
     dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
-    piece->hash = 0;
-    piece->enabled = piece->module->default_enabled;
-    dt_iop_commit_params(piece->module, piece->module->default_params, piece->module->default_blendop_params,
-                         pipe, piece);
+    GList *history = (GList *)g_hash_table_lookup(items, piece->module);
+    if(history)
+      dt_dev_pixelpipe_synch(pipe, dev, history);
+    else
+      _pixelpipe_synch_defaults(pipe, dev, piece);
   }
+  g_hash_table_destroy(items);
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+}
 
-  dt_print(DT_DEBUG_PARAMS, "[pixelpipe] synch all modules with history for pipe %i\n", pipe->type);
+void dt_dev_pixelpipe_synch_changed(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
 
-  // go through all history items and adjust params
-  GList *history = dev->history;
-  for(int k = 0; k < dev->history_end && history; k++)
+  GHashTable *items = _pixelpipe_history_in_effect(dev);
+  int synched = 0;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
   {
-    dt_dev_pixelpipe_synch(pipe, dev, history);
-    history = g_list_next(history);
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    GList *history = (GList *)g_hash_table_lookup(items, piece->module);
+    const dt_dev_history_item_t *hist = history ? (dt_dev_history_item_t *)history->data : NULL;
+    if(_piece_synch_hash(dev, piece, hist) == piece->synch_hash) continue;
+
+    if(history)
+      dt_dev_pixelpipe_synch(pipe, dev, history);
+    else
+      _pixelpipe_synch_defaults(pipe, dev, piece);
+    synched++;
   }
+  g_hash_table_destroy(items);
+
+  dt_print(DT_DEBUG_PARAMS, "[pixelpipe] synch %d changed modules for pipe %i\n", synched, pipe->type);
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
@@ -452,6 +541,11 @@ void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
     // only top history item changed.
     dt_dev_pixelpipe_synch_top(pipe, dev);
   }
+  if((pipe->changed & DT_DEV_PIPE_HISTORY_CHANGED) && !(pipe->changed & (DT_DEV_PIPE_SYNCH | DT_DEV_PIPE_REMOVE)))
+  {
+    // history items were added or popped, synch the modules they changed
+    dt_dev_pixelpipe_synch_changed(pipe, dev);
+  }
   if(pipe->changed & DT_DEV_PIPE_SYNCH)
   {
     // pipeline topology remains intact, only change all params.
@@ -1190,6 +1284,294 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   return 0; //no errors
 }
 
+// write the output of a module to the disk cache, see pixelpipe_disk_cache.h
+static void _pixelpipe_disk_cache_store(dt_dev_pixelpipe_t *pipe, const uint64_t hash, void *output,
+                                        void *cl_mem_output, const dt_iop_roi_t *roi_out, const size_t bpp,
+                                        const dt_iop_buffer_dsc_t *dsc)
+{
+#ifdef HAVE_OPENCL
+  // the result may so far only exist on the device
+  if(cl_mem_output != NULL
+     && dt_opencl_copy_device_to_host(pipe->devid, output, cl_mem_output, roi_out->width, roi_out->height, bpp)
+            != CL_SUCCESS)
+    return;
+#endif
+  (void)dt_dev_pixelpipe_disk_cache_write(dt_dev_pixelpipe_disk_cache_key(pipe, hash), output,
+                                          (size_t)bpp * roi_out->width * roi_out->height, dsc);
+}
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// modules flagged IOP_FLAGS_FULL_PRECISION don't take input that went through half floats in the
+// cache. returns TRUE if all such lines were dropped and the input has to be computed again.
+static gboolean _pixelpipe_drop_rounded_input(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module, void *input)
+{
+  if(!pipe->cache.fp16 || !(module->flags() & IOP_FLAGS_FULL_PRECISION)) return FALSE;
+  if(dt_dev_pixelpipe_cache_rounded(&pipe->cache, input))
+  {
+    dt_print(DT_DEBUG_DEV, "[dev_pixelpipe] recomputing half float input of `%s'\n", module->op);
+    dt_dev_pixelpipe_cache_invalidate_rounded(&pipe->cache);
+    return TRUE;
+  }
+  dt_dev_pixelpipe_cache_keep_float(&pipe->cache, input);
+  return FALSE;
+}
+
+// the cache had no memory for the output of module (NULL for the input), the run fails
+static int _pixelpipe_cache_out_of_memory(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                                          const size_t bufsize)
+{
+  fprintf(stderr, "[dev_pixelpipe] out of memory for the output of `%s', %zu bytes [%s]\n",
+          module ? module->op : "input", bufsize, _pipe_type_to_str(pipe->type));
+  return 1;
+}
+
+// strips of a streamed export have at least this many rows besides their overlap
+#define DT_PIXELPIPE_MIN_STRIP_ROWS 64
+
+// pixels per block of a fused pointwise run, two blocks of intermediates per thread stay in L2
+#define DT_PIXELPIPE_POINTWISE_BLOCK 8192
+
+// can this module be part of a fused run of pointwise modules working in colorspace `cst'? its
+// output will not be in the cache, so it must not produce anything besides its output pixels.
+static gboolean _pixelpipe_pointwise_eligible(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                              dt_dev_pixelpipe_iop_t *piece, const int cst)
+{
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  return module->process_pointwise && piece->process_pointwise_ready
+         // the focused module wants its input in the cache
+         && module != dev->gui_module
+         && !(bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+         && !(piece->request_histogram & DT_REQUEST_ON)
+         && !_request_color_pick(pipe, dev, module)
+         && module->input_colorspace(module, pipe, piece) == cst
+         && module->output_colorspace(module, pipe, piece) == cst
+         && !dt_dev_pixelpipe_disk_cache_wanted(pipe, module);
+}
+
+// find the run of pointwise modules ending at `modules', which is not in the cache. returns the pieces
+// of the run in pipe order, or NULL if there is nothing to fuse. `modules', `pieces' and `pos' are moved
+// to where the input of the run has to come from.
+static GList *_pixelpipe_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                       GList **modules, GList **pieces, int *pos)
+{
+  if(!pipe->fuse_pointwise || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return NULL;
+#ifdef HAVE_OPENCL
+  // intermediates would have to go through host memory
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return NULL;
+#endif
+
+  dt_iop_module_t *last = (dt_iop_module_t *)(*modules)->data;
+  dt_dev_pixelpipe_iop_t *last_piece = (dt_dev_pixelpipe_iop_t *)(*pieces)->data;
+  const int cst = last->input_colorspace(last, pipe, last_piece);
+  if(cst == iop_cs_RAW) return NULL;
+
+  GList *run = NULL;
+  GList *m = *modules, *p = *pieces;
+  int k = *pos;
+  for(; m; m = g_list_previous(m), p = g_list_previous(p), k--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    // skipped the same way as in dt_dev_pixelpipe_process_rec()
+    if(!piece->enabled
+       || (dev->gui_module && dev->gui_module != module
+           && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+      continue;
+    if(!_pixelpipe_pointwise_eligible(pipe, dev, module, piece, cst)) break;
+    if(run)
+    {
+      // resume from the cache rather than recomputing the start of the run
+      uint64_t basichash = 0, hash = 0;
+      dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi, pipe, k, &basichash, &hash);
+      if(dt_dev_pixelpipe_cache_available(&(pipe->cache), hash)) break;
+    }
+    run = g_list_prepend(run, piece);
+  }
+
+  if(!run || !run->next)
+  {
+    g_list_free(run);
+    return NULL;
+  }
+
+  // the run reads and writes 4-channel floats only
+  dt_iop_buffer_dsc_t dsc = pipe->image.buf_dsc;
+  for(GList *mi = m, *pi = p; mi; mi = g_list_previous(mi), pi = g_list_previous(pi))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)mi->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pi->data;
+    if(!piece->enabled
+       || (dev->gui_module && dev->gui_module != module
+           && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+      continue;
+    module->output_format(module, pipe, piece, &dsc);
+    break;
+  }
+  if(dsc.channels != 4 || dsc.datatype != TYPE_FLOAT)
+  {
+    g_list_free(run);
+    return NULL;
+  }
+
+  *modules = m;
+  *pieces = p;
+  *pos = k;
+  return run;
+}
+
+// process a run of pointwise modules in one pass: the input is streamed through all of them in
+// cache sized blocks and only the output of the last one is written to the pixelpipe cache.
+static int _pixelpipe_process_pointwise(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                        GList *run, GList *modules, GList *pieces, const int pos,
+                                        const uint64_t basichash, const uint64_t hash)
+{
+  const int nrun = g_list_length(run);
+  dt_dev_pixelpipe_iop_t **run_pieces = g_new(dt_dev_pixelpipe_iop_t *, nrun);
+  int k = 0;
+  for(GList *iter = run; iter; iter = g_list_next(iter)) run_pieces[k++] = (dt_dev_pixelpipe_iop_t *)iter->data;
+  dt_dev_pixelpipe_iop_t *first = run_pieces[0];
+  dt_dev_pixelpipe_iop_t *last = run_pieces[nrun - 1];
+
+  for(int r = 0; r < nrun; r++)
+  {
+    run_pieces[r]->processed_roi_in = *roi_out;
+    run_pieces[r]->processed_roi_out = *roi_out;
+  }
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, modules, pieces, pos))
+  {
+    g_free(run_pieces);
+    return 1;
+  }
+  if(_pixelpipe_drop_rounded_input(pipe, first->module, input))
+  {
+    if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, modules, pieces,
+                                    pos))
+    {
+      g_free(run_pieces);
+      return 1;
+    }
+    dt_dev_pixelpipe_cache_keep_float(&pipe->cache, input);
+  }
+  if(input_format->channels != 4 || input_format->datatype != TYPE_FLOAT)
+  {
+    fprintf(stderr, "[dev_pixelpipe] input of fused run ending at `%s' is not 4-channel float [%s]\n",
+            last->module->op, _pipe_type_to_str(pipe->type));
+    g_free(run_pieces);
+    return 1;
+  }
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // transform to the colorspace of the run, as pixelpipe_process_on_CPU() does for a single module
+  const dt_iop_order_iccprofile_info_t *const work_profile
+      = (input_format->cst != iop_cs_RAW) ? dt_ioppr_get_pipe_work_profile_info(pipe) : NULL;
+  dt_ioppr_transform_image_colorspace(first->module, input, input, roi_out->width, roi_out->height,
+                                      input_format->cst, first->module->input_colorspace(first->module, pipe, first),
+                                      &input_format->cst, work_profile);
+
+  // the buffer descriptions go from module to module as if each one was processed on its own
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  for(int r = 0; r < nrun; r++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = run_pieces[r];
+    dt_iop_module_t *module = piece->module;
+    piece->dsc_out = piece->dsc_in = dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+    if(module->pointwise_setup) module->pointwise_setup(module, piece, roi_out);
+    pipe->dsc.cst = module->output_colorspace(module, pipe, piece);
+    dsc = piece->dsc_out = pipe->dsc;
+  }
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  const size_t bufsize = 4 * sizeof(float) * npixels;
+  if(dt_atomic_get_int(&pipe->shutdown))
+  {
+    g_free(run_pieces);
+    return 1;
+  }
+
+  // reserve the output cache line of the last module, the others get none
+  **out_format = dsc;
+  if(dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format) < 0)
+  {
+    g_free(run_pieces);
+    return _pixelpipe_cache_out_of_memory(pipe, last->module, bufsize);
+  }
+
+  size_t padded_size;
+  float *const restrict scratch
+      = dt_dev_pixelpipe_scratch_alloc_perthread(last, 2 * 4 * DT_PIXELPIPE_POINTWISE_BLOCK, &padded_size);
+  if(!scratch)
+  {
+    fprintf(stderr, "[dev_pixelpipe] out of memory for fused run ending at `%s' [%s]\n", last->module->op,
+            _pipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    g_free(run_pieces);
+    return 1;
+  }
+
+  const float *const restrict in = (const float *)input;
+  float *const restrict out = (float *)*output;
+  const size_t nblocks = (npixels + DT_PIXELPIPE_POINTWISE_BLOCK - 1) / DT_PIXELPIPE_POINTWISE_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, scratch, padded_size, npixels, nblocks, nrun, run_pieces) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    float *const restrict tmp = dt_get_perthread(scratch, padded_size);
+    const size_t offset = b * DT_PIXELPIPE_POINTWISE_BLOCK;
+    const size_t n = MIN(npixels - offset, DT_PIXELPIPE_POINTWISE_BLOCK);
+    const float *src = in + 4 * offset;
+    for(int r = 0; r < nrun; r++)
+    {
+      // ping-pong between the two blocks of scratch, the last module writes the output
+      float *const dst = (r == nrun - 1) ? out + 4 * offset : tmp + (r & 1) * 4 * DT_PIXELPIPE_POINTWISE_BLOCK;
+      dt_iop_module_t *module = run_pieces[r]->module;
+      module->process_pointwise(module, run_pieces[r], src, dst, n);
+      src = dst;
+    }
+  }
+  dt_dev_pixelpipe_scratch_free(last, scratch);
+
+  **out_format = last->dsc_out = pipe->dsc;
+
+  dt_dev_pixelpipe_cache_processed(&(pipe->cache), *output, last->module->op,
+                                   1000.0 * (dt_get_wtime() - start.clock));
+  dt_dev_pixelpipe_cache_inherit_rounded(&(pipe->cache), *output, input);
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    GString *labels = g_string_new(NULL);
+    for(int r = 0; r < nrun; r++)
+    {
+      gchar *module_label = dt_history_item_get_name(run_pieces[r]->module);
+      g_string_append_printf(labels, "%s`%s'", r ? ", " : "", module_label);
+      g_free(module_label);
+    }
+    dt_show_times_f(&start, "[dev_pixelpipe]", "processed %s fused on CPU [%s]", labels->str,
+                    _pipe_type_to_str(pipe->type));
+    g_string_free(labels, TRUE);
+  }
+  dt_trace_event(_pipe_type_to_str(pipe->type), last->module->op, pipe->image.id, &start, bufsize,
+                 DT_TRACE_CACHE_MISS | DT_TRACE_FUSED);
+
+  g_free(run_pieces);
+  return dt_atomic_get_int(&pipe->shutdown) ? 1 : 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1253,13 +1635,44 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // if(module) printf("found valid buf pos %d in cache for module %s %s %lu\n", pos, module->op, pipe ==
     // dev->preview_pipe ? "[preview]" : "", hash);
 
-    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    dt_times_t start;
+    dt_get_times(&start);
+    // a half float line is expanded again, that may fail
+    if(dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format) < 0)
+      return _pixelpipe_cache_out_of_memory(pipe, module, bufsize);
+    dt_dev_pixelpipe_cache_reused(&(pipe->cache), module ? module->op : "input");
+    dt_trace_event(_pipe_type_to_str(pipe->type), module ? module->op : "input", pipe->image.id, &start, 0,
+                   DT_TRACE_CACHE_HIT);
 
     if(!modules) return 0;
     // go to post-collect directly:
     goto post_process_collect_info;
   }
 
+  // export pipes may find the output of an expensive early module on disk, left by an earlier export
+  if(!cache_available && dt_dev_pixelpipe_disk_cache_wanted(pipe, module))
+  {
+    const uint64_t key = dt_dev_pixelpipe_disk_cache_key(pipe, hash);
+    if(dt_dev_pixelpipe_disk_cache_contains(key, bufsize))
+    {
+      dt_iop_buffer_dsc_t dsc;
+      dt_times_t start;
+      dt_get_times(&start);
+      if(dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format) < 0)
+        return _pixelpipe_cache_out_of_memory(pipe, module, bufsize);
+      if(!dt_dev_pixelpipe_disk_cache_read(key, *output, bufsize, &dsc))
+      {
+        dt_trace_event(_pipe_type_to_str(pipe->type), module->op, pipe->image.id, &start, bufsize,
+                       DT_TRACE_DISK_CACHE_HIT);
+        dt_print(DT_DEBUG_DEV, "[pixelpipe] resuming after `%s' from disk cache [%s]\n", module->op,
+                 _pipe_type_to_str(pipe->type));
+        **out_format = piece->dsc_out = dsc;
+        goto post_process_collect_info;
+      }
+      dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    }
+  }
+
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
   if(dt_iop_breakpoint(dev, pipe)) return 1;
@@ -1289,6 +1702,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       }
       else if(dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format))
       {
+        if(!*output) return _pixelpipe_cache_out_of_memory(pipe, module, bufsize);
         memset(*output, 0, bufsize);
         if(roi_in.scale == 1.0f)
         {
@@ -1328,7 +1742,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       // else found in cache.
     }
 
+    if(*output != pipe->input)
+      dt_dev_pixelpipe_cache_processed(&(pipe->cache), *output, "input", 1000.0 * (dt_get_wtime() - start.clock));
     dt_show_times_f(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    dt_trace_event(_pipe_type_to_str(pipe->type), "input", pipe->image.id, &start,
+                   *output != pipe->input ? bufsize : 0, DT_TRACE_CACHE_MISS);
   }
   else
   {
@@ -1339,6 +1757,21 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     {
       return 1;
     }
+
+    // pointwise modules before this one are processed together with it
+    {
+      GList *run_modules = modules, *run_pieces = pieces;
+      int run_pos = pos;
+      GList *run = _pixelpipe_pointwise_run(pipe, dev, roi_out, &run_modules, &run_pieces, &run_pos);
+      if(run)
+      {
+        const int err = _pixelpipe_process_pointwise(pipe, dev, output, out_format, roi_out, run,
+                                                     run_modules, run_pieces, run_pos, basichash, hash);
+        g_list_free(run);
+        return err;
+      }
+    }
+
     module->modify_roi_in(module, piece, roi_out, &roi_in);
 
     // recurse to get actual data of input buffer
@@ -1354,6 +1787,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
                                     g_list_previous(modules), g_list_previous(pieces), pos - 1))
       return 1;
+    if(_pixelpipe_drop_rounded_input(pipe, module, input))
+    {
+      if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
+                                      g_list_previous(modules), g_list_previous(pieces), pos - 1))
+        return 1;
+      dt_dev_pixelpipe_cache_keep_float(&pipe->cache, input);
+    }
 
     const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
 
@@ -1376,10 +1816,11 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       important = (strcmp(module->op, "colorout") == 0);
     else
       important = (strcmp(module->op, "gamma") == 0);
-    if(important)
-      (void)dt_dev_pixelpipe_cache_get_important(&(pipe->cache), basichash, hash, bufsize, output, out_format);
-    else
-      (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    const int cache_err
+        = important
+              ? dt_dev_pixelpipe_cache_get_important(&(pipe->cache), basichash, hash, bufsize, output, out_format)
+              : dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    if(cache_err < 0) return _pixelpipe_cache_out_of_memory(pipe, module, bufsize);
 
 // if(module) printf("reserving new buf in cache for module %s %s: %ld buf %p\n", module->op, pipe ==
 // dev->preview_pipe ? "[preview]" : "", hash, *output);
@@ -1917,6 +2358,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           /* Bad luck, opencl failed. Let's clean up and fall back to cpu module */
           dt_print(DT_DEBUG_OPENCL, "[opencl_pixelpipe] could not run module '%s' on gpu. falling back to cpu path\n",
                    module->op);
+          pixelpipe_flow |= PIXELPIPE_FLOW_OPENCL_FALLBACK;
 
           // fprintf(stderr, "[opencl_pixelpipe 4] module '%s' running on cpu\n", module->op);
 
@@ -2034,6 +2476,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                     : pixelpipe_flow & PIXELPIPE_FLOW_HISTOGRAM_ON_CPU ? "CPU" : ""));
     }
 
+    // remember how long this buffer took, for the cache to decide what to keep
+    dt_dev_pixelpipe_cache_processed(&(pipe->cache), *output, module->op, 1000.0 * (dt_get_wtime() - start.clock));
+    dt_dev_pixelpipe_cache_inherit_rounded(&(pipe->cache), *output, input);
+
     gchar *module_label = dt_history_item_get_name(module);
     dt_show_times_f(
         &start, "[dev_pixelpipe]", "processed `%s' on %s%s%s, blended on %s [%s]", module_label,
@@ -2051,9 +2497,21 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     g_free(module_label);
     module_label = NULL;
 
+    if(dt_trace_enabled())
+    {
+      uint32_t trace_flags = DT_TRACE_CACHE_MISS;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING) trace_flags |= DT_TRACE_TILING;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) trace_flags |= DT_TRACE_OPENCL;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_OPENCL_FALLBACK) trace_flags |= DT_TRACE_OPENCL_FALLBACK;
+      dt_trace_event(_pipe_type_to_str(pipe->type), module->op, pipe->image.id, &start, bufsize, trace_flags);
+    }
+
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
+    if(dt_dev_pixelpipe_disk_cache_wanted(pipe, module))
+      _pixelpipe_disk_cache_store(pipe, hash, *output, *cl_mem_output, roi_out, bpp, *out_format);
+
     if(module == darktable.develop->gui_module)
     {
       // give the input buffer to the currently focused plugin more weight.
@@ -2314,9 +2772,14 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
-int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
-                             float scale)
+// one run of the pipe for the given region, `out_bpp' is set to the bytes per pixel of pipe->backbuf
+static int _dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                  int height, float scale, size_t *out_bpp)
 {
+  dt_times_t start;
+  dt_get_times(&start);
+  uint32_t trace_flags = DT_TRACE_NONE;
+
   pipe->processing = 1;
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
@@ -2404,15 +2867,19 @@ restart:
     dt_dev_pixelpipe_change(pipe, dev);
     dt_print(DT_DEBUG_OPENCL, "[pixelpipe_process] [%s] falling back to cpu path\n",
              _pipe_type_to_str(pipe->type));
+    trace_flags |= DT_TRACE_OPENCL_FALLBACK;
     goto restart; // try again (this time without opencl)
   }
 
+  if(pipe->devid >= 0) trace_flags |= DT_TRACE_OPENCL;
+
   // release resources:
   if (pipe->forms)
   {
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
   }
+  dt_dev_pixelpipe_arena_trim(&pipe->arena);
   if(pipe->devid >= 0)
   {
     dt_opencl_unlock_device(pipe->devid);
@@ -2422,6 +2889,8 @@ restart:
   if(err)
   {
     pipe->processing = 0;
+    dt_trace_event(_pipe_type_to_str(pipe->type), "pixelpipe (aborted)", pipe->image.id, &start,
+                   pipe->cache.memory, trace_flags);
     return 1;
   }
 
@@ -2449,12 +2918,141 @@ restart:
     pipe->output_imgid = pipe->image.id;
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  *out_bpp = dt_iop_buffer_dsc_to_bpp(out_format);
 
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
+  dt_trace_event(_pipe_type_to_str(pipe->type), "pixelpipe", pipe->image.id, &start, pipe->cache.memory,
+                 trace_flags);
+  return 0;
+}
+
+// rows per strip to stream an export of this size through the pipe, 0 to process it at once. `margin'
+// is set to the rows each strip has to overlap its neighbours, from the tiling requirements of the modules.
+static int _dev_pixelpipe_strip_rows(dt_dev_pixelpipe_t *pipe, const int width, const int height,
+                                     const float scale, int *margin)
+{
+  const size_t budget = (size_t)MAX(dt_conf_get_int64("pixelpipe_export_strip_memory"), 0);
+  // raster masks are exported for the whole image
+  if((pipe->type & DT_DEV_PIXELPIPE_ANY) != DT_DEV_PIXELPIPE_EXPORT || pipe->store_all_raster_masks
+     || budget == 0 || sizeof(float) * 4 * width * height <= budget)
+    return 0;
+
+  // from the output back to the input, the way the rois are requested
+  dt_iop_roi_t roi_out = (dt_iop_roi_t){ 0, 0, width, height, scale };
+  unsigned overlap = 0;
+  GList *pieces = g_list_last(pipe->nodes);
+  for(GList *modules = g_list_last(pipe->iop); modules && pieces;
+      modules = g_list_previous(modules), pieces = g_list_previous(pieces))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(!piece->enabled) continue;
+
+    dt_iop_roi_t roi_in = roi_out;
+    module->modify_roi_in(module, piece, &roi_out, &roi_in);
+
+    // a module sees only part of the image. unlike tiling, which is a rare fallback, this happens to
+    // every large export, so it's up to the module to declare its output doesn't depend on anything
+    // but a neighbourhood, like statistics over the whole roi. per pixel modules are fine anyway.
+    if(module->process_pointwise || !strcmp(module->op, "gamma"))
+      ;
+    else if(module->flags() & IOP_FLAGS_STRIP_SAFE)
+    {
+      dt_develop_tiling_t tiling = { 0 };
+      module->tiling_callback(module, piece, &roi_in, &roi_out, &tiling);
+      // the overlap is in rows of the module input, count it in rows of the pipe output
+      overlap += ceilf(tiling.overlap * (float)height / MAX(roi_in.height, 1));
+    }
+    else
+    {
+      dt_print(DT_DEBUG_DEV, "[pixelpipe_process] [export] `%s' needs the whole image, not streaming\n",
+               module->op);
+      return 0;
+    }
+    roi_out = roi_in;
+
+    // blurred or feathered masks look beyond the strip, too
+    const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+      overlap += ceilf(3.0f * (bp->feathering_radius + bp->blur_radius) * scale / piece->iscale);
+  }
+
+  *margin = overlap;
+  // strips of about the budget, but the margins mustn't dominate the work
+  const size_t rows = MAX(MAX(budget / (sizeof(float) * 4 * width), (size_t)4 * overlap),
+                          DT_PIXELPIPE_MIN_STRIP_ROWS);
+  return rows < height ? (int)rows : 0;
+}
+
+// process an export in horizontal strips. only buffers of the size of a strip are kept between
+// modules, the output is assembled in pipe->strip_backbuf.
+static int _dev_pixelpipe_process_strips(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                         int height, float scale, const int rows, const int margin)
+{
+  dt_times_t start;
+  dt_get_times(&start);
+
+  // the cache lines were sized for the whole image
+  dt_dev_pixelpipe_cache_release(&pipe->cache);
+  dt_free_align(pipe->strip_backbuf);
+  pipe->strip_backbuf = NULL;
+
+  int strips = 0;
+  for(int sy = 0; sy < height; sy += rows, strips++)
+  {
+    const int sh = MIN(rows, height - sy);
+    const int top = MIN(margin, sy);
+    const int bottom = MIN(margin, height - sy - sh);
+    size_t bpp = 0;
+    if(_dev_pixelpipe_process(pipe, dev, x, y + sy - top, width, top + sh + bottom, scale, &bpp)) return 1;
+
+    if(!pipe->strip_backbuf)
+    {
+      pipe->strip_backbuf = dt_alloc_align(64, bpp * width * height);
+      if(!pipe->strip_backbuf)
+      {
+        fprintf(stderr, "[pixelpipe_process] [export] can't allocate the output of %dx%d pixels\n", width,
+                height);
+        return 1;
+      }
+    }
+    memcpy(pipe->strip_backbuf + bpp * width * sy, (uint8_t *)pipe->backbuf + bpp * width * top,
+           bpp * width * sh);
+  }
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
+  pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
+  pipe->backbuf = pipe->strip_backbuf;
+  pipe->backbuf_width = width;
+  pipe->backbuf_height = height;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "streamed %dx%d in %d strips of %d rows, %d rows overlap [export]",
+                  width, height, strips, rows, margin);
   return 0;
 }
 
+int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
+                             float scale)
+{
+  int margin = 0;
+  const int rows = _dev_pixelpipe_strip_rows(pipe, width, height, scale, &margin);
+  // per strip outputs would only fill the disk cache with entries nobody asks for again
+  if(rows)
+  {
+    g_strfreev(pipe->disk_cache_ops);
+    pipe->disk_cache_ops = NULL;
+  }
+  else
+    dt_dev_pixelpipe_disk_cache_prepare(pipe);
+  if(rows) return _dev_pixelpipe_process_strips(pipe, dev, x, y, width, height, scale, rows, margin);
+
+  size_t bpp = 0;
+  return _dev_pixelpipe_process(pipe, dev, x, y, width, height, scale, &bpp);
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
@@ -25,6 +25,7 @@
 #include "control/conf.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_arena.h"
 #include "develop/pixelpipe_cache.h"
 
 /**
@@ -59,6 +60,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;        // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight; // width and height of input buffer
   uint64_t hash;       // hash of params and enabled.
+  uint64_t synch_hash; // what the last commit was made of, see dt_dev_pixelpipe_synch_changed()
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -66,6 +68,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  int process_pointwise_ready; // set this to 0 in commit_params to keep the module out of fused pointwise runs
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
@@ -80,7 +83,8 @@ typedef enum dt_dev_pixelpipe_change_t
   DT_DEV_PIPE_REMOVE = 1 << 1,      // possibly elements of the pipe have to be removed
   DT_DEV_PIPE_SYNCH
   = 1 << 2, // all nodes up to end need to be synched, but no removal of module pieces is necessary
-  DT_DEV_PIPE_ZOOMED = 1 << 3 // zoom event, preview pipe does not need changes
+  DT_DEV_PIPE_ZOOMED = 1 << 3, // zoom event, preview pipe does not need changes
+  DT_DEV_PIPE_HISTORY_CHANGED = 1 << 4 // history items changed, only nodes whose params differ need to be synched
 } dt_dev_pixelpipe_change_t;
 
 /**
@@ -95,6 +99,10 @@ typedef struct dt_dev_pixelpipe_t
   dt_dev_pixelpipe_cache_t cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
+  // scratch buffers of modules and tiling, recycled across modules and runs
+  dt_dev_pixelpipe_arena_t arena;
+  // process runs of modules with process_pointwise() in one pass, from `pixelpipe_fuse_pointwise'
+  gboolean fuse_pointwise;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -130,6 +138,11 @@ typedef struct dt_dev_pixelpipe_t
   // output buffer (for display)
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
+  // output of an export processed in strips, backbuf points here then
+  uint8_t *strip_backbuf;
+  // modules whose output goes through the disk cache in the current run, NULL for none.
+  // see dt_dev_pixelpipe_disk_cache_prepare().
+  gchar **disk_cache_ops;
 
   // the data for the luminance mask are kept in a buffer written by demosaic or rawprepare
   // as we have to scale the mask later ke keep roi at that stage
@@ -221,8 +234,12 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, struct dt_develop_t
 void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 // adjust output node according to history stack (history pop event)
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
+// sync only the nodes whose history item, params, blend params or masks differ from their last commit.
+// only valid if nothing else the modules commit from has changed, use synch_all for that.
+void dt_dev_pixelpipe_synch_changed(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
+// large exports are processed in horizontal strips, see `pixelpipe_export_strip_memory'.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
 // convenience method that does not gamma-compress the image.
@@ -701,14 +701,14 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
            tiles_x, tiles_y, width, height, overlap);
 
   /* reserve input and output buffers for tiles */
-  input = dt_alloc_align(64, (size_t)width * height * in_bpp);
+  input = dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena, (size_t)width * height * in_bpp);
   if(input == NULL)
   {
     dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc input buffer for module '%s'\n",
              self->op);
     goto error;
   }
-  output = dt_alloc_align(64, (size_t)width * height * out_bpp);
+  output = dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena, (size_t)width * height * out_bpp);
   if(output == NULL)
   {
     dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc output buffer for module '%s'\n",
@@ -812,8 +812,8 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, input);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, output);
   piece->pipe->tiling = 0;
   return;
 
@@ -822,8 +822,8 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, input);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] fall back to standard processing for module '%s'\n",
            self->op);
@@ -1087,14 +1087,16 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
 
 
       /* prepare input tile buffer */
-      input = dt_alloc_align(64, (size_t)iroi_full.width * iroi_full.height * in_bpp);
+      input = dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena,
+                                           (size_t)iroi_full.width * iroi_full.height * in_bpp);
       if(input == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc input buffer for module '%s'\n",
                  self->op);
         goto error;
       }
-      output = dt_alloc_align(64, (size_t)oroi_full.width * oroi_full.height * out_bpp);
+      output = dt_dev_pixelpipe_arena_alloc(&piece->pipe->arena,
+                                            (size_t)oroi_full.width * oroi_full.height * out_bpp);
       if(output == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc output buffer for module '%s'\n",
@@ -1145,16 +1147,16 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                (char *)output + ((j + origin_y) * oroi_full.width + origin_x) * out_bpp,
                (size_t)oroi_good.width * out_bpp);
 
-      dt_free_align(input);
-      dt_free_align(output);
+      dt_dev_pixelpipe_arena_free(&piece->pipe->arena, input);
+      dt_dev_pixelpipe_arena_free(&piece->pipe->arena, output);
       input = output = NULL;
     }
 
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, input);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, output);
   piece->pipe->tiling = 0;
   return;
 
@@ -1163,8 +1165,8 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, input);
+  dt_dev_pixelpipe_arena_free(&piece->pipe->arena, output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] fall back to standard processing for module '%s'\n",
            self->op);
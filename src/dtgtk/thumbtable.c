@@ -754,6 +754,142 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   return TRUE;
 }
 
+// upper limits of the prefetching while scrolling. the foreground job queue only holds a few
+// dozen jobs and the thumbnails on screen must not be pushed out of it.
+#define DT_THUMBTABLE_PREFETCH_MAX_ROWS 10
+#define DT_THUMBTABLE_PREFETCH_MAX_IMAGES 16
+
+// count the prefetched images which are on screen now as hits or misses
+static void _prefetch_account(dt_thumbtable_t *table)
+{
+  if(g_hash_table_size(table->prefetch.pending) == 0) return;
+
+  for(const GList *l = table->list; l; l = g_list_next(l))
+  {
+    dt_thumbnail_t *th = (dt_thumbnail_t *)l->data;
+    gpointer mip;
+    if(!g_hash_table_lookup_extended(table->prefetch.pending, GINT_TO_POINTER(th->imgid), NULL, &mip)) continue;
+    if(dt_mipmap_cache_is_loaded(darktable.mipmap_cache, th->imgid, GPOINTER_TO_INT(mip)))
+      table->prefetch.hits++;
+    else
+      table->prefetch.misses++;
+    g_hash_table_remove(table->prefetch.pending, GINT_TO_POINTER(th->imgid));
+  }
+}
+
+// the mip the thumbnails on screen ask for, computed from their image box like
+// dt_view_image_get_surface() does
+static dt_mipmap_size_t _prefetch_mip(dt_thumbtable_t *table)
+{
+  const dt_thumbnail_t *th = (dt_thumbnail_t *)table->list->data;
+  int image_w = 0, image_h = 0;
+  if(th->w_image_box) gtk_widget_get_size_request(th->w_image_box, &image_w, &image_h);
+  if(image_w <= 0 || image_h <= 0) image_w = image_h = table->thumb_size;
+  return dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, image_w * darktable.gui->ppd,
+                                           image_h * darktable.gui->ppd);
+}
+
+typedef struct _prefetch_window_t
+{
+  const int *imgids;
+  int num;
+} _prefetch_window_t;
+
+static gboolean _prefetch_outside_window(gpointer key, gpointer value, gpointer user_data)
+{
+  const _prefetch_window_t *window = (_prefetch_window_t *)user_data;
+  const int imgid = GPOINTER_TO_INT(key);
+  for(int k = 0; k < window->num; k++)
+    if(window->imgids[k] == imgid) return FALSE;
+  return TRUE;
+}
+
+// called after each scroll step of `rows' rows (columns for the filmstrip), positive towards the
+// end of the collection. the thumbnails of the next rows in that direction are loaded from the
+// disk cache in the background, so they are in memory once they scroll into view. the faster
+// the user scrolls, the further ahead we look.
+static void _prefetch_update(dt_thumbtable_t *table, const int rows)
+{
+  if(rows == 0 || !table->list) return;
+  if(table->mode != DT_THUMBTABLE_MODE_FILEMANAGER && table->mode != DT_THUMBTABLE_MODE_FILMSTRIP) return;
+  const int min_rows = dt_conf_get_int("plugins/lighttable/thumbnail_prefetch_rows");
+  if(min_rows <= 0) return;
+
+  _prefetch_account(table);
+
+  const int direction = rows > 0 ? 1 : -1;
+  const double now = dt_get_wtime();
+  const double elapsed = now - table->prefetch.last_time;
+  table->prefetch.last_time = now;
+  if(direction != table->prefetch.direction)
+  {
+    // whatever was queued for the other way is of no use now
+    dt_image_prefetch_cancel();
+    g_hash_table_remove_all(table->prefetch.pending);
+    table->prefetch.direction = direction;
+    table->prefetch.velocity = 0.0f;
+  }
+  else if(elapsed > 1.0)
+    table->prefetch.velocity = 0.0f; // the user paused, start over
+  else
+    table->prefetch.velocity = 0.5f * table->prefetch.velocity + 0.5f * abs(rows) / MAX(elapsed, 0.01);
+
+  // at least the configured rows, plus what the user scrolls through in half a second
+  const int ahead = CLAMP(min_rows + (int)(0.5f * table->prefetch.velocity), 1, DT_THUMBTABLE_PREFETCH_MAX_ROWS);
+  const int count = MIN(ahead * table->thumbs_per_row, DT_THUMBTABLE_PREFETCH_MAX_IMAGES);
+
+  int first = INT_MAX, last = 0;
+  for(const GList *l = table->list; l; l = g_list_next(l))
+  {
+    const dt_thumbnail_t *th = (dt_thumbnail_t *)l->data;
+    first = MIN(first, th->rowid);
+    last = MAX(last, th->rowid);
+  }
+
+  int imgids[DT_THUMBTABLE_PREFETCH_MAX_IMAGES];
+  int num = 0;
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              direction > 0
+                              ? "SELECT imgid FROM memory.collected_images WHERE rowid > ?1 ORDER BY rowid LIMIT ?2"
+                              : "SELECT imgid FROM memory.collected_images WHERE rowid < ?1 ORDER BY rowid DESC LIMIT ?2",
+                              -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, direction > 0 ? last : first);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, count);
+  while(sqlite3_step(stmt) == SQLITE_ROW && num < count) imgids[num++] = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  // forget what was prefetched for rows we jumped over or left behind, they can't be told hits or misses
+  _prefetch_window_t window = { imgids, num };
+  g_hash_table_foreach_remove(table->prefetch.pending, _prefetch_outside_window, &window);
+
+  // the job queue is a stack: the farthest go first, so the nearest are loaded first
+  const dt_mipmap_size_t mip = _prefetch_mip(table);
+  int queued = 0;
+  for(int k = num - 1; k >= 0; k--)
+  {
+    if(g_hash_table_contains(table->prefetch.pending, GINT_TO_POINTER(imgids[k]))) continue;
+    if(!dt_mipmap_cache_prefetch_disk(darktable.mipmap_cache, imgids[k], mip)) continue;
+    g_hash_table_insert(table->prefetch.pending, GINT_TO_POINTER(imgids[k]), GINT_TO_POINTER(mip));
+    queued++;
+  }
+  table->prefetch.queued += queued;
+
+  dt_print(DT_DEBUG_LIGHTTABLE,
+           "[thumbtable] prefetch %d of %d images %d rows ahead at %.1f rows/s, %" PRIu64 " hits, %" PRIu64
+           " misses so far\n",
+           queued, num, ahead, table->prefetch.velocity, table->prefetch.hits, table->prefetch.misses);
+}
+
+void dt_thumbtable_get_prefetch_stats(dt_thumbtable_t *table, uint64_t *queued, uint64_t *hits, uint64_t *misses)
+{
+  if(queued) *queued = table->prefetch.queued;
+  if(hits) *hits = table->prefetch.hits;
+  if(misses) *misses = table->prefetch.misses;
+}
+
 static dt_thumbnail_t *_thumbtable_get_thumb(dt_thumbtable_t *table, int imgid)
 {
   if(imgid <= 0) return NULL;
@@ -931,14 +1067,17 @@ static gboolean _event_scroll(GtkWidget *widget, GdkEvent *event, gpointer user_
             || table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
     {
       // for filemanger and filmstrip, scrolled = move
+      gboolean moved = FALSE;
       if(delta < 0 && table->mode == DT_THUMBTABLE_MODE_FILEMANAGER)
-        _move(table, 0, table->thumb_size, TRUE);
+        moved = _move(table, 0, table->thumb_size, TRUE);
       else if(delta < 0 && table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        _move(table, table->thumb_size, 0, TRUE);
+        moved = _move(table, table->thumb_size, 0, TRUE);
       if(delta >= 0 && table->mode == DT_THUMBTABLE_MODE_FILEMANAGER)
-        _move(table, 0, -table->thumb_size, TRUE);
+        moved = _move(table, 0, -table->thumb_size, TRUE);
       else if(delta >= 0 && table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        _move(table, -table->thumb_size, 0, TRUE);
+        moved = _move(table, -table->thumb_size, 0, TRUE);
+
+      if(moved) _prefetch_update(table, delta < 0 ? -1 : 1);
 
       // ensure the hovered image is the right one
       dt_thumbnail_t *th = _thumb_get_under_mouse(table);
@@ -1797,6 +1936,7 @@ dt_thumbtable_t *dt_thumbtable_new()
   g_free(cl);
 
   table->offset = MAX(1, dt_conf_get_int("plugins/lighttable/recentcollect/pos0"));
+  table->prefetch.pending = g_hash_table_new(g_direct_hash, g_direct_equal);
 
   // set widget signals
   gtk_widget_set_events(table->widget, GDK_EXPOSURE_MASK | GDK_POINTER_MOTION_MASK
@@ -1867,6 +2007,8 @@ void dt_thumbtable_scrollbar_changed(dt_thumbtable_t *table, float x, float y)
 
     if(new_offset != table->offset)
     {
+      const int diff = new_offset - table->offset;
+      const int rows = diff / table->thumbs_per_row;
       table->offset = new_offset;
       dt_thumbtable_full_redraw(table, TRUE);
       // To enable smooth scrolling move the thumbnails
@@ -1874,6 +2016,7 @@ void dt_thumbtable_scrollbar_changed(dt_thumbtable_t *table, float x, float y)
       // so if the scrollbar is in 13.28 position move the thumbs by 0.28 * thumb_size
       const float thumbs_area_offset_y = ((y - floor(y)) * (float)table->thumb_size);
       _move(table, 0, -thumbs_area_offset_y, FALSE);
+      _prefetch_update(table, rows ? rows : (diff > 0 ? 1 : -1));
     }
   }
   else if(table->mode == DT_THUMBTABLE_MODE_ZOOM)
@@ -103,6 +103,19 @@ typedef struct dt_thumbtable_t
   // let's remember previous thumbnail generation settings to detect if they change
   int pref_embedded;
   int pref_hq;
+
+  // thumbnails loaded ahead of scrolling, see _prefetch_update()
+  struct
+  {
+    int direction;       // 1 towards the end of the collection, -1 towards the start
+    double last_time;    // of the last scroll step
+    float velocity;      // rows per second, smoothed
+    GHashTable *pending; // imgid -> mip of the prefetched images not shown yet
+    // statistics:
+    uint64_t queued;
+    uint64_t hits;   // shown after the prefetch was done
+    uint64_t misses; // shown before it was done
+  } prefetch;
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
@@ -116,6 +129,9 @@ gboolean dt_thumbtable_set_offset(dt_thumbtable_t *table, int offset, gboolean r
 // set offset at specific imageid (and redraw if needed)
 gboolean dt_thumbtable_set_offset_image(dt_thumbtable_t *table, int imgid, gboolean redraw);
 
+// statistics of the thumbnails prefetched while scrolling
+void dt_thumbtable_get_prefetch_stats(dt_thumbtable_t *table, uint64_t *queued, uint64_t *hits, uint64_t *misses);
+
 // fired when the zoom level change
 void dt_thumbtable_zoom_changed(dt_thumbtable_t *table, int oldzoom, int newzoom);
 
@@ -31,6 +31,7 @@
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
+#include "common/dtpthread.h"    // for dt_pthread_create, dt_pthread_mutex_t
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
 #include "common/file_location.h"
 #include "common/history.h"      // for dt_history_hash_set_mipmap
@@ -45,7 +46,83 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+typedef struct dt_generate_cache_t
+{
+  int32_t *images;
+  gboolean *stale; // thumbnails on disc were made for an older history
+  size_t count;
+  size_t next; // next image to hand out
+  dt_mipmap_size_t min_mip, max_mip;
+  int openmp_threads;
+  dt_pthread_mutex_t lock;
+  // statistics
+  size_t done, thumbnails, up_to_date, failed;
+} dt_generate_cache_t;
+
+static void *generate_thread(void *data)
+{
+  dt_generate_cache_t *g = (dt_generate_cache_t *)data;
+#ifdef _OPENMP
+  omp_set_num_threads(g->openmp_threads);
+#endif
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&g->lock);
+    if(g->next >= g->count)
+    {
+      dt_pthread_mutex_unlock(&g->lock);
+      break;
+    }
+    const size_t i = g->next++;
+    dt_pthread_mutex_unlock(&g->lock);
+
+    const int32_t imgid = g->images[i];
+    // the thumbnails on disc show an older edit, don't let the cache load them again
+    if(g->stale[i]) dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+
+    size_t thumbnails = 0, failed = 0;
+    for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+    {
+      // if a valid thumbnail is already on disc - do nothing
+      if(dt_mipmap_cache_is_on_disk(darktable.mipmap_cache, imgid, k))
+      {
+        // a loose file may be truncated, check it. entries of the packed store have no file of their own.
+        char filename[PATH_MAX] = { 0 };
+        snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+        if(!g_file_test(filename, G_FILE_TEST_EXISTS) || dt_util_test_image_file(filename)) continue;
+      }
+
+      // else, generate thumbnail and store in mipmap cache.
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+      if(buf.buf && buf.width > 0 && buf.height > 0)
+        thumbnails++;
+      else
+        failed++;
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
+
+    // and immediately write thumbs to disc and remove from mipmap cache.
+    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+    // thumbnail in sync with image
+    if(!failed) dt_history_hash_set_mipmap(imgid);
+
+    dt_pthread_mutex_lock(&g->lock);
+    g->done++;
+    g->thumbnails += thumbnails;
+    if(failed) g->failed++;
+    if(!thumbnails && !failed) g->up_to_date++;
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)%s\n", g->done, g->count, 100.0 * g->done / (float)g->count,
+            imgid, failed ? " failed" : !thumbnails ? " up to date" : g->stale[i] ? " stale" : "");
+    dt_pthread_mutex_unlock(&g->lock);
+  }
+  return NULL;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    const int32_t min_imgid, const int32_t max_imgid, const int shard,
+                                    const int shards, const int jobs)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -61,24 +138,34 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
+  // collect this shard's images and whether their thumbnails are stale. an image without
+  // a history hash has never been edited, so its thumbnails can't be outdated.
+  GArray *images = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  GArray *stale = g_array_new(FALSE, FALSE, sizeof(gboolean));
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT i.id,"
+                              "       h.imgid IS NOT NULL"
+                              "       AND (h.mipmap_hash IS NULL OR h.mipmap_hash != h.current_hash)"
+                              " FROM main.images AS i"
+                              " LEFT JOIN main.history_hash AS h ON h.imgid = i.id"
+                              " WHERE i.id >= ?1 AND i.id <= ?2 AND i.id % ?3 = ?4"
+                              " ORDER BY i.id",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, shards);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 4, shard);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    return 1;
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    const gboolean is_stale = sqlite3_column_int(stmt, 1);
+    g_array_append_val(images, imgid);
+    g_array_append_val(stale, is_stale);
   }
+  sqlite3_finalize(stmt);
 
-  if(!image_count)
+  if(!images->len)
   {
     fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
     if(min_imgid > max_imgid)
@@ -87,40 +174,45 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  dt_generate_cache_t g = { 0 };
+  g.images = (int32_t *)images->data;
+  g.stale = (gboolean *)stale->data;
+  g.count = images->len;
+  g.min_mip = min_mip;
+  g.max_mip = max_mip;
+  // share the cores between the workers instead of oversubscribing them
+  const int workers = MAX(1, MIN(jobs, (int)g.count));
+  g.openmp_threads = MAX(1, darktable.num_openmp_threads / workers);
+  dt_pthread_mutex_init(&g.lock, NULL);
+
+  dt_times_t start, end;
+  dt_get_times(&start);
+
+  pthread_t *threads = g_malloc0_n(workers, sizeof(pthread_t));
+  int started = 0;
+  for(int i = 0; i < workers - 1; i++)
   {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid);
-
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
-
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
+    if(dt_pthread_create(&threads[started], generate_thread, &g)) break;
+    started++;
   }
+  generate_thread(&g);
+  for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+  g_free(threads);
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  dt_get_times(&end);
+  const double seconds = end.clock - start.clock;
+  fprintf(stderr,
+          _("done: %zu images in %.1f s with %d workers (%.2f images/s), %zu thumbnails generated, "
+            "%zu images up to date, %zu failed\n"),
+          g.done, seconds, started + 1, seconds > 0.0 ? g.done / seconds : 0.0, g.thumbnails, g.up_to_date,
+          g.failed);
+
+  dt_pthread_mutex_destroy(&g.lock);
+  g_array_free(images, TRUE);
+  g_array_free(stale, TRUE);
 
   return 0;
 }
@@ -131,13 +223,21 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 1)] [--shard <i>/<N>]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "--jobs runs that many images at once. --shard i/N only works on the images\n"
+          "with ID modulo N equal to i (0 <= i < N), so N machines sharing the library\n"
+          "and cache can split the work.\n"
+          "\n"
+          "Thumbnails already on disc are kept unless the image has been edited since\n"
+          "they were made, so an interrupted run can simply be restarted.\n",
           progname);
 }
 
@@ -163,6 +263,7 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 1, shard = 0, shards = 1;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -198,6 +299,20 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MAX(atoi(arg[k]), 1);
+    }
+    else if(!strcmp(arg[k], "--shard") && argc > k + 1)
+    {
+      k++;
+      if(sscanf(arg[k], "%d/%d", &shard, &shards) != 2 || shards < 1 || shard < 0 || shard >= shards)
+      {
+        fprintf(stderr, _("error: --shard expects <i>/<N> with 0 <= i < N\n"));
+        exit(EXIT_FAILURE);
+      }
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -251,7 +366,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, shard, shards, jobs))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
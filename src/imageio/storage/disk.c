@@ -242,12 +242,12 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set max_width and max_height values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
   gboolean fail = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set max_width and max_height values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -313,6 +313,9 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      // reserve the name, another export thread could pick it before we write the file
+      FILE *f = g_fopen(filename, "wb");
+      if(f) fclose(f);
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
@@ -336,15 +339,24 @@ try_again:
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    if(d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME) g_unlink(filename);
     return 1;
   }
 
+  // not written yet, the writer stage tells the user once it is
+  if(dt_imageio_export_deferred()) return 0;
+
   fprintf(stderr, "[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, filename);
   return 0;
 }
 
+int flags(dt_imageio_module_storage_t *self)
+{
+  return STORAGE_FLAGS_PARALLEL_STORE;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
@@ -86,6 +86,9 @@ OPTIONAL(void, export_dispatched, struct dt_imageio_module_storage_t *self);
 
 OPTIONAL(char *, ask_user_confirmation, struct dt_imageio_module_storage_t *self);
 
+/* dt_imageio_storage_flags_t, e.g. whether store() can run for several images at once */
+OPTIONAL(int, flags, struct dt_imageio_module_storage_t *self);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
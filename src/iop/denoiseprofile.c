@@ -679,7 +679,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_WIDE_PLAIN;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1261,7 +1261,7 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   float *restrict precond = NULL;
   float *restrict tmp = NULL;
 
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &precond, 4, &tmp, 4, &buf, 0))
+  if (!dt_iop_alloc_scratch_buffers(piece, roi_in, roi_out, 4, &precond, 4, &tmp, 4, &buf, 0))
   {
     dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out, TRUE);
     return;
@@ -1361,9 +1361,9 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     backtransform_Y0U0V0(out, width, height, d->a[1] * compensate_p, p, d->b[1], d->bias - 0.5 * logf(in_scale), wb, toRGB);
   }
 
-  dt_free_align(buf);
-  dt_free_align(tmp);
-  dt_free_align(precond);
+  dt_dev_pixelpipe_scratch_free(piece, buf);
+  dt_dev_pixelpipe_scratch_free(piece, tmp);
+  dt_dev_pixelpipe_scratch_free(piece, precond);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -1531,7 +1531,7 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
     return; // image has been copied through to output and module's trouble flag has been updated
 
   float *restrict in;
-  if (!dt_iop_alloc_image_buffers(piece->module, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
+  if (!dt_iop_alloc_scratch_buffers(piece, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
     return;
 
   // adjust to zoom size:
@@ -1563,7 +1563,7 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                       .norm = norm2 };
   denoiser(in,ovoid,roi_in,roi_out,&params);
 
-  dt_free_align(in);
+  dt_dev_pixelpipe_scratch_free(piece, in);
   nlmeans_backtransform(d,ovoid,roi_in,scale,compensate_p,wb,aa,bb,p);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
@@ -1663,7 +1663,7 @@ static void process_variance(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   }
 
   float *restrict in;
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
+  if (!dt_iop_alloc_scratch_buffers(piece, roi_in, roi_out, 4 | DT_IMGSZ_INPUT, &in, 0))
     return;
 
   float DT_ALIGNED_PIXEL wb[4];  // the "unused" fourth element enables vectorization
@@ -1700,6 +1700,7 @@ static void process_variance(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   g->variance_R = var[0];
   g->variance_G = var[1];
   g->variance_B = var[2];
+  dt_dev_pixelpipe_scratch_free(piece, in);
 
   memcpy(ovoid, ivoid, sizeof(float) * 4 * npixels);
 }
@@ -189,12 +189,23 @@ DEFAULT(void, process_tiling, struct dt_iop_module_t *self, struct dt_dev_pixelp
 
 #if defined(__SSE__)
 /** a variant process(), that can contain SSE2 intrinsics. */
-/** can be provided by each IOP. */
+/** can be provided by each IOP. on AVX2 machines it is skipped if flags() has IOP_FLAGS_WIDE_PLAIN. */
 OPTIONAL(void, process_sse2, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                              void *const o, const struct dt_iop_roi_t *const roi_in,
                              const struct dt_iop_roi_t *const roi_out);
 #endif
 
+/** a per-pixel variant of process() for modules whose output pixel only depends on the same input pixel.
+  * the pipe fuses runs of such modules into one pass over the image, without buffers in between.
+  * it is called with blocks of `npixels' 64 byte aligned 4-channel float pixels, from several threads
+  * at once, so it must not parallelize itself. */
+OPTIONAL(void, process_pointwise, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                  const float *const in, float *const out, const size_t npixels);
+/** called once per pipe run before process_pointwise(), for what process() does besides the pixel loop,
+  * like updating piece->pipe->dsc. */
+OPTIONAL(void, pointwise_setup, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                const struct dt_iop_roi_t *const roi);
+
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process(). */
 OPTIONAL(int, process_cl, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
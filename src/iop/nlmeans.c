@@ -130,7 +130,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_WIDE_PLAIN;
 }
 
 #if defined(HAVE_OPENCL) && !USE_NEW_IMPL_CL
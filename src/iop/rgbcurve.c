@@ -1754,6 +1754,54 @@ cleanup:
 }
 #endif
 
+static inline void _rgbcurve_pixel(const float *const restrict in, float *const restrict out,
+                                   dt_iop_rgbcurve_data_t *const d,
+                                   const dt_iop_order_iccprofile_info_t *const work_profile,
+                                   const float xm_L, const float xm_g, const float xm_b)
+{
+  const int autoscale = d->params.curve_autoscale;
+  const _curve_table_ptr restrict table = d->table;
+  const _coeffs_table_ptr restrict unbounded_coeffs = d->unbounded_coeffs;
+
+  if(autoscale == DT_S_SCALE_MANUAL_RGB)
+  {
+    out[0] = (in[0] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[0] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[0]);
+    out[1] = (in[1] < xm_g) ? table[DT_IOP_RGBCURVE_G][CLAMP((int)(in[1] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_G], in[1]);
+    out[2] = (in[2] < xm_b) ? table[DT_IOP_RGBCURVE_B][CLAMP((int)(in[2] * 0x10000ul), 0, 0xffff)]
+                            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_B], in[2]);
+  }
+  else if(autoscale == DT_S_SCALE_AUTOMATIC_RGB)
+  {
+    if(d->params.preserve_colors == DT_RGB_NORM_NONE)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        out[c] = (in[c] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[c] * 0x10000ul), 0, 0xffff)]
+          : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[c]);
+      }
+    }
+    else
+    {
+      float ratio = 1.f;
+      const float lum = dt_rgb_norm(in, d->params.preserve_colors, work_profile);
+      if(lum > 0.f)
+      {
+        const float curve_lum = (lum < xm_L)
+          ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(lum * 0x10000ul), 0, 0xffff)]
+          : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], lum);
+        ratio = curve_lum / lum;
+      }
+      for(size_t c = 0; c < 3; c++)
+      {
+        out[c] = (ratio * in[c]);
+      }
+    }
+  }
+  out[3] = in[3];
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -1776,55 +1824,37 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const int width = roi_out->width;
   const int height = roi_out->height;
   const size_t npixels = (size_t)width * height;
-  const int autoscale = d->params.curve_autoscale;
-  const _curve_table_ptr restrict table = d->table;
-  const _coeffs_table_ptr restrict unbounded_coeffs = d->unbounded_coeffs;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(autoscale, npixels, work_profile, xm_b, xm_g, xm_L) \
-  dt_omp_sharedconst(in, out, table, unbounded_coeffs, d) \
+  dt_omp_firstprivate(npixels, work_profile, xm_b, xm_g, xm_L) \
+  dt_omp_sharedconst(in, out, d) \
   schedule(static)
 #endif
   for(int y = 0; y < 4*npixels; y += 4)
   {
-    if(autoscale == DT_S_SCALE_MANUAL_RGB)
-    {
-      out[y+0] = (in[y+0] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[y+0] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[y+0]);
-      out[y+1] = (in[y+1] < xm_g) ? table[DT_IOP_RGBCURVE_G][CLAMP((int)(in[y+1] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_G], in[y+1]);
-      out[y+2] = (in[y+2] < xm_b) ? table[DT_IOP_RGBCURVE_B][CLAMP((int)(in[y+2] * 0x10000ul), 0, 0xffff)]
-                                  : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_B], in[y+2]);
-    }
-    else if(autoscale == DT_S_SCALE_AUTOMATIC_RGB)
-    {
-      if(d->params.preserve_colors == DT_RGB_NORM_NONE)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          out[y+c] = (in[y+c] < xm_L) ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(in[y+c] * 0x10000ul), 0, 0xffff)]
-            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], in[y+c]);
-        }
-      }
-      else
-      {
-        float ratio = 1.f;
-        const float lum = dt_rgb_norm(in + y, d->params.preserve_colors, work_profile);
-        if(lum > 0.f)
-        {
-          const float curve_lum = (lum < xm_L)
-            ? table[DT_IOP_RGBCURVE_R][CLAMP((int)(lum * 0x10000ul), 0, 0xffff)]
-            : dt_iop_eval_exp(unbounded_coeffs[DT_IOP_RGBCURVE_R], lum);
-          ratio = curve_lum / lum;
-        }
-        for(size_t c = 0; c < 3; c++)
-        {
-          out[y+c] = (ratio * in[y+c]);
-        }
-      }
-    }
-    out[y+3] = in[y+3];
+    _rgbcurve_pixel(in + y, out + y, d, work_profile, xm_L, xm_g, xm_b);
+  }
+}
+
+void pointwise_setup(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi)
+{
+  _generate_curve_lut(piece->pipe, (dt_iop_rgbcurve_data_t *)piece->data);
+}
+
+void process_pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *const out, const size_t npixels)
+{
+  const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
+  dt_iop_rgbcurve_data_t *const d = (dt_iop_rgbcurve_data_t *)piece->data;
+
+  const float xm_L = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_R][0];
+  const float xm_g = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_G][0];
+  const float xm_b = 1.0f / d->unbounded_coeffs[DT_IOP_RGBCURVE_B][0];
+
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+  {
+    _rgbcurve_pixel(in + k, out + k, d, work_profile, xm_L, xm_g, xm_b);
   }
 }
 
@@ -98,6 +98,22 @@ const char *description(struct dt_iop_module_t *self)
                                       _("non-linear, Lab, display-referred"));
 }
 
+static inline void _vibrance_pixel(const float *const restrict in, float *const restrict out, const float amount)
+{
+  /* saturation weight 0 - 1 */
+  const float sw = sqrtf((in[1] * in[1]) + (in[2] * in[2])) / 256.0f;
+  const float ls = 1.0f - ((amount * sw) * .25f);
+  const float ss = 1.0f + (amount * sw);
+  const float weights[4] = { ls, ss, ss, 1.0f };
+#ifdef _OPENMP
+#pragma omp simd aligned(in, out : 16)
+#endif
+  for (int c = 0; c < 4; c++)
+  {
+    out[c] = in[c] * weights[c];
+  }
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -120,18 +136,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
   for(int k = 0; k < 4 * npixels; k += 4)
   {
-    /* saturation weight 0 - 1 */
-    const float sw = sqrtf((in[k + 1] * in[k + 1]) + (in[k + 2] * in[k + 2])) / 256.0f;
-    const float ls = 1.0f - ((amount * sw) * .25f);
-    const float ss = 1.0f + (amount * sw);
-    const float weights[4] = { ls, ss, ss, 1.0f };
-#ifdef _OPENMP
-#pragma omp simd aligned(in, out : 16)
-#endif
-    for (int c = 0; c < 4; c++)
-    {
-      out[k + c] = in[k + c] * weights[c];
-    }
+    _vibrance_pixel(in + k, out + k, amount);
+  }
+}
+
+void process_pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *const out, const size_t npixels)
+{
+  const dt_iop_vibrance_data_t *const d = (dt_iop_vibrance_data_t *)piece->data;
+  const float amount = (d->amount * 0.01);
+
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+  {
+    _vibrance_pixel(in + k, out + k, amount);
   }
 }
 
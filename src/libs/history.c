@@ -182,6 +182,9 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_change_callback), self);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_module_remove_callback), self);
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+  g_list_free_full(d->previous_snapshot, dt_dev_free_history_item);
+  g_list_free_full(d->previous_iop_order_list, free);
   g_free(self->data);
   self->data = NULL;
 }
@@ -257,7 +260,8 @@ static GtkWidget *_lib_history_create_button(dt_lib_module_t *self, int num, con
   return hbox;
 }
 
-static void _reset_module_instance(GList *hist, dt_iop_module_t *module, int multi_priority)
+// base is the list hist shares items with, if any. those are copied before being changed.
+static void _reset_module_instance(GList *base, GList *hist, dt_iop_module_t *module, int multi_priority)
 {
   for(; hist; hist = g_list_next(hist))
   {
@@ -265,6 +269,7 @@ static void _reset_module_instance(GList *hist, dt_iop_module_t *module, int mul
 
     if(!hit->module && strcmp(hit->op_name, module->op) == 0 && hit->multi_priority == multi_priority)
     {
+      hit = dt_history_item_unshare(base, hist);
       hit->module = module;
     }
   }
@@ -280,13 +285,16 @@ static void _undo_items_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data
 {
   struct _cb_data *udata = (struct _cb_data *)user_data;
   dt_undo_history_t *hdata = (dt_undo_history_t *)data;
-  _reset_module_instance(hdata->after_snapshot, udata->module, udata->multi_priority);
+  _reset_module_instance(hdata->before_snapshot, hdata->after_snapshot, udata->module, udata->multi_priority);
 }
 
 static void _history_invalidate_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item)
 {
   dt_iop_module_t *module = (dt_iop_module_t *)user_data;
   dt_undo_history_t *hist = (dt_undo_history_t *)item;
+  // the before snapshot must keep the module, don't invalidate the items shared with it
+  for(GList *l = hist->after_snapshot; l; l = g_list_next(l))
+    if(((dt_dev_history_item_t *)l->data)->module == module) dt_history_item_unshare(hist->before_snapshot, l);
   dt_dev_invalidate_history_module(hist->after_snapshot, module);
 }
 
@@ -526,7 +534,7 @@ static int _create_deleted_modules(GList **_iop_list, GList *history_list)
       // if not already done, set the module to all others same instance
       if(!done)
       {
-        _reset_module_instance(history_list, module, hitem->multi_priority);
+        _reset_module_instance(NULL, history_list, module, hitem->multi_priority);
 
         // and do that also in the undo/redo lists
         struct _cb_data udata = { module, hitem->multi_priority };
@@ -655,8 +663,8 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _history_undo_data_free(gpointer data)
 {
   dt_undo_history_t *hist = (dt_undo_history_t *)data;
+  dt_history_free_shared(hist->before_snapshot, hist->after_snapshot);
   g_list_free_full(hist->before_snapshot, dt_dev_free_history_item);
-  g_list_free_full(hist->after_snapshot, dt_dev_free_history_item);
   g_list_free_full(hist->before_iop_order_list, free);
   g_list_free_full(hist->after_iop_order_list, free);
   free(data);
@@ -677,12 +685,17 @@ static void _lib_history_will_change_callback(gpointer instance, GList *history,
   {
     // history is about to change, here we want to record a snapshot of the history for the undo
     // record previous history
-    g_list_free_full(lib->previous_snapshot, free);
+    g_list_free_full(lib->previous_snapshot, dt_dev_free_history_item);
     g_list_free_full(lib->previous_iop_order_list, free);
     lib->previous_snapshot = history;
     lib->previous_history_end = history_end;
     lib->previous_iop_order_list = iop_order_list;
   }
+  else
+  {
+    g_list_free_full(history, dt_dev_free_history_item);
+    g_list_free_full(iop_order_list, free);
+  }
 
   lib->record_history_level += 1;
 }
@@ -1033,11 +1046,15 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
   {
     /* record undo/redo history snapshot */
     dt_undo_history_t *hist = malloc(sizeof(dt_undo_history_t));
-    hist->before_snapshot = dt_history_duplicate(d->previous_snapshot);
+    // the record takes over the snapshot from before the change, the one after it only
+    // copies the items that changed
+    hist->before_snapshot = d->previous_snapshot;
     hist->before_end = d->previous_history_end;
-    hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
+    hist->before_iop_order_list = d->previous_iop_order_list;
+    d->previous_snapshot = NULL;
+    d->previous_iop_order_list = NULL;
 
-    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
+    hist->after_snapshot = dt_history_duplicate_shared(hist->before_snapshot, darktable.develop->history);
     hist->after_end = darktable.develop->history_end;
     hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
 
@@ -0,0 +1,390 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2021 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * darktable-bench-iop: time the process() and process_tiling() kernels of
+ * single image operations on synthetic input and report the results as JSON.
+ *
+ * Please see README.txt for more detailed documentation.
+ */
+#include <float.h>
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/darktable.h"
+#include "common/image.h"
+#include "config.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe_hb.h"
+
+#include "../unittests/util/testimg.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+// bayer pattern used for modules working on raw data (RGGB)
+#define BENCH_FILTERS 0x94949494u
+
+typedef struct bench_result_t
+{
+  double seconds; // best of all runs
+  size_t bytes;   // read and written per run
+  size_t pixels;  // written per run
+} bench_result_t;
+
+static void usage(const char *progname)
+{
+  fprintf(stderr,
+          "usage: %s [-w|--width <pixels>] [-h|--height <pixels>] [-t|--threads <n>]\n"
+          "  [-r|--runs <n>] [--no-tiling] [<operation>|<path to iop library>]... [--core <darktable options>]\n\n"
+          "without operations all available image operations are benchmarked.\n",
+          progname);
+}
+
+// a smooth, colourful gradient covering several EV, so that no module takes a trivial code path
+static Testimg *_bench_testimg(const int width, const int height)
+{
+  Testimg *ti = testimg_alloc(width, height);
+  ti->name = "bench";
+  for_testimg_pixels_p_yx(ti)
+  {
+    const float fx = (float)x / width, fy = (float)y / height;
+    const float ev = exp2f(6.0f * fx - 4.0f);
+    p[0] = ev * (0.5f + 0.5f * fy);
+    p[1] = ev * (0.75f - 0.25f * fy);
+    p[2] = ev * (1.0f - 0.5f * fx * fy);
+    p[3] = 0.0f;
+  }
+  return ti;
+}
+
+// copy the test image into an aligned buffer of the layout the module expects as input
+static void *_bench_input(const Testimg *ti, const dt_iop_buffer_dsc_t *dsc)
+{
+  const size_t npixels = (size_t)ti->width * ti->height;
+  void *buf = dt_alloc_align(64, npixels * dt_iop_buffer_dsc_to_bpp(dsc));
+  if(!buf) return NULL;
+
+  for(int y = 0; y < ti->height; y++)
+    for(int x = 0; x < ti->width; x++)
+    {
+      const float *p = get_pixel(ti, x, y);
+      const size_t k = (size_t)y * ti->width + x;
+      if(dsc->channels == 1)
+      {
+        const float v = MIN(p[FC(y, x, dsc->filters)], 1.0f);
+        if(dsc->datatype == TYPE_UINT16)
+          ((uint16_t *)buf)[k] = (uint16_t)(v * 65535.0f);
+        else
+          ((float *)buf)[k] = v;
+      }
+      else
+        memcpy((float *)buf + 4 * k, p, sizeof(float) * 4);
+    }
+  return buf;
+}
+
+static double _bench_run(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const void *input, void *output,
+                         const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, const size_t in_bpp,
+                         const int runs, const gboolean tiling)
+{
+  double best = DBL_MAX;
+  // one more run than requested, to warm up caches and lazily initialised tables
+  for(int k = 0; k <= runs; k++)
+  {
+    const double start = dt_get_wtime();
+    if(tiling)
+      module->process_tiling(module, piece, input, output, roi_in, roi_out, in_bpp);
+    else
+      module->process(module, piece, input, output, roi_in, roi_out);
+    const double end = dt_get_wtime();
+    if(k > 0) best = MIN(best, end - start);
+  }
+  return best;
+}
+
+static void _bench_print(const char *kernel, const bench_result_t *res)
+{
+  printf("      \"%s\": { \"seconds\": %.6f, \"ns_per_pixel\": %.3f, \"gb_per_s\": %.3f }", kernel, res->seconds,
+         1e9 * res->seconds / res->pixels, res->bytes / res->seconds / 1e9);
+}
+
+// benchmark one module. returns 0 on success, prints one json object
+static int _bench_module(dt_iop_module_so_t *so, const int width, const int height, const int runs,
+                         const gboolean tiling, const gboolean first)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, FALSE);
+
+  // raw modules get a single channel bayer mosaic, everything else rgba floats
+  const gboolean raw = so->default_colorspace(NULL, NULL, NULL) == iop_cs_RAW;
+  dt_image_init(&dev.image_storage);
+  dev.image_storage.id = 1;
+  dev.image_storage.width = dev.image_storage.p_width = dev.image_storage.final_width = width;
+  dev.image_storage.height = dev.image_storage.p_height = dev.image_storage.final_height = height;
+  dev.image_storage.flags = raw ? DT_IMAGE_RAW : DT_IMAGE_HDR;
+  dev.image_storage.buf_dsc = (dt_iop_buffer_dsc_t){.channels = raw ? 1 : 4, .datatype = TYPE_FLOAT,
+                                                    .filters = raw ? BENCH_FILTERS : 0u,
+                                                    .cst = raw ? iop_cs_RAW : iop_cs_rgb };
+  for(int k = 0; k < 4; k++)
+  {
+    dev.image_storage.buf_dsc.processed_maximum[k] = 1.0f;
+    dev.image_storage.wb_coeffs[k] = 1.0f;
+  }
+
+  dt_dev_pixelpipe_t pipe;
+  dt_dev_pixelpipe_init_dummy(&pipe, width, height);
+  dt_dev_pixelpipe_set_input(&pipe, &dev, NULL, width, height, 1.0f);
+
+  dt_iop_module_t *module = (dt_iop_module_t *)calloc(1, sizeof(dt_iop_module_t));
+  if(dt_iop_load_module(module, so, &dev))
+  {
+    fprintf(stderr, "[bench_iop] can't instantiate `%s'\n", so->op);
+    dt_dev_pixelpipe_cleanup(&pipe);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+  module->global_data = so->data;
+  module->so = so;
+
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)calloc(1, sizeof(dt_dev_pixelpipe_iop_t));
+  piece->enabled = TRUE;
+  piece->colors = raw ? 1 : 4;
+  piece->iscale = pipe.iscale;
+  piece->iwidth = pipe.iwidth;
+  piece->iheight = pipe.iheight;
+  piece->module = module;
+  piece->pipe = &pipe;
+  piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
+  dt_iop_init_pipe(module, &pipe, piece);
+  pipe.nodes = g_list_append(pipe.nodes, piece);
+  dt_iop_commit_params(module, module->default_params, module->default_blendop_params, &pipe, piece);
+
+  // let the module decide about geometry and buffer layout
+  dt_iop_roi_t roi_full = { 0, 0, width, height, 1.0f };
+  dt_iop_roi_t roi_in, roi_out;
+  module->modify_roi_out(module, piece, &roi_out, &roi_full);
+  module->modify_roi_in(module, piece, &roi_out, &roi_in);
+  piece->buf_in = roi_full;
+  piece->buf_out = roi_out;
+  piece->processed_roi_in = roi_in;
+  piece->processed_roi_out = roi_out;
+
+  piece->dsc_in = pipe.dsc;
+  module->input_format(module, &pipe, piece, &piece->dsc_in);
+  piece->dsc_out = piece->dsc_in;
+  module->output_format(module, &pipe, piece, &piece->dsc_out);
+  pipe.dsc = piece->dsc_out;
+
+  const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_in);
+  const size_t out_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
+
+  Testimg *ti = _bench_testimg(roi_in.width, roi_in.height);
+  void *input = _bench_input(ti, &piece->dsc_in);
+  void *output = dt_alloc_align(64, (size_t)roi_out.width * roi_out.height * out_bpp);
+  testimg_free(ti);
+
+  int err = 0;
+  if(!input || !output || roi_out.width <= 1 || roi_out.height <= 1)
+  {
+    fprintf(stderr, "[bench_iop] can't set up buffers for `%s'\n", so->op);
+    err = 1;
+  }
+  else
+  {
+    bench_result_t res = { 0 };
+    res.pixels = (size_t)roi_out.width * roi_out.height;
+    res.bytes = (size_t)roi_in.width * roi_in.height * in_bpp + res.pixels * out_bpp;
+
+    printf("%s    { \"operation\": \"%s\", \"version\": %d, \"input\": [%d, %d, %zu], \"output\": [%d, %d, %zu],\n",
+           first ? "" : ",\n", so->op, so->version(), roi_in.width, roi_in.height, in_bpp, roi_out.width,
+           roi_out.height, out_bpp);
+
+    res.seconds = _bench_run(module, piece, input, output, &roi_in, &roi_out, in_bpp, runs, FALSE);
+    _bench_print("process", &res);
+
+    if(tiling && piece->process_tiling_ready)
+    {
+      res.seconds = _bench_run(module, piece, input, output, &roi_in, &roi_out, in_bpp, runs, TRUE);
+      printf(",\n");
+      _bench_print("process_tiling", &res);
+    }
+    printf(" }");
+    fflush(stdout);
+  }
+
+  dt_free_align(input);
+  dt_free_align(output);
+
+  // this also cleans up the piece
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_iop_cleanup_module(module);
+  free(module);
+  dt_dev_cleanup(&dev);
+  return err;
+}
+
+// find an operation by name, or load it from a library file
+static dt_iop_module_so_t *_bench_find_so(const char *arg)
+{
+  for(GList *iop = darktable.iop; iop; iop = g_list_next(iop))
+  {
+    dt_iop_module_so_t *so = (dt_iop_module_so_t *)iop->data;
+    if(!strcmp(so->op, arg)) return so;
+  }
+
+  if(!g_file_test(arg, G_FILE_TEST_IS_REGULAR)) return NULL;
+
+  // libexposure.so -> exposure
+  gchar *base = g_path_get_basename(arg);
+  gchar *op = base;
+  if(g_str_has_prefix(op, SHARED_MODULE_PREFIX)) op += strlen(SHARED_MODULE_PREFIX);
+  if(g_str_has_suffix(op, SHARED_MODULE_SUFFIX)) op[strlen(op) - strlen(SHARED_MODULE_SUFFIX)] = '\0';
+
+  dt_iop_module_so_t *so = (dt_iop_module_so_t *)calloc(1, sizeof(dt_iop_module_so_t));
+  if(dt_iop_load_module_so(so, arg, op))
+  {
+    free(so);
+    so = NULL;
+  }
+  g_free(base);
+  return so;
+}
+
+int main(int argc, char *arg[])
+{
+  int width = 4000, height = 3000, threads = 0, runs = 5;
+  gboolean tiling = TRUE;
+  GList *ops = NULL;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(EXIT_FAILURE);
+    }
+    else if((!strcmp(arg[k], "-w") || !strcmp(arg[k], "--width")) && argc > k + 1)
+      width = MAX(atoi(arg[++k]), 2);
+    else if((!strcmp(arg[k], "-h") || !strcmp(arg[k], "--height")) && argc > k + 1)
+      height = MAX(atoi(arg[++k]), 2);
+    else if((!strcmp(arg[k], "-t") || !strcmp(arg[k], "--threads")) && argc > k + 1)
+      threads = MAX(atoi(arg[++k]), 1);
+    else if((!strcmp(arg[k], "-r") || !strcmp(arg[k], "--runs")) && argc > k + 1)
+      runs = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--no-tiling"))
+      tiling = FALSE;
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else if(arg[k][0] == '-')
+    {
+      usage(arg[0]);
+      exit(EXIT_FAILURE);
+    }
+    else
+      ops = g_list_append(ops, arg[k]);
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc(sizeof(char *) * (6 + argc - k + 1));
+  m_arg[m_argc++] = "darktable-bench-iop";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  m_arg[m_argc++] = "--disable-opencl";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // init dt without gui:
+  if(dt_init(m_argc, m_arg, FALSE, TRUE, NULL))
+  {
+    free(m_arg);
+    g_list_free(ops);
+    exit(EXIT_FAILURE);
+  }
+
+#ifdef _OPENMP
+  if(threads) darktable.num_openmp_threads = threads;
+  omp_set_num_threads(darktable.num_openmp_threads);
+  threads = darktable.num_openmp_threads;
+#else
+  threads = 1;
+#endif
+
+  printf("{\n  \"darktable\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %d,\n  \"runs\": %d,\n"
+         "  \"modules\": [\n",
+         darktable_package_version, width, height, threads, runs);
+
+  int failed = 0;
+  gboolean first = TRUE;
+  if(ops)
+  {
+    for(GList *iter = ops; iter; iter = g_list_next(iter))
+    {
+      dt_iop_module_so_t *so = _bench_find_so((const char *)iter->data);
+      if(!so)
+      {
+        fprintf(stderr, "[bench_iop] unknown operation `%s'\n", (const char *)iter->data);
+        failed++;
+        continue;
+      }
+      if(_bench_module(so, width, height, runs, tiling, first))
+        failed++;
+      else
+        first = FALSE;
+    }
+  }
+  else
+  {
+    for(GList *iter = darktable.iop; iter; iter = g_list_next(iter))
+    {
+      dt_iop_module_so_t *so = (dt_iop_module_so_t *)iter->data;
+      if(so->flags() & IOP_FLAGS_DEPRECATED) continue;
+      if(_bench_module(so, width, height, runs, tiling, first))
+        failed++;
+      else
+        first = FALSE;
+    }
+  }
+
+  printf("\n  ]\n}\n");
+
+  g_list_free(ops);
+  dt_cleanup();
+  free(m_arg);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -54,6 +54,8 @@
 static void dt_view_manager_load_modules(dt_view_manager_t *vm);
 static int dt_view_load_module(void *v, const char *libname, const char *module_name);
 static void dt_view_unload_module(dt_view_t *view);
+static void _surface_cache_init();
+static void _surface_cache_cleanup();
 
 void dt_view_manager_init(dt_view_manager_t *vm)
 {
@@ -89,6 +91,8 @@ void dt_view_manager_init(dt_view_manager_t *vm)
 
   vm->current_view = NULL;
   vm->audio.audio_player_id = -1;
+
+  _surface_cache_init();
 }
 
 void dt_view_manager_gui_init(dt_view_manager_t *vm)
@@ -102,6 +106,7 @@ void dt_view_manager_gui_init(dt_view_manager_t *vm)
 
 void dt_view_manager_cleanup(dt_view_manager_t *vm)
 {
+  _surface_cache_cleanup();
   for(GList *iter = vm->views; iter; iter = g_list_next(iter)) dt_view_unload_module((dt_view_t *)iter->data);
   g_list_free_full(vm->views, free);
   vm->views = NULL;
@@ -988,6 +993,205 @@ int dt_view_get_image_to_act_on()
   return ret;
 }
 
+// display ready thumbnails.
+//
+// turning a mipmap into a surface means a color transform of all of it to the display profile and
+// a scaled paint, for every thumbnail on every redraw of the lighttable. the results are kept here
+// with a memory budget, so redrawing an unchanged thumbnail only copies its pixels. they are dropped
+// when the mipmap of the image is updated or the display profile changes.
+
+typedef struct _surface_key_t
+{
+  int32_t imgid;
+  int32_t width, height; // size asked for, in dots
+  int32_t mip;
+  int32_t quality;
+  int32_t filter;
+  float ppd;
+  const void *transform; // to the display profile, NULL if none
+} _surface_key_t;
+
+typedef struct _surface_entry_t
+{
+  uint64_t hash;
+  _surface_key_t key;
+  cairo_surface_t *surface;
+  size_t bytes;
+  uint64_t used; // clock of the last lookup
+} _surface_entry_t;
+
+typedef struct _surface_cache_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries; // hash -> _surface_entry_t
+  size_t bytes;
+  size_t max_bytes;
+  uint64_t clock;
+  uint32_t generation; // changes whenever the cache is cleared
+} _surface_cache_t;
+
+static _surface_cache_t _surface_cache = { 0 };
+
+static void _surface_entry_free(gpointer data)
+{
+  _surface_entry_t *entry = (_surface_entry_t *)data;
+  cairo_surface_destroy(entry->surface);
+  free(entry);
+}
+
+static uint64_t _surface_key_hash(const _surface_key_t *key)
+{
+  uint64_t hash = 5381;
+  const char *str = (const char *)key;
+  for(size_t i = 0; i < sizeof(_surface_key_t); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// drop the surfaces of `imgid', of all images if it is <= 0
+static void _surface_cache_invalidate(const int imgid)
+{
+  if(!_surface_cache.entries) return;
+  dt_pthread_mutex_lock(&_surface_cache.lock);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, _surface_cache.entries);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    _surface_entry_t *entry = (_surface_entry_t *)value;
+    if(imgid > 0 && entry->key.imgid != imgid) continue;
+    _surface_cache.bytes -= entry->bytes;
+    g_hash_table_iter_remove(&iter);
+  }
+  _surface_cache.generation++;
+  dt_pthread_mutex_unlock(&_surface_cache.lock);
+}
+
+static void _surface_cache_mipmap_updated(gpointer instance, int imgid, gpointer user_data)
+{
+  _surface_cache_invalidate(imgid);
+}
+
+static void _surface_cache_profile_changed(gpointer instance, gpointer user_data)
+{
+  _surface_cache_invalidate(-1);
+}
+
+static void _surface_cache_profile_user_changed(gpointer instance, uint8_t profile_type, gpointer user_data)
+{
+  if(profile_type == DT_COLORSPACES_PROFILE_TYPE_DISPLAY) _surface_cache_invalidate(-1);
+}
+
+static void _surface_cache_init()
+{
+  dt_pthread_mutex_init(&_surface_cache.lock, NULL);
+  _surface_cache.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _surface_entry_free);
+  _surface_cache.bytes = 0;
+  _surface_cache.max_bytes = MAX(dt_conf_get_int64("thumbnail_surface_cache_memory"), 0);
+  _surface_cache.clock = 0;
+  _surface_cache.generation = 0;
+
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED,
+                                  G_CALLBACK(_surface_cache_mipmap_updated), NULL);
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_CONTROL_PROFILE_CHANGED,
+                                  G_CALLBACK(_surface_cache_profile_changed), NULL);
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_CONTROL_PROFILE_USER_CHANGED,
+                                  G_CALLBACK(_surface_cache_profile_user_changed), NULL);
+}
+
+static void _surface_cache_cleanup()
+{
+  if(!_surface_cache.entries) return;
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_surface_cache_mipmap_updated), NULL);
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_surface_cache_profile_changed), NULL);
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_surface_cache_profile_user_changed), NULL);
+  g_hash_table_destroy(_surface_cache.entries);
+  _surface_cache.entries = NULL;
+  dt_pthread_mutex_destroy(&_surface_cache.lock);
+}
+
+// a surface of its own for the caller, they may draw on it
+static cairo_surface_t *_surface_copy(cairo_surface_t *src)
+{
+  const int width = cairo_image_surface_get_width(src);
+  const int height = cairo_image_surface_get_height(src);
+  cairo_surface_t *dst = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  if(cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) return dst;
+  cairo_surface_flush(src);
+  cairo_surface_flush(dst);
+  memcpy(cairo_image_surface_get_data(dst), cairo_image_surface_get_data(src),
+         (size_t)cairo_image_surface_get_stride(src) * height);
+  cairo_surface_mark_dirty(dst);
+  return dst;
+}
+
+// a copy of the cached surface for `key', NULL if there is none. `generation' is to be passed
+// to _surface_cache_put() then.
+static cairo_surface_t *_surface_cache_get(const _surface_key_t *key, const uint64_t hash, uint32_t *generation)
+{
+  cairo_surface_t *surface = NULL;
+  dt_pthread_mutex_lock(&_surface_cache.lock);
+  *generation = _surface_cache.generation;
+  _surface_entry_t *entry = (_surface_entry_t *)g_hash_table_lookup(_surface_cache.entries, &hash);
+  if(entry && !memcmp(&entry->key, key, sizeof(_surface_key_t)))
+  {
+    entry->used = ++_surface_cache.clock;
+    surface = _surface_copy(entry->surface);
+  }
+  dt_pthread_mutex_unlock(&_surface_cache.lock);
+  return surface;
+}
+
+// keep a copy of `surface' unless the cache has been cleared since `generation'
+static void _surface_cache_put(const _surface_key_t *key, const uint64_t hash, cairo_surface_t *surface,
+                               const uint32_t generation)
+{
+  const size_t bytes
+      = (size_t)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+  // one huge surface (full preview) shouldn't flush all the thumbnails
+  if(bytes > _surface_cache.max_bytes / 4) return;
+
+  _surface_entry_t *entry = (_surface_entry_t *)calloc(1, sizeof(_surface_entry_t));
+  if(!entry) return;
+  entry->hash = hash;
+  entry->key = *key;
+  entry->surface = _surface_copy(surface);
+  entry->bytes = bytes;
+
+  dt_pthread_mutex_lock(&_surface_cache.lock);
+  if(generation != _surface_cache.generation)
+  {
+    // the mipmap or the profile changed while we were drawing
+    dt_pthread_mutex_unlock(&_surface_cache.lock);
+    _surface_entry_free(entry);
+    return;
+  }
+  _surface_entry_t *old = (_surface_entry_t *)g_hash_table_lookup(_surface_cache.entries, &hash);
+  if(old)
+  {
+    _surface_cache.bytes -= old->bytes;
+    g_hash_table_remove(_surface_cache.entries, &hash);
+  }
+  // drop the least recently used surfaces until this one fits
+  while(_surface_cache.bytes + bytes > _surface_cache.max_bytes && g_hash_table_size(_surface_cache.entries))
+  {
+    GHashTableIter iter;
+    gpointer k, value;
+    _surface_entry_t *oldest = NULL;
+    g_hash_table_iter_init(&iter, _surface_cache.entries);
+    while(g_hash_table_iter_next(&iter, &k, &value))
+    {
+      _surface_entry_t *e = (_surface_entry_t *)value;
+      if(!oldest || e->used < oldest->used) oldest = e;
+    }
+    _surface_cache.bytes -= oldest->bytes;
+    g_hash_table_remove(_surface_cache.entries, &oldest->hash);
+  }
+  entry->used = ++_surface_cache.clock;
+  g_hash_table_insert(_surface_cache.entries, &entry->hash, entry);
+  _surface_cache.bytes += bytes;
+  dt_pthread_mutex_unlock(&_surface_cache.lock);
+}
+
 dt_view_surface_value_t dt_view_image_get_surface(int imgid, int width, int height, cairo_surface_t **surface,
                                                   const gboolean quality)
 {
@@ -1018,6 +1222,75 @@ dt_view_surface_value_t dt_view_image_get_surface(int imgid, int width, int heig
     return DT_VIEW_SURFACE_KO;
   }
 
+  gboolean have_lock = FALSE;
+  cmsHTRANSFORM transform = NULL;
+
+  if(dt_conf_get_bool("cache_color_managed"))
+  {
+    pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
+    have_lock = TRUE;
+
+    // we only color manage when a thumbnail is sRGB or AdobeRGB. everything else just gets dumped to the
+    // screen
+    if(buf.color_space == DT_COLORSPACE_SRGB
+       && darktable.color_profiles->transform_srgb_to_display)
+    {
+      transform = darktable.color_profiles->transform_srgb_to_display;
+    }
+    else if(buf.color_space == DT_COLORSPACE_ADOBERGB
+            && darktable.color_profiles->transform_adobe_rgb_to_display)
+    {
+      transform = darktable.color_profiles->transform_adobe_rgb_to_display;
+    }
+    else
+    {
+      pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+      have_lock = FALSE;
+      if(buf.color_space == DT_COLORSPACE_NONE)
+      {
+        fprintf(stderr, "oops, there seems to be a code path not setting the color space of thumbnails!\n");
+      }
+      else if(buf.color_space != DT_COLORSPACE_DISPLAY && buf.color_space != DT_COLORSPACE_DISPLAY2)
+      {
+        fprintf(stderr,
+                "oops, there seems to be a code path setting an unhandled color space of thumbnails (%s)!\n",
+                dt_colorspaces_get_name(buf.color_space, "from file"));
+      }
+    }
+  }
+
+  // only the right mip is worth keeping, anything else gets replaced soon. focus peaking is
+  // drawn into the surface.
+  const gboolean cacheable = _surface_cache.entries && _surface_cache.max_bytes && mip == buf.size
+                             && !(buf_wd <= 8 && buf_ht <= 8) && !darktable.gui->show_focus_peaking;
+  _surface_key_t key;
+  memset(&key, 0, sizeof(key)); // the padding is hashed too
+  uint64_t hash = 0;
+  uint32_t generation = 0;
+  if(cacheable)
+  {
+    key.imgid = imgid;
+    key.width = width;
+    key.height = height;
+    key.mip = mip;
+    key.quality = quality;
+    key.filter = darktable.gui->filter_image;
+    key.ppd = darktable.gui->ppd_thb;
+    key.transform = transform;
+    hash = _surface_key_hash(&key);
+
+    cairo_surface_t *cached = _surface_cache_get(&key, hash, &generation);
+    if(cached)
+    {
+      if(have_lock) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      *surface = cached;
+      dt_print(DT_DEBUG_LIGHTTABLE, "[dt_view_image_get_surface]  id %i, dots %ix%i, surf %ix%i from cache\n",
+               imgid, width, height, cairo_image_surface_get_width(cached), cairo_image_surface_get_height(cached));
+      return DT_VIEW_SURFACE_OK;
+    }
+  }
+
   // so we create a new image surface to return
   float scale = fminf(width / (float)buf_wd, height / (float)buf_ht) * darktable.gui->ppd_thb;
   const int img_width = roundf(buf_wd * scale);
@@ -1031,43 +1304,6 @@ dt_view_surface_value_t dt_view_image_get_surface(int imgid, int width, int heig
   uint8_t *rgbbuf = (uint8_t *)calloc((size_t)buf_wd * buf_ht * 4, sizeof(uint8_t));
   if(rgbbuf)
   {
-    gboolean have_lock = FALSE;
-    cmsHTRANSFORM transform = NULL;
-
-    if(dt_conf_get_bool("cache_color_managed"))
-    {
-      pthread_rwlock_rdlock(&darktable.color_profiles->xprofile_lock);
-      have_lock = TRUE;
-
-      // we only color manage when a thumbnail is sRGB or AdobeRGB. everything else just gets dumped to the
-      // screen
-      if(buf.color_space == DT_COLORSPACE_SRGB
-         && darktable.color_profiles->transform_srgb_to_display)
-      {
-        transform = darktable.color_profiles->transform_srgb_to_display;
-      }
-      else if(buf.color_space == DT_COLORSPACE_ADOBERGB
-              && darktable.color_profiles->transform_adobe_rgb_to_display)
-      {
-        transform = darktable.color_profiles->transform_adobe_rgb_to_display;
-      }
-      else
-      {
-        pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-        have_lock = FALSE;
-        if(buf.color_space == DT_COLORSPACE_NONE)
-        {
-          fprintf(stderr, "oops, there seems to be a code path not setting the color space of thumbnails!\n");
-        }
-        else if(buf.color_space != DT_COLORSPACE_DISPLAY && buf.color_space != DT_COLORSPACE_DISPLAY2)
-        {
-          fprintf(stderr,
-                  "oops, there seems to be a code path setting an unhandled color space of thumbnails (%s)!\n",
-                  dt_colorspaces_get_name(buf.color_space, "from file"));
-        }
-      }
-    }
-
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) shared(buf, rgbbuf, transform)
 #endif
@@ -1090,11 +1326,10 @@ dt_view_surface_value_t dt_view_image_get_surface(int imgid, int width, int heig
         }
       }
     }
-    if(have_lock) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
-
     const int32_t stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, buf_wd);
     tmp_surface = cairo_image_surface_create_for_data(rgbbuf, CAIRO_FORMAT_RGB24, buf_wd, buf_ht, stride);
   }
+  if(have_lock) pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
   // draw the image scaled:
   if(tmp_surface)
@@ -1141,6 +1376,8 @@ dt_view_surface_value_t dt_view_image_get_surface(int imgid, int width, int heig
   else
     ret = DT_VIEW_SURFACE_OK;
 
+  if(cacheable && rgbbuf && ret == DT_VIEW_SURFACE_OK) _surface_cache_put(&key, hash, *surface, generation);
+
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
   if(rgbbuf) free(rgbbuf);
 